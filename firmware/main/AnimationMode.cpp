@@ -0,0 +1,329 @@
+#include "AnimationMode.h"
+#include "AnimationOpcodes.h"
+#include "utils.h"
+#include <avr/eeprom.h>
+
+// EEPROM header in front of the program
+#define ANIM_MAGIC 0xA7
+#define ANIM_HEADER_SIZE 4  // magic, length u16, crc8
+#define ANIM_PROGRAM_BASE (ANIM_EEPROM_BASE + ANIM_HEADER_SIZE)
+
+// Instruction size including the opcode, 0 for unknown opcodes
+static uint8_t operandSize(uint8_t op) {
+    switch (op) {
+        case ANIM_OP_PUSH:
+            return 2;
+        case ANIM_OP_PUSH16:
+        case ANIM_OP_BLIT:
+        case ANIM_OP_JMP:
+        case ANIM_OP_JZ:
+        case ANIM_OP_JNZ:
+        case ANIM_OP_LOOP:
+            return 3;
+        case ANIM_OP_HALT: case ANIM_OP_DUP: case ANIM_OP_DROP: case ANIM_OP_SWAP:
+        case ANIM_OP_ADD: case ANIM_OP_SUB: case ANIM_OP_EQ: case ANIM_OP_LT:
+        case ANIM_OP_RAND: case ANIM_OP_CLEAR: case ANIM_OP_SETROW: case ANIM_OP_GETROW:
+        case ANIM_OP_SHIFT: case ANIM_OP_INVERT: case ANIM_OP_WAIT:
+        case ANIM_OP_ORIENT: case ANIM_OP_ANGLE:
+            return 1;
+    }
+    return 0;
+}
+
+AnimationMode::AnimationMode(LedControl* lc, MPU6050* mpu) {
+    this->lc = lc;
+    this->mpu = mpu;
+    length = 0;
+    pc = 0;
+    sp = 0;
+    state = ANIM_IDLE;
+    waitUntil = 0;
+}
+
+void AnimationMode::init() {
+    // Re-check the stored program, a half-finished upload leaves no magic
+    length = 0;
+    state = ANIM_IDLE;
+    if (eeprom_read_byte((const uint8_t*)ANIM_EEPROM_BASE) != ANIM_MAGIC) return;
+
+    uint16_t len = eeprom_read_byte((const uint8_t*)(ANIM_EEPROM_BASE + 1)) |
+                   (eeprom_read_byte((const uint8_t*)(ANIM_EEPROM_BASE + 2)) << 8);
+    uint8_t crc = eeprom_read_byte((const uint8_t*)(ANIM_EEPROM_BASE + 3));
+    commit(len, crc);
+}
+
+void AnimationMode::enter() {
+    lc->clearDisplay(MATRIX_A);
+    lc->clearDisplay(MATRIX_B);
+    pc = 0;
+    sp = 0;
+    state = length ? ANIM_RUNNING : ANIM_IDLE;
+}
+
+void AnimationMode::exit() {
+    // Program stays in EEPROM and restarts on the next enter()
+}
+
+void AnimationMode::update() {
+    if (state == ANIM_WAITING && (long)(millis() - waitUntil) >= 0) {
+        state = ANIM_RUNNING;
+    }
+    if (state == ANIM_RUNNING) run();
+}
+
+bool AnimationMode::isAnimating() const {
+    return state == ANIM_RUNNING || state == ANIM_WAITING;
+}
+
+uint16_t AnimationMode::getLength() const {
+    return length;
+}
+
+uint8_t AnimationMode::getState() const {
+    return state;
+}
+
+uint16_t AnimationMode::getPc() const {
+    return pc;
+}
+
+uint8_t AnimationMode::fetch(uint16_t addr) const {
+    return eeprom_read_byte((const uint8_t*)(size_t)(ANIM_PROGRAM_BASE + addr));
+}
+
+uint16_t AnimationMode::fetch16(uint16_t addr) const {
+    return fetch(addr) | (fetch(addr + 1) << 8);
+}
+
+bool AnimationMode::write(uint16_t offset, const uint8_t* data, uint8_t len) {
+    if (offset > ANIM_MAX_PROGRAM || len > ANIM_MAX_PROGRAM - offset) return false;
+
+    if (length) {
+        eeprom_update_byte((uint8_t*)ANIM_EEPROM_BASE, 0);
+        length = 0;
+        state = ANIM_IDLE;
+    }
+    eeprom_update_block(data, (void*)(size_t)(ANIM_PROGRAM_BASE + offset), len);
+    return true;
+}
+
+int AnimationMode::commit(uint16_t len, uint8_t crc) {
+    length = 0;
+    state = ANIM_IDLE;
+    if (len == 0 || len > ANIM_MAX_PROGRAM) return ANIM_BAD_UPLOAD;
+
+    uint8_t actual = 0;
+    for (uint16_t i = 0; i < len; i++) {
+        uint8_t b = fetch(i);
+        actual = crc8(&b, 1, actual);
+    }
+    if (actual != crc) return ANIM_BAD_UPLOAD;
+
+    int fault = validate(len);
+    if (fault != ANIM_VALID) return fault;
+
+    uint8_t header[ANIM_HEADER_SIZE] = { ANIM_MAGIC, (uint8_t)(len & 0xFF), (uint8_t)(len >> 8), crc };
+    eeprom_update_block(header, (void*)ANIM_EEPROM_BASE, sizeof(header));
+    length = len;
+    return ANIM_VALID;
+}
+
+int AnimationMode::validate(uint16_t len) const {
+    // Pass 1: decode every instruction and note where each one starts
+    uint8_t starts[(ANIM_MAX_PROGRAM + 7) / 8];
+    memset(starts, 0, sizeof(starts));
+
+    uint16_t at = 0;
+    while (at < len) {
+        uint8_t op = fetch(at);
+        uint16_t size = (op == ANIM_OP_DATA) ? (at + 1 < len ? 2 + fetch(at + 1) : 2) : operandSize(op);
+        if (size == 0 || size > len - at) return at;
+        starts[at >> 3] |= 1 << (at & 7);
+        at += size;
+    }
+
+    // Pass 2: jumps must land on an instruction, blits must stay in the program
+    for (at = 0; at < len; at++) {
+        if (!(starts[at >> 3] & (1 << (at & 7)))) continue;
+        uint8_t op = fetch(at);
+        if (op == ANIM_OP_BLIT) {
+            uint16_t addr = fetch16(at + 1);
+            if (len < 8 || addr > len - 8) return at;
+        } else if (op >= ANIM_OP_JMP && op <= ANIM_OP_LOOP) {
+            uint16_t addr = fetch16(at + 1);
+            if (addr >= len || !(starts[addr >> 3] & (1 << (addr & 7)))) return at;
+        }
+    }
+    return ANIM_VALID;
+}
+
+bool AnimationMode::push(int16_t value) {
+    if (sp >= ANIM_STACK_DEPTH) return false;
+    stack[sp++] = value;
+    return true;
+}
+
+bool AnimationMode::pop(int16_t* value) {
+    if (sp == 0) return false;
+    *value = stack[--sp];
+    return true;
+}
+
+void AnimationMode::shiftMatrix(uint8_t matrix, uint8_t dir) {
+    byte* rows = lc->getBuffer(matrix);
+    bool wrap = dir & 4;
+    switch (dir & 3) {
+        case 0: {
+            byte first = rows[0];
+            memmove(rows, rows + 1, 7);
+            rows[7] = wrap ? first : 0;
+            break;
+        }
+        case 1: {
+            byte last = rows[7];
+            memmove(rows + 1, rows, 7);
+            rows[0] = wrap ? last : 0;
+            break;
+        }
+        case 2:  // Towards column 0, which is bit 7
+            for (uint8_t r = 0; r < 8; r++) rows[r] = (rows[r] << 1) | (wrap ? rows[r] >> 7 : 0);
+            break;
+        case 3:
+            for (uint8_t r = 0; r < 8; r++) rows[r] = (rows[r] >> 1) | (wrap ? rows[r] << 7 : 0);
+            break;
+    }
+}
+
+void AnimationMode::run() {
+    int16_t a, b;
+
+    // A bounded number of steps per tick, so a tight loop can't starve the rest
+    for (uint16_t steps = 0; steps < ANIM_STEPS_PER_TICK; steps++) {
+        if (pc >= length) {
+            state = ANIM_HALTED;
+            return;
+        }
+
+        uint16_t at = pc;
+        uint8_t op = fetch(pc);
+        pc += (op == ANIM_OP_DATA) ? 2 + fetch(pc + 1) : operandSize(op);
+        bool ok = true;
+
+        switch (op) {
+            case ANIM_OP_HALT:
+                pc = at;
+                state = ANIM_HALTED;
+                return;
+            case ANIM_OP_PUSH:
+                ok = push(fetch(at + 1));
+                break;
+            case ANIM_OP_PUSH16:
+                ok = push((int16_t)fetch16(at + 1));
+                break;
+            case ANIM_OP_DUP:
+                ok = pop(&a) && push(a) && push(a);
+                break;
+            case ANIM_OP_DROP:
+                ok = pop(&a);
+                break;
+            case ANIM_OP_SWAP:
+                ok = pop(&b) && pop(&a) && push(b) && push(a);
+                break;
+            case ANIM_OP_ADD:
+                ok = pop(&b) && pop(&a) && push(a + b);
+                break;
+            case ANIM_OP_SUB:
+                ok = pop(&b) && pop(&a) && push(a - b);
+                break;
+            case ANIM_OP_EQ:
+                ok = pop(&b) && pop(&a) && push(a == b);
+                break;
+            case ANIM_OP_LT:
+                ok = pop(&b) && pop(&a) && push(a < b);
+                break;
+            case ANIM_OP_RAND:
+                ok = pop(&a) && push(a > 0 ? random(a) : 0);
+                break;
+            case ANIM_OP_CLEAR:
+                ok = pop(&a);
+                if (ok) lc->clearDisplay((uint8_t)a % NUM_MATRICES);
+                break;
+            case ANIM_OP_SETROW:
+                ok = pop(&b) && pop(&a);
+                if (ok) {
+                    uint8_t row = (uint8_t)a % (NUM_MATRICES * 8);
+                    lc->getBuffer(row >> 3)[row & 7] = (byte)b;
+                }
+                break;
+            case ANIM_OP_GETROW: {
+                ok = pop(&a);
+                uint8_t row = (uint8_t)a % (NUM_MATRICES * 8);
+                ok = ok && push(lc->getBuffer(row >> 3)[row & 7]);
+                break;
+            }
+            case ANIM_OP_BLIT:
+                ok = pop(&a);
+                if (ok) {
+                    byte* rows = lc->getBuffer((uint8_t)a % NUM_MATRICES);
+                    uint16_t src = fetch16(at + 1);
+                    for (uint8_t r = 0; r < 8; r++) rows[r] = fetch(src + r);
+                }
+                break;
+            case ANIM_OP_SHIFT:
+                ok = pop(&b) && pop(&a);
+                if (ok) shiftMatrix((uint8_t)a % NUM_MATRICES, (uint8_t)b);
+                break;
+            case ANIM_OP_INVERT:
+                ok = pop(&a);
+                if (ok) {
+                    byte* rows = lc->getBuffer((uint8_t)a % NUM_MATRICES);
+                    for (uint8_t r = 0; r < 8; r++) rows[r] = ~rows[r];
+                }
+                break;
+            case ANIM_OP_WAIT:
+                ok = pop(&a);
+                if (ok) {
+                    waitUntil = millis() + (a > 0 ? a : 0);
+                    state = ANIM_WAITING;
+                    return;
+                }
+                break;
+            case ANIM_OP_JMP:
+                pc = fetch16(at + 1);
+                break;
+            case ANIM_OP_JZ:
+                ok = pop(&a);
+                if (ok && a == 0) pc = fetch16(at + 1);
+                break;
+            case ANIM_OP_JNZ:
+                ok = pop(&a);
+                if (ok && a != 0) pc = fetch16(at + 1);
+                break;
+            case ANIM_OP_LOOP:
+                ok = pop(&a);
+                if (ok && --a > 0) {
+                    push(a);
+                    pc = fetch16(at + 1);
+                }
+                break;
+            case ANIM_OP_ORIENT: {
+                // Same axis as the hourglass neck: +X down puts matrix A on top
+                int16_t x = mpu->getRawX();
+                uint8_t o = mpu->isHorizontal() ? 0 : (x > 8192 ? 1 : (x < -8192 ? 2 : 3));
+                ok = push(o);
+                break;
+            }
+            case ANIM_OP_ANGLE:
+                ok = push(mpu->getAngle());
+                break;
+            case ANIM_OP_DATA:
+                break;
+        }
+
+        if (!ok) {
+            pc = at;
+            state = ANIM_FAULT;
+            return;
+        }
+    }
+}
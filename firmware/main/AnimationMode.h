@@ -0,0 +1,66 @@
+#ifndef ANIMATION_MODE_H
+#define ANIMATION_MODE_H
+
+#include "LedControl.h"
+#include "MPU6050.h"
+#include "config.h"
+
+/**
+ * Runs a small stack-based bytecode program stored in EEPROM, so custom
+ * animations need neither a re-flash nor a host streaming frames.
+ *
+ * The program is uploaded in chunks with write() and enabled with
+ * commit(), which checks the CRC and validates every instruction before
+ * the VM will run it (see ANIM_OP_* in AnimationOpcodes.h). Validation
+ * guarantees that operands and jump/blit targets stay inside the
+ * program; stack depth and matrix/row operands are checked at run time.
+ */
+
+// VM states
+#define ANIM_IDLE 0      // No valid program
+#define ANIM_RUNNING 1
+#define ANIM_WAITING 2   // In a WAIT
+#define ANIM_HALTED 3    // Reached HALT
+#define ANIM_FAULT 4     // Stack over/underflow, pc holds the instruction
+
+// commit() results other than the offset of an invalid instruction
+#define ANIM_VALID -1
+#define ANIM_BAD_UPLOAD -2  // Length out of range or CRC mismatch
+
+class AnimationMode {
+private:
+    LedControl* lc;
+    MPU6050* mpu;
+    uint16_t length;        // 0 while there is no valid program
+    uint16_t pc;
+    int16_t stack[ANIM_STACK_DEPTH];
+    uint8_t sp;
+    uint8_t state;
+    unsigned long waitUntil;
+
+    uint8_t fetch(uint16_t addr) const;
+    uint16_t fetch16(uint16_t addr) const;
+    int validate(uint16_t len) const;
+    bool push(int16_t value);
+    bool pop(int16_t* value);
+    void shiftMatrix(uint8_t matrix, uint8_t dir);
+    void run();
+
+public:
+    AnimationMode(LedControl* lc, MPU6050* mpu);
+    void init();
+    void enter();
+    void exit();
+    void update();
+    bool isAnimating() const;
+
+    // Upload: write chunks, then commit. Writing stops and invalidates the program.
+    bool write(uint16_t offset, const uint8_t* data, uint8_t len);
+    int commit(uint16_t len, uint8_t crc);
+
+    uint16_t getLength() const;
+    uint8_t getState() const;
+    uint16_t getPc() const;
+};
+
+#endif
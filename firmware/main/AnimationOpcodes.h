@@ -0,0 +1,40 @@
+#ifndef ANIMATION_OPCODES_H
+#define ANIMATION_OPCODES_H
+
+/*
+ * Animation VM instruction set, shared with tools/hganim.
+ *
+ * The stack holds int16 values. Matrix operands are device addresses
+ * (MATRIX_A is 1, MATRIX_B is 0) and rows are matrix * 8 + row (0-15),
+ * both taken modulo their range. Addresses are
+ * u16 little endian program offsets. Running off the end halts.
+ *
+ *   op     operands    stack               effect
+ */
+#define ANIM_OP_HALT 0x00   //              -                   stop, keep the frame
+#define ANIM_OP_PUSH 0x01   // u8           - n
+#define ANIM_OP_PUSH16 0x02 // i16          - n
+#define ANIM_OP_DUP 0x03    //              a - a a
+#define ANIM_OP_DROP 0x04   //              a -
+#define ANIM_OP_SWAP 0x05   //              a b - b a
+#define ANIM_OP_ADD 0x06    //              a b - a+b
+#define ANIM_OP_SUB 0x07    //              a b - a-b
+#define ANIM_OP_EQ 0x08     //              a b - a==b
+#define ANIM_OP_LT 0x09     //              a b - a<b
+#define ANIM_OP_RAND 0x0A   //              n - random(0..n-1)
+#define ANIM_OP_CLEAR 0x10  //              m -                 clear matrix m
+#define ANIM_OP_SETROW 0x11 //              row v -             set row to v
+#define ANIM_OP_GETROW 0x12 //              row - v
+#define ANIM_OP_BLIT 0x13   // addr         m -                 copy 8 row bytes at addr to m
+#define ANIM_OP_SHIFT 0x14  //              m dir -             dir 0 row-, 1 row+, 2 col-, 3 col+, +4 rotates
+#define ANIM_OP_INVERT 0x15 //              m -
+#define ANIM_OP_WAIT 0x20   //              ms -                show the frame and sleep
+#define ANIM_OP_JMP 0x30    // addr         -
+#define ANIM_OP_JZ 0x31     // addr         a -                 jump if a == 0
+#define ANIM_OP_JNZ 0x32    // addr         a -                 jump if a != 0
+#define ANIM_OP_LOOP 0x33   // addr         n - n-1 | -         jump while n-1 > 0, else drop
+#define ANIM_OP_ORIENT 0x40 //              - o                 0 flat, 1 A up, 2 B up, 3 on its side
+#define ANIM_OP_ANGLE 0x41  //              - degrees
+#define ANIM_OP_DATA 0x7F   // len, bytes   -                   skipped, holds BLIT data
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef BINARY_OPCODES_H
+#define BINARY_OPCODES_H
+
+/*
+ * Binary protocol constants, shared with the host tools.
+ *
+ * The host switches a text-mode link to binary by sending BIN_MAGIC.
+ * Frames are COBS encoded and terminated by 0x00:
+ *   request:  opcode, args..., crc8
+ *   response: opcode | BIN_RESPONSE, status, payload..., crc8
+ * The CRC-8 (poly 0x07) covers everything before it. Multi-byte
+ * values are little endian.
+ */
+
+#define BIN_MAGIC 0xB1
+#define BIN_VERSION 1
+#define BIN_MAX_FRAME 48      // Decoded bytes, including the CRC
+#define BIN_RESPONSE 0x80
+
+// Status byte
+#define BIN_OK 0
+#define BIN_ERR_CRC 1         // Sent with opcode BIN_OP_NAK
+#define BIN_ERR_UNKNOWN 2
+#define BIN_ERR_ARGS 3        // Wrong argument length
+#define BIN_ERR_RANGE 4
+#define BIN_ERR_INVALID 5     // Rejected content, payload = offset u16
+#define BIN_ERR_FULL 6        // Queue full, payload as for success
+
+// Opcodes                        args              -> response payload
+#define BIN_OP_HELLO 0x00      // -                 -> version u8 (also sent on entry)
+#define BIN_OP_GET_STATUS 0x01 // -                 -> mode u8
+#define BIN_OP_GET_ORIENTATION 0x02 // -            -> angle u16, ax i16, ay i16, az i16
+#define BIN_OP_GET_DISPLAY 0x03 // -                -> matrixA rows[8], matrixB rows[8]
+#define BIN_OP_GET_POWER 0x04  // -                 -> state u8, sleep% u8, idleMs u32
+#define BIN_OP_GET_BOOT 0x05   // -                 -> serial, display, frame, ready (u32 us)
+#define BIN_OP_SET_MODE 0x10   // mode u8           -> -
+#define BIN_OP_SET_TIME 0x11   // hours u8, min u8  -> -
+#define BIN_OP_SET_HG 0x12     // hours u8, min u8  -> -
+#define BIN_OP_RESET_HG 0x13   // -                 -> -
+#define BIN_OP_ROLL_DICE 0x14  // -                 -> value u8
+#define BIN_OP_GET_FLIP_COUNT 0x15 // -             -> count u16
+#define BIN_OP_RESET_FLIP 0x16 // -                 -> -
+#define BIN_OP_SET_BRIGHTNESS 0x17 // level u8      -> -
+#define BIN_OP_STREAM_IMU 0x18 // hz u16 (0 stops) -> - or, on stop, sent u32, dropped u32
+#define BIN_OP_IMU_SAMPLE 0x19 // (unsolicited)     -> ImuStream record, see ImuStream.h
+#define BIN_OP_ANIM_WRITE 0x1A // offset u16, bytes  -> -
+#define BIN_OP_ANIM_COMMIT 0x1B // length u16, crc8 -> - (BIN_ERR_INVALID: bad instruction offset)
+#define BIN_OP_ANIM_INFO 0x1C  // -                 -> length u16, state u8, pc u16
+#define BIN_OP_PUSH_FRAME 0x1D // A rows[8], B rows[8] -> fill u8, free u8
+#define BIN_OP_PUSH_DELTA 0x1E // (row u8, value u8)... -> fill u8, free u8 (rows 0-7 A, 8-15 B)
+#define BIN_OP_STREAM_FPS 0x1F // fps u8           -> -
+#define BIN_OP_STREAM_INFO 0x20 // -               -> fill u8, depth u8, fps u8, played u16, underruns u16
+#define BIN_OP_GET_CPU 0x21    // -                 -> refresh load u16 (1/1000), sleep% u8, grey levels u8, tick ms u16
+#define BIN_OP_GET_MEM 0x22    // -                 -> data, bss, heap, free, stackPeak, freeMin (u16), canary u8
+#define BIN_OP_TSYNC 0x23      // seq u8, host ms u32 -> seq u8, rx ms u32, tx ms u32 (device millis)
+#define BIN_OP_TSYNC_FIN 0x24  // seq u8, host ms u32 -> step i32 (ms), rate i32 (ppb), delay u16, samples u8
+#define BIN_OP_GET_TIME 0x25   // -                 -> time of day ms u32, rate i32 (ppb), synced u8, samples u8
+#define BIN_OP_HG_START_AT 0x26 // host ms u32      -> -
+#define BIN_OP_HG_PAUSE 0x27   // -                 -> -
+#define BIN_OP_HG_RESUME 0x28  // -                 -> -
+#define BIN_OP_GET_HG 0x29     // -                 -> duration ms u32, elapsed ms u32, running u8, progress u8
+#define BIN_OP_SET_SCRUB 0x2A  // ms u16 (0 stops)  -> -
+#define BIN_OP_SAND_MIRROR 0x2B // on u8           -> - or, on stop, records u32, syncs u32
+#define BIN_OP_SAND_EVENT 0x2C // (unsolicited)     -> mirror record, see SandMirror.h
+#define BIN_OP_DUMP_TRACE 0x2D // from u16         -> first u16, written u16, uptime ms u32, age ms u32, records
+#define BIN_OP_PING 0x7D       // any bytes         -> same bytes
+#define BIN_OP_NAK 0x7E        // (response only) frame failed its CRC
+#define BIN_OP_EXIT 0x7F       // -                 -> - then back to text mode
+
+// BIN_OP_SAND_EVENT record kinds, first payload byte (see SandMirror.h)
+#define SAND_SYNC 0
+#define SAND_MOTION 1
+#define SAND_DROP 2
+#define SAND_CHECK 3
+#define SAND_SYNC_PAYLOAD 23
+
+// BIN_OP_DUMP_TRACE record ids (see TraceRing.h), and the records per response
+#define TRACE_GAP 0          // time field is whole seconds of silence, not ms
+#define TRACE_BOOT 1         // arg: reset flags (MCUSR)
+#define TRACE_MODE 2         // arg: MODE_*
+#define TRACE_COMMAND 3      // arg: CMD_*
+#define TRACE_GESTURE 4      // arg: GESTURE_*
+#define TRACE_OVERRUN 5      // arg: ms a mode update took beyond its tick period, up to 255
+#define TRACE_QUEUE_FULL 6   // arg: EVENT_* type that was dropped
+#define TRACE_I2C_FAIL 7     // arg: Wire error, or bytes read when a read came up short
+#define TRACE_DROP 8         // arg: TRACE_DROP_*
+#define TRACE_ERROR 9        // arg: BIN_ERR_* sent, 0 for a text ERR line
+#define TRACE_DROP_IMU 1     // IMU sample, TX buffer full
+#define TRACE_DROP_STREAM 2  // Stream underrun, frame held
+#define TRACE_DROP_SAND 3    // Sand mirror record, resync pending
+#define TRACE_DUMP_RECORDS 7
+
+#endif
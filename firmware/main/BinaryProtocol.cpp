@@ -0,0 +1,384 @@
+#include "BinaryProtocol.h"
+#include "DeviceApi.h"
+#include "EventBus.h"
+#include "config.h"
+#include "utils.h"
+#include "ImuStream.h"
+#include "AnimationMode.h"
+#include "MemoryMonitor.h"
+#include "TimeSync.h"
+#include "SandMirror.h"
+#include "TraceRing.h"
+
+static void putU16(uint8_t* out, uint16_t v) {
+    out[0] = (uint8_t)(v & 0xFF);
+    out[1] = (uint8_t)(v >> 8);
+}
+
+static void putU32(uint8_t* out, uint32_t v) {
+    putU16(out, (uint16_t)(v & 0xFFFF));
+    putU16(out + 2, (uint16_t)(v >> 16));
+}
+
+static uint32_t getU32(const uint8_t* in) {
+    return in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+}
+
+BinaryProtocol::BinaryProtocol() {
+    framePos = 0;
+    active = false;
+    overflow = false;
+    receivedAt = 0;
+}
+
+void BinaryProtocol::begin() {
+    imuStream.stop();  // Text-mode records would break the framing
+    sandMirror.stop();
+    active = true;
+    framePos = 0;
+    overflow = false;
+    uint8_t version = BIN_VERSION;
+    send(BIN_OP_HELLO, BIN_OK, &version, 1);
+}
+
+bool BinaryProtocol::isActive() const {
+    return active;
+}
+
+void BinaryProtocol::feed(uint8_t c) {
+    if (c != 0) {
+        if (framePos < sizeof(frame)) frame[framePos++] = c;
+        else overflow = true;
+        return;
+    }
+
+    // End of frame
+    receivedAt = millis();
+    uint8_t req[BIN_MAX_FRAME];
+    uint8_t len;
+    bool ok = !overflow && framePos > 0 && decode(req, &len) && len >= 2;
+    framePos = 0;
+    overflow = false;
+    if (!ok) return;  // Line noise or a partial frame - wait for the next one
+
+    if (crc8(req, len - 1) != req[len - 1]) {
+        send(BIN_OP_NAK, BIN_ERR_CRC, NULL, 0);
+        return;
+    }
+    noteHostActivity();
+    dispatch(req, len - 1);
+}
+
+bool BinaryProtocol::decode(uint8_t* out, uint8_t* len) {
+    uint8_t in = 0;
+    uint8_t n = 0;
+    while (in < framePos) {
+        uint8_t code = frame[in++];
+        if (code == 0 || in + code - 1 > framePos) return false;
+        for (uint8_t i = 1; i < code; i++) {
+            if (n >= BIN_MAX_FRAME) return false;
+            out[n++] = frame[in++];
+        }
+        // A zero follows each block shorter than 254 bytes, except the last
+        if (code < 0xFF && in < framePos) {
+            if (n >= BIN_MAX_FRAME) return false;
+            out[n++] = 0;
+        }
+    }
+    *len = n;
+    return true;
+}
+
+void BinaryProtocol::send(uint8_t opcode, uint8_t status, const uint8_t* payload, uint8_t len) {
+    uint8_t raw[BIN_MAX_FRAME];
+    if (len > BIN_MAX_FRAME - 3) len = BIN_MAX_FRAME - 3;
+    // A full stream queue is flow control, not a fault
+    if (status != BIN_OK && status != BIN_ERR_FULL) TRACE(TRACE_ERROR, status);
+    raw[0] = opcode | BIN_RESPONSE;
+    raw[1] = status;
+    if (len) memcpy(raw + 2, payload, len);
+    raw[len + 2] = crc8(raw, len + 2);
+    uint8_t total = len + 3;
+
+    // COBS: each block is its length + 1, then the bytes up to the next zero
+    uint8_t start = 0;
+    while (start <= total) {
+        uint8_t end = start;
+        while (end < total && raw[end] != 0) end++;
+        Serial.write((uint8_t)(end - start + 1));
+        Serial.write(raw + start, end - start);
+        start = end + 1;
+    }
+    Serial.write((uint8_t)0);
+}
+
+void BinaryProtocol::dispatch(const uint8_t* req, uint8_t len) {
+    uint8_t op = req[0];
+    const uint8_t* args = req + 1;
+    uint8_t argc = len - 1;
+    uint8_t out[16];
+
+    #define EXPECT_ARGS(n) if (argc != (n)) { send(op, BIN_ERR_ARGS, NULL, 0); return; }
+
+    switch (op) {
+        case BIN_OP_HELLO: {
+            uint8_t version = BIN_VERSION;
+            send(op, BIN_OK, &version, 1);
+            break;
+        }
+        case BIN_OP_GET_STATUS:
+            out[0] = getCurrentMode();
+            send(op, BIN_OK, out, 1);
+            break;
+        case BIN_OP_GET_ORIENTATION: {
+            int16_t accel[3];
+            getAcceleration(accel);
+            putU16(out, getOrientationAngle());
+            putU16(out + 2, accel[0]);
+            putU16(out + 4, accel[1]);
+            putU16(out + 6, accel[2]);
+            send(op, BIN_OK, out, 8);
+            break;
+        }
+        case BIN_OP_GET_DISPLAY:
+            memcpy(out, getDisplayRows(MATRIX_A), 8);
+            memcpy(out + 8, getDisplayRows(MATRIX_B), 8);
+            send(op, BIN_OK, out, 16);
+            break;
+        case BIN_OP_GET_POWER:
+            out[0] = getPowerState();
+            out[1] = getSleepPercent();
+            putU32(out + 2, getIdleTime());
+            send(op, BIN_OK, out, 6);
+            break;
+        case BIN_OP_GET_CPU:
+            putU16(out, getRefreshLoad());
+            out[2] = getSleepPercent();
+            out[3] = getGreyLevels();
+            putU16(out + 4, getTickPeriod());
+            send(op, BIN_OK, out, 6);
+            break;
+        case BIN_OP_GET_MEM: {
+            MemoryStats mem;
+            getMemoryStats(&mem);
+            putU16(out, mem.data);
+            putU16(out + 2, mem.bss);
+            putU16(out + 4, mem.heap);
+            putU16(out + 6, mem.freeNow);
+            putU16(out + 8, mem.stackPeak);
+            putU16(out + 10, mem.freeMin);
+            out[12] = mem.canaryOk;
+            send(op, BIN_OK, out, 13);
+            break;
+        }
+        case BIN_OP_GET_BOOT:
+            for (uint8_t i = 0; i < BOOT_PHASES; i++) putU32(out + i * 4, getBootTime(i));
+            send(op, BIN_OK, out, BOOT_PHASES * 4);
+            break;
+        case BIN_OP_SET_MODE:
+            EXPECT_ARGS(1);
+            if (args[0] >= NUM_MODES) { send(op, BIN_ERR_RANGE, NULL, 0); return; }
+            eventBus.send(EVENT_COMMAND, CMD_SET_MODE, args[0]);
+            send(op, BIN_OK, NULL, 0);
+            break;
+        case BIN_OP_SET_TIME:
+            EXPECT_ARGS(2);
+            if (args[0] > 23 || args[1] > 59) { send(op, BIN_ERR_RANGE, NULL, 0); return; }
+            eventBus.send(EVENT_COMMAND, CMD_SET_TIME, args[0] * 60 + args[1]);
+            send(op, BIN_OK, NULL, 0);
+            break;
+        case BIN_OP_SET_HG:
+            EXPECT_ARGS(2);
+            if (args[0] > 23 || args[1] > 59 || (args[0] == 0 && args[1] == 0)) {
+                send(op, BIN_ERR_RANGE, NULL, 0);
+                return;
+            }
+            eventBus.send(EVENT_COMMAND, CMD_SET_HG, args[0] * 60 + args[1]);
+            send(op, BIN_OK, NULL, 0);
+            break;
+        case BIN_OP_HG_START_AT:
+            EXPECT_ARGS(4);
+            if (getU32(args) >= TSYNC_DAY_MS) { send(op, BIN_ERR_RANGE, NULL, 0); return; }
+            eventBus.send(EVENT_COMMAND, CMD_HG_START_AT, getU32(args));
+            send(op, BIN_OK, NULL, 0);
+            break;
+        case BIN_OP_TSYNC: {
+            EXPECT_ARGS(5);
+            if (getU32(args + 1) >= TSYNC_DAY_MS) { send(op, BIN_ERR_RANGE, NULL, 0); return; }
+            unsigned long sentAt = millis();
+            timeSync.exchange(args[0], getU32(args + 1), receivedAt, sentAt);
+            out[0] = args[0];
+            putU32(out + 1, receivedAt);
+            putU32(out + 5, sentAt);
+            send(op, BIN_OK, out, 9);
+            break;
+        }
+        case BIN_OP_TSYNC_FIN: {
+            EXPECT_ARGS(5);
+            int32_t step;
+            if (getU32(args + 1) >= TSYNC_DAY_MS) { send(op, BIN_ERR_RANGE, NULL, 0); return; }
+            if (!timeSync.finish(args[0], getU32(args + 1), &step)) { send(op, BIN_ERR_ARGS, NULL, 0); return; }
+            putU32(out, step);
+            putU32(out + 4, timeSync.getRate());
+            putU16(out + 8, timeSync.getDelay());
+            out[10] = timeSync.getSamples();
+            send(op, BIN_OK, out, 11);
+            break;
+        }
+        case BIN_OP_GET_TIME:
+            putU32(out, timeSync.timeOfDay());
+            putU32(out + 4, timeSync.getRate());
+            out[8] = timeSync.isSynced();
+            out[9] = timeSync.getSamples();
+            send(op, BIN_OK, out, 10);
+            break;
+        case BIN_OP_RESET_HG:
+            eventBus.send(EVENT_COMMAND, CMD_RESET_HG);
+            send(op, BIN_OK, NULL, 0);
+            break;
+        case BIN_OP_HG_PAUSE:
+            eventBus.send(EVENT_COMMAND, CMD_HG_PAUSE);
+            send(op, BIN_OK, NULL, 0);
+            break;
+        case BIN_OP_HG_RESUME:
+            eventBus.send(EVENT_COMMAND, CMD_HG_RESUME);
+            send(op, BIN_OK, NULL, 0);
+            break;
+        case BIN_OP_GET_HG:
+            putU32(out, getHourglassDuration());
+            putU32(out + 4, getHourglassElapsed());
+            out[8] = isHourglassRunning();
+            out[9] = getHourglassProgress();
+            send(op, BIN_OK, out, 10);
+            break;
+        case BIN_OP_ROLL_DICE:
+            eventBus.send(EVENT_COMMAND, CMD_ROLL_DICE);
+            out[0] = getDiceValue();
+            send(op, BIN_OK, out, 1);
+            break;
+        case BIN_OP_GET_FLIP_COUNT:
+            putU16(out, getFlipCount());
+            send(op, BIN_OK, out, 2);
+            break;
+        case BIN_OP_RESET_FLIP:
+            eventBus.send(EVENT_COMMAND, CMD_RESET_FLIP);
+            send(op, BIN_OK, NULL, 0);
+            break;
+        case BIN_OP_SET_BRIGHTNESS:
+            EXPECT_ARGS(1);
+            if (args[0] > 15) { send(op, BIN_ERR_RANGE, NULL, 0); return; }
+            eventBus.send(EVENT_COMMAND, CMD_SET_BRIGHTNESS, args[0]);
+            send(op, BIN_OK, NULL, 0);
+            break;
+        case BIN_OP_SAND_MIRROR:
+            EXPECT_ARGS(1);
+            if (args[0]) {
+                sandMirror.start(this);
+                send(op, BIN_OK, NULL, 0);
+            } else {
+                sandMirror.stop();
+                putU32(out, sandMirror.getSent());
+                putU32(out + 4, sandMirror.getSyncs());
+                send(op, BIN_OK, out, 8);
+            }
+            break;
+        case BIN_OP_DUMP_TRACE: {
+            EXPECT_ARGS(2);
+#if TRACE_ENABLED
+            uint8_t dump[12 + TRACE_DUMP_RECORDS * 4];
+            send(op, BIN_OK, dump, traceRing.dump(args[0] | (args[1] << 8), dump));
+#else
+            send(op, BIN_ERR_UNKNOWN, NULL, 0);
+#endif
+            break;
+        }
+        case BIN_OP_SET_SCRUB: {
+            EXPECT_ARGS(2);
+            uint16_t ms = args[0] | (args[1] << 8);
+            if (ms > DISPLAY_SCRUB_MAX_MS) { send(op, BIN_ERR_RANGE, NULL, 0); return; }
+            eventBus.send(EVENT_COMMAND, CMD_SET_SCRUB, ms);
+            send(op, BIN_OK, NULL, 0);
+            break;
+        }
+        case BIN_OP_STREAM_IMU: {
+            EXPECT_ARGS(2);
+            uint16_t hz = args[0] | (args[1] << 8);
+            if (hz > IMU_STREAM_MAX_HZ) { send(op, BIN_ERR_RANGE, NULL, 0); return; }
+            if (hz == 0) {
+                imuStream.stop();
+                putU32(out, imuStream.getSent());
+                putU32(out + 4, imuStream.getDropped());
+                send(op, BIN_OK, out, 8);
+            } else {
+                send(op, BIN_OK, NULL, 0);
+                imuStream.start(hz, this);
+            }
+            break;
+        }
+        case BIN_OP_ANIM_WRITE:
+            if (argc < 2) { send(op, BIN_ERR_ARGS, NULL, 0); return; }
+            if (!writeAnimation(args[0] | (args[1] << 8), args + 2, argc - 2)) {
+                send(op, BIN_ERR_RANGE, NULL, 0);
+                return;
+            }
+            send(op, BIN_OK, NULL, 0);
+            break;
+        case BIN_OP_ANIM_COMMIT: {
+            EXPECT_ARGS(3);
+            int result = commitAnimation(args[0] | (args[1] << 8), args[2]);
+            if (result == ANIM_BAD_UPLOAD) {
+                send(op, BIN_ERR_RANGE, NULL, 0);
+            } else if (result != ANIM_VALID) {
+                putU16(out, result);
+                send(op, BIN_ERR_INVALID, out, 2);
+            } else {
+                send(op, BIN_OK, NULL, 0);
+            }
+            break;
+        }
+        case BIN_OP_ANIM_INFO:
+            putU16(out, getAnimationLength());
+            out[2] = getAnimationState();
+            putU16(out + 3, getAnimationPc());
+            send(op, BIN_OK, out, 5);
+            break;
+        case BIN_OP_PUSH_FRAME:
+        case BIN_OP_PUSH_DELTA: {
+            if (op == BIN_OP_PUSH_FRAME) EXPECT_ARGS(16);
+            if (op == BIN_OP_PUSH_DELTA && (argc & 1)) { send(op, BIN_ERR_ARGS, NULL, 0); return; }
+            int fill = (op == BIN_OP_PUSH_FRAME) ? pushFrame(args) : pushFrameDelta(args, argc / 2);
+            out[0] = fill < 0 ? getStreamFill() : fill;
+            out[1] = STREAM_QUEUE_DEPTH - out[0];
+            send(op, fill < 0 ? BIN_ERR_FULL : BIN_OK, out, 2);
+            break;
+        }
+        case BIN_OP_STREAM_FPS:
+            EXPECT_ARGS(1);
+            if (args[0] < 1 || args[0] > STREAM_MAX_FPS) { send(op, BIN_ERR_RANGE, NULL, 0); return; }
+            setStreamFps(args[0]);
+            send(op, BIN_OK, NULL, 0);
+            break;
+        case BIN_OP_STREAM_INFO:
+            out[0] = getStreamFill();
+            out[1] = STREAM_QUEUE_DEPTH;
+            out[2] = getStreamFps();
+            putU16(out + 3, getStreamPlayed());
+            putU16(out + 5, getStreamUnderruns());
+            send(op, BIN_OK, out, 7);
+            break;
+        case BIN_OP_PING:
+            send(op, BIN_OK, args, argc);
+            break;
+        case BIN_OP_EXIT:
+            imuStream.stop();
+            sandMirror.stop();
+            send(op, BIN_OK, NULL, 0);
+            active = false;
+            break;
+        default:
+            send(op, BIN_ERR_UNKNOWN, NULL, 0);
+            break;
+    }
+
+    #undef EXPECT_ARGS
+}
@@ -0,0 +1,35 @@
+#ifndef BINARY_PROTOCOL_H
+#define BINARY_PROTOCOL_H
+
+#include <Arduino.h>
+#include "BinaryOpcodes.h"
+
+/**
+ * COBS-framed binary command protocol, see BinaryOpcodes.h.
+ * A frame that is too long or fails its CRC is dropped and the decoder
+ * restarts at the next 0x00, so the link resyncs after any corruption.
+ */
+class BinaryProtocol {
+private:
+    uint8_t frame[BIN_MAX_FRAME + 2];  // Encoded bytes of the frame being received
+    uint8_t framePos;
+    bool active;
+    bool overflow;
+    unsigned long receivedAt;  // millis() when the last frame ended
+
+    bool decode(uint8_t* out, uint8_t* len);
+    void dispatch(const uint8_t* req, uint8_t len);
+
+public:
+    BinaryProtocol();
+    void begin();
+    bool isActive() const;
+
+    // Feed one received byte
+    void feed(uint8_t c);
+
+    // Send a response frame
+    void send(uint8_t opcode, uint8_t status, const uint8_t* payload, uint8_t len);
+};
+
+#endif
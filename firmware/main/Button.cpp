@@ -1,77 +1,109 @@
 #include <Arduino.h>
 #include "Button.h"
+#include "Recorder.h"
+#include "EventBus.h"
+
+Button* Button::instance = NULL;
 
 Button::Button(int pin) {
     this->pin = pin;
-    lastState = HIGH;
-    currentState = HIGH;
     debouncedState = HIGH;
-    wasJustPressed = false;
-    lastDebounceTime = 0;
+    lastEdgeTime = 0;
     pressStartTime = 0;
-    longPressDetected = false;
+    lastRepeatTime = 0;
+    pendingClickTime = 0;
+    pendingClick = false;
+    repeating = false;
+    unsettled = false;
 }
 
 void Button::init() {
     pinMode(pin, INPUT_PULLUP);
-    lastState = digitalRead(pin);
-    currentState = lastState;
+    debouncedState = digitalRead(pin);
+    instance = this;
+    attachInterrupt(digitalPinToInterrupt(pin), handleInterrupt, CHANGE);
 }
 
-void Button::update() {
-    int reading = digitalRead(pin);
-    
-    if (reading != lastState) {
-        lastDebounceTime = millis();
+void Button::handleInterrupt() {
+    // The only producer of the bus's interrupt queue
+    eventBus.postFromIsr(EVENT_EDGE, digitalRead(instance->pin), millis());
+}
+
+void Button::onEdge(uint8_t level, unsigned long time) {
+    // The first edge after a quiet period is taken right away, bounces
+    // inside the debounce window are dropped
+    recorder.recordButton(level, time);
+    unsettled = true;
+    if (level != debouncedState && (time - lastEdgeTime) > DEBOUNCE_DELAY) {
+        acceptEdge(level, time);
     }
-    
-    if ((millis() - lastDebounceTime) > DEBOUNCE_DELAY) {
-        if (reading != debouncedState) {
-            // Track state change for wasJustPressed detection
-            if (reading == LOW && debouncedState == HIGH) {
-                wasJustPressed = true;
-            }
-            
-            debouncedState = reading;
-            currentState = reading;
-            
-            if (currentState == LOW) {
-                // Button pressed
-                pressStartTime = millis();
-                longPressDetected = false;
-            } else {
-                // Button released
-                pressStartTime = 0;
-            }
+}
+
+void Button::update() {
+    unsigned long now = millis();
+
+    // A bounce may have ended on the other level - settle on the real one
+    if (unsettled && (now - lastEdgeTime) > DEBOUNCE_DELAY) {
+        unsettled = false;
+        uint8_t level = digitalRead(pin);
+        if (level != debouncedState) {
+            acceptEdge(level, now);
         }
     }
-    
-    // Check for long press
-    if (currentState == LOW && pressStartTime > 0) {
-        if ((millis() - pressStartTime) > BUTTON_LONG_PRESS_MS && !longPressDetected) {
-            longPressDetected = true;
+
+    if (debouncedState == LOW) {
+        unsigned long held = now - pressStartTime;
+        if (!repeating && held >= BUTTON_HOLD_DELAY_MS) {
+            repeating = true;
+            lastRepeatTime = now;
+            pushEvent(BUTTON_HOLD_REPEAT);
+        } else if (repeating && (now - lastRepeatTime) >= BUTTON_HOLD_REPEAT_MS) {
+            lastRepeatTime = now;
+            pushEvent(BUTTON_HOLD_REPEAT);
         }
     }
-    
-    lastState = reading;
-}
 
-bool Button::wasPressed() {
-    bool pressed = wasJustPressed;
-    wasJustPressed = false;  // Clear after reading
-    return pressed;
+    // Single click is only final once the double-click window has passed
+    if (pendingClick && (now - pendingClickTime) > BUTTON_DOUBLE_CLICK_MS) {
+        pendingClick = false;
+        pushEvent(BUTTON_CLICK);
+    }
 }
 
-bool Button::wasLongPressed() {
-    // Only trigger when button is released after a long press
-    bool result = longPressDetected && (currentState == HIGH);
-    if (result) {
-        longPressDetected = false; // Reset after reading
+void Button::acceptEdge(uint8_t level, unsigned long time) {
+    debouncedState = level;
+    lastEdgeTime = time;
+
+    if (level == LOW) {
+        pressStartTime = time;
+        repeating = false;
+        pushEvent(BUTTON_PRESS);
+        return;
+    }
+
+    unsigned long held = time - pressStartTime;
+    if (held >= BUTTON_LONG_PRESS_MS) {
+        pendingClick = false;
+        pushEvent(BUTTON_LONG_PRESS);
+    } else if (repeating) {
+        pendingClick = false;
+    } else if (pendingClick) {
+        pendingClick = false;
+        pushEvent(BUTTON_DOUBLE_CLICK);
+    } else {
+        pendingClick = true;
+        pendingClickTime = time;
     }
-    return result;
 }
 
-bool Button::isPressed() const {
-    return currentState == LOW;
+void Button::pushEvent(uint8_t event) {
+    eventBus.post(EVENT_BUTTON, event);
 }
 
+bool Button::isBusy() const {
+    return unsettled || pendingClick || debouncedState == LOW;
+}
+
+bool Button::isPressed() const {
+    return debouncedState == LOW;
+}
@@ -4,25 +4,46 @@
 #include <Arduino.h>
 #include "config.h"
 
+// Decoded button events
+#define BUTTON_NONE 0
+#define BUTTON_PRESS 1         // Debounced press edge, reported immediately
+#define BUTTON_CLICK 2         // Short press with no second click following
+#define BUTTON_DOUBLE_CLICK 3  // Two short presses within BUTTON_DOUBLE_CLICK_MS
+#define BUTTON_LONG_PRESS 4    // Released after BUTTON_LONG_PRESS_MS or more
+#define BUTTON_HOLD_REPEAT 5   // Repeats while held past BUTTON_HOLD_DELAY_MS
+
+/**
+ * Debounces the push button and decodes clicks, double clicks, long
+ * presses and hold repeats. The INT0 handler posts raw edges to the
+ * event bus; onEdge() decodes them and posts EVENT_BUTTON events.
+ * update() only has timing work left (click windows, repeats), so
+ * loop() calls it while isBusy().
+ */
 class Button {
 private:
+    static Button* instance;
+
     int pin;
-    bool lastState;
-    bool currentState;
     bool debouncedState;
-    bool wasJustPressed;
-    unsigned long lastDebounceTime;
+    unsigned long lastEdgeTime;
     unsigned long pressStartTime;
-    bool longPressDetected;
-    
+    unsigned long lastRepeatTime;
+    unsigned long pendingClickTime;
+    bool pendingClick;
+    bool repeating;
+    bool unsettled;     // An edge arrived; check the level once bounces end
+
+    static void handleInterrupt();
+    void pushEvent(uint8_t event);
+    void acceptEdge(uint8_t level, unsigned long time);
+
 public:
     Button(int pin);
     void init();
+    void onEdge(uint8_t level, unsigned long time);
     void update();
-    bool wasPressed();
-    bool wasLongPressed();
+    bool isBusy() const;
     bool isPressed() const;
 };
 
 #endif
-
@@ -0,0 +1,126 @@
+#include "Buzzer.h"
+#include "EventBus.h"
+#include <util/atomic.h>
+
+Buzzer buzzer;
+
+/* ========= SOUNDS ========= */
+// Indexed by SOUND_* - 1 from EventBus.h
+static const ToneStep CLICK_STEPS[] PROGMEM = {
+    NOTE(HOURGLASS_TONE_FREQ, HOURGLASS_TONE_DURATION),
+};
+static const ToneStep ALARM_STEPS[] PROGMEM = {
+    NOTE(HOURGLASS_TONE_FREQ, 200),
+    REST(800),
+};
+
+static const SoundPattern SOUNDS[] PROGMEM = {
+    { CLICK_STEPS, 1, 1, 1 },
+    { ALARM_STEPS, 2, HOURGLASS_ALARM_CYCLES, 2 },
+};
+static_assert(sizeof(SOUNDS) / sizeof(SOUNDS[0]) == SOUND_COUNT, "SOUNDS table must match SOUND_COUNT");
+
+#if defined(__AVR_ATmega328P__) || defined(ARDUINO_HOST_SHIM)
+#define BUZZER_TIMER2 1
+#if PIN_BUZZER != 3
+#error "PIN_BUZZER must be D3 (OC2B) for the Timer2 sequencer"
+#endif
+
+ISR(TIMER2_COMPA_vect) {
+    buzzer.onCompare();
+}
+#else
+#define BUZZER_TIMER2 0
+#endif
+
+Buzzer::Buzzer() {
+    step = NULL;
+    first = NULL;
+    remaining = 0;
+    stepsLeft = 0;
+    length = 0;
+    playsLeft = 0;
+    priority = 0;
+}
+
+void Buzzer::begin() {
+    pinMode(PIN_BUZZER, OUTPUT);
+    digitalWrite(PIN_BUZZER, LOW);
+}
+
+void Buzzer::load(const ToneStep* next) {
+    uint8_t control = pgm_read_byte(&next->control);
+    uint16_t matches = pgm_read_word(&next->matches);
+    step = next;
+    remaining = matches ? matches : 1;
+#if BUZZER_TIMER2
+    // CTC on OCR2A; OC2B toggles on every match while the step sounds
+    // and is disconnected for a rest, leaving the pin at its PORT value (low)
+    TCCR2B = 0;
+    TCCR2A = _BV(WGM21) | ((control & TONE_ON) ? _BV(COM2B0) : 0);
+    OCR2A = pgm_read_byte(&next->top);
+    OCR2B = 0;
+    TCNT2 = 0;
+    TCCR2B = control & 7;
+    TIMSK2 |= _BV(OCIE2A);
+#else
+    (void)control;
+    silence();  // Nothing to play it with
+#endif
+}
+
+void Buzzer::silence() {
+#if BUZZER_TIMER2
+    TIMSK2 &= ~_BV(OCIE2A);
+    TCCR2B = 0;
+    TCCR2A = 0;
+#endif
+    priority = 0;
+    step = NULL;
+}
+
+bool Buzzer::play(uint8_t sound) {
+    if (sound == SOUND_OFF) {
+        stop();
+        return true;
+    }
+    if (sound > SOUND_COUNT) return false;
+
+    SoundPattern pattern;
+    memcpy_P(&pattern, &SOUNDS[sound - 1], sizeof(pattern));
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (priority > pattern.priority) return false;
+        priority = pattern.priority;
+        first = pattern.steps;
+        length = pattern.length;
+        stepsLeft = pattern.length;
+        playsLeft = pattern.plays - 1;
+        load(pattern.steps);
+    }
+    return true;
+}
+
+void Buzzer::stop() {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        silence();
+    }
+}
+
+bool Buzzer::isPlaying() const {
+    return priority != 0;
+}
+
+void Buzzer::onCompare() {
+    if (!step || --remaining) return;
+    if (--stepsLeft) {
+        load(step + 1);
+        return;
+    }
+    if (playsLeft == 0) {
+        silence();
+        return;
+    }
+    playsLeft--;
+    stepsLeft = length;
+    load(first);
+}
@@ -0,0 +1,84 @@
+#ifndef BUZZER_H
+#define BUZZER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * Tone sequencer for the piezo on PIN_BUZZER, run by Timer2.
+ *
+ * A sound is a PROGMEM list of steps, each a note or a rest, played a
+ * number of times. Timer2 runs in CTC mode at twice the note frequency
+ * and toggles OC2B (D3) in hardware, so the pitch does not depend on
+ * interrupt latency. The compare interrupt counts the toggles down and
+ * loads the next step when the count runs out. Nothing is left for
+ * loop() to do once a sound is started.
+ *
+ * Sounds have priorities: a sound only starts if nothing more
+ * important is playing, so an alarm is never cut short by a grain
+ * click. Modes post EVENT_SOUND with a SOUND_* id (EventBus.h) rather
+ * than calling play() directly.
+ *
+ * Arduino's tone() uses Timer2 as well; nothing may call it. Targets
+ * other than the ATmega328P stay silent.
+ */
+
+// Timer2 clock select bits for a note: the smallest prescaler that fits
+// half its period into the 8-bit compare register
+#define TONE_CS(hz) ((hz) >= F_CPU / 512 ? 1 : (hz) >= F_CPU / 512 / 8 ? 2 : \
+                     (hz) >= F_CPU / 512 / 32 ? 3 : (hz) >= F_CPU / 512 / 64 ? 4 : \
+                     (hz) >= F_CPU / 512 / 128 ? 5 : (hz) >= F_CPU / 512 / 256 ? 6 : 7)
+#define TONE_PRESCALE(cs) ((cs) == 1 ? 1 : (cs) == 2 ? 8 : (cs) == 3 ? 32 : (cs) == 4 ? 64 : \
+                           (cs) == 5 ? 128 : (cs) == 6 ? 256 : 1024)
+#define TONE_TOP(hz) (F_CPU / 2 / TONE_PRESCALE(TONE_CS(hz)) / (hz) - 1)
+#define TONE_ON 0x80  // Step drives the pin; otherwise it only counts time
+
+// One step, worked out at compile time. A rest counts at 500 Hz, i.e.
+// one compare match per ms
+#define NOTE(hz, ms) { TONE_ON | TONE_CS(hz), TONE_TOP(hz), (2UL * (hz) * (ms) + 500) / 1000 }
+#define REST(ms) { TONE_CS(500), TONE_TOP(500), (ms) }
+
+struct ToneStep {
+    uint8_t control;   // TONE_ON | Timer2 clock select
+    uint8_t top;       // OCR2A
+    uint16_t matches;  // Compare matches the step lasts, 2 per period of a note
+};
+
+struct SoundPattern {
+    const ToneStep* steps;  // PROGMEM
+    uint8_t length;
+    uint8_t plays;          // Times the list is played
+    uint8_t priority;       // Higher preempts lower
+};
+
+class Buzzer {
+private:
+    // Shared with the Timer2 interrupt
+    const ToneStep* volatile step;
+    const ToneStep* volatile first;
+    volatile uint16_t remaining;
+    volatile uint8_t stepsLeft;
+    volatile uint8_t length;
+    volatile uint8_t playsLeft;
+    volatile uint8_t priority;  // Of the sound playing, 0 when silent
+
+    void load(const ToneStep* next);
+    void silence();
+
+public:
+    Buzzer();
+    void begin();
+
+    // Starts a SOUND_* unless something more important is playing.
+    // SOUND_OFF stops whatever plays
+    bool play(uint8_t sound);
+    void stop();
+    bool isPlaying() const;
+
+    // From the Timer2 compare interrupt
+    void onCompare();
+};
+
+extern Buzzer buzzer;
+
+#endif
@@ -1,19 +1,16 @@
 #include "ClockMode.h"
+#include "TimeSync.h"
 #include "utils.h"
 #include "config.h"
 
 ClockMode::ClockMode(LedControl* lc, MPU6050* mpu) {
     this->lc = lc;
     this->mpu = mpu;
-    hours = 12;
-    minutes = 0;
     horizontal = true;
 }
 
 void ClockMode::init() {
-    // Initialize time from system or default
-    hours = 12;
-    minutes = 0;
+    // The time lives in timeSync, which starts at noon
 }
 
 void ClockMode::enter() {
@@ -27,36 +24,57 @@ void ClockMode::exit() {
 
 void ClockMode::update() {
     horizontal = mpu->isHorizontal();
-    
-    // Update rotation based on orientation
-    int angle = mpu->getAngle();
-    lc->setRotation(normalizeAngle(ROTATION_OFFSET + angle));
-    
+
+    uint32_t now = timeSync.timeOfDay();
+    int h = now / 3600000UL;
+    int m = (now / 60000UL) % 60;
     if (horizontal) {
-        displayDigitalTime();
+        displayDigitalTime(h, m);
     } else {
-        displayDotTime();
+        displayDotTime(h, m);
+    }
+}
+
+bool ClockMode::isAnimating() const {
+    return false;
+}
+
+void ClockMode::onEvent(const Event& event) {
+    if (event.type == EVENT_ORIENTATION) {
+        lc->setRotation(normalizeAngle(ROTATION_OFFSET + event.value));
+    } else if (event.type == EVENT_COMMAND && event.arg == CMD_SET_TIME) {
+        setTime(event.value / 60, event.value % 60);
     }
 }
 
 void ClockMode::setTime(int h, int m) {
-    hours = constrain(h, 0, 23);
-    minutes = constrain(m, 0, 59);
+    h = constrain(h, 0, 23);
+    m = constrain(m, 0, 59);
+    timeSync.setTimeOfDay(h * 3600000UL + m * 60000UL);
+}
+
+int ClockMode::getHours() const {
+    return timeSync.timeOfDay() / 3600000UL;
+}
+
+int ClockMode::getMinutes() const {
+    return (timeSync.timeOfDay() / 60000UL) % 60;
 }
 
 String ClockMode::getTimeString() {
     // Avoid reentrancy issues by building owned String directly from snprintf
     // without relying on a shared static buffer
     char buffer[6];
-    snprintf(buffer, sizeof(buffer), "%02d:%02d", hours, minutes);
+    uint32_t now = timeSync.timeOfDay();
+    snprintf(buffer, sizeof(buffer), "%02d:%02d", (int)(now / 3600000UL % 24), (int)(now / 60000UL % 60));
     return String(buffer);  // Caller gets a fresh owned String
 }
-void ClockMode::displayDigitalTime() {
+void ClockMode::displayDigitalTime(int h, int m) {
     // Display HH:MM across both matrices (16 columns)
-    int h1 = hours / 10;
-    int h2 = hours % 10;
-    int m1 = minutes / 10;
-    int m2 = minutes % 10;
+    int h1 = h / 10;
+    int h2 = h % 10;
+    int m1 = m / 10;
+    int m2 = m % 10;
     
     // Clear displays
     lc->clearDisplay(MATRIX_A);
@@ -73,14 +91,14 @@ void ClockMode::displayDigitalTime() {
     lc->setXY(MATRIX_B, 0, 5, true);
 }
 
-void ClockMode::displayDotTime() {
+void ClockMode::displayDotTime(int h, int m) {
     // Left matrix: hours as dots (max 23)
     // Right matrix: minutes as grouped dots
     lc->clearDisplay(MATRIX_A);
     lc->clearDisplay(MATRIX_B);
     
-    drawDots(MATRIX_A, hours);
-    drawDots(MATRIX_B, minutes);
+    drawDots(MATRIX_A, h);
+    drawDots(MATRIX_B, m);
 }
 
 void ClockMode::drawDigit(int matrix, int x, int digit) {
@@ -3,14 +3,13 @@
 
 #include "LedControl.h"
 #include "MPU6050.h"
+#include "EventBus.h"
 #include "config.h"
 
 class ClockMode {
 private:
     LedControl* lc;
     MPU6050* mpu;
-    int hours;
-    int minutes;
     bool horizontal;
     
 public:
@@ -19,12 +18,16 @@ public:
     void enter();
     void exit();
     void update();
+    bool isAnimating() const;
+    void onEvent(const Event& event);
     void setTime(int h, int m);
+    int getHours() const;
+    int getMinutes() const;
     String getTimeString();
     
 private:
-    void displayDigitalTime();
-    void displayDotTime();
+    void displayDigitalTime(int h, int m);
+    void displayDotTime(int h, int m);
     void drawDigit(int matrix, int x, int digit);
     void drawDots(int matrix, int count);
 };
@@ -0,0 +1,66 @@
+#ifndef DEVICE_API_H
+#define DEVICE_API_H
+
+#include <Arduino.h>
+#include "JsonWriter.h"
+
+/**
+ * Device queries and data paths implemented in main.ino, shared by the
+ * text and binary protocols. Actions that modes handle are EVENT_COMMAND
+ * events instead (see EventBus.h).
+ */
+
+// Boot phases recorded by setup()
+#define BOOT_SERIAL 0
+#define BOOT_DISPLAY 1
+#define BOOT_FIRST_FRAME 2
+#define BOOT_READY 3
+#define BOOT_PHASES 4
+
+// Actions
+void noteHostActivity();
+bool writeAnimation(uint16_t offset, const uint8_t* data, uint8_t len);
+int commitAnimation(uint16_t len, uint8_t crc);  // ANIM_VALID, ANIM_BAD_UPLOAD or fault offset
+int pushFrame(const uint8_t* rows);              // Queue fill, or -1 when full
+int pushFrameDelta(const uint8_t* pairs, uint8_t count);
+void setStreamFps(int fps);
+
+// Queries
+int getCurrentMode();
+int getDiceValue();
+int getFlipCount();
+int getOrientationAngle();
+void getAcceleration(int16_t* xyz);
+const uint8_t* getDisplayRows(int matrix);
+uint8_t getPowerState();
+uint8_t getSleepPercent();
+// Display refresh interrupt load in 1/1000, and grey levels shown (0 when off)
+unsigned int getRefreshLoad();
+uint8_t getGreyLevels();
+unsigned long getIdleTime();
+unsigned int getTickPeriod();          // Period of the last mode tick, ms (before this query woke it)
+unsigned long getHourglassDuration();  // ms
+unsigned long getHourglassElapsed();   // ms, runs while other modes show
+bool isHourglassRunning();
+uint8_t getHourglassProgress();
+unsigned long getBootTime(uint8_t phase);
+uint16_t getAnimationLength();
+uint8_t getAnimationState();
+uint16_t getAnimationPc();
+uint8_t getStreamFill();
+uint8_t getStreamFps();
+uint16_t getStreamPlayed();
+uint16_t getStreamUnderruns();
+
+// JSON for the text protocol, streamed into the writer
+void writeStatusJSON(JsonWriter& json);
+void writeOrientationJSON(JsonWriter& json);
+void writeDisplayJSON(JsonWriter& json);
+void writePowerJSON(JsonWriter& json);
+void writeCpuJSON(JsonWriter& json);
+void writeBootJSON(JsonWriter& json);
+void writeMemJSON(JsonWriter& json);
+void writeTimeJSON(JsonWriter& json);
+void writeHourglassJSON(JsonWriter& json);
+
+#endif
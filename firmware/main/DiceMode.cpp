@@ -1,4 +1,5 @@
 #include "DiceMode.h"
+#include "Button.h"
 #include "config.h"
 #include "utils.h"
 
@@ -7,6 +8,7 @@ DiceMode::DiceMode(LedControl* lc, MPU6050* mpu) {
     this->mpu = mpu;
     currentValue = 1;
     lastRoll = 0;
+    active = false;
 }
 
 void DiceMode::init() {
@@ -14,28 +16,45 @@ void DiceMode::init() {
 }
 
 void DiceMode::enter() {
+    active = true;
     roll();
 }
 
 void DiceMode::exit() {
-    // Cleanup
+    active = false;
 }
 
 void DiceMode::update() {
-    // Auto-roll on shake
-    if (mpu->isShaking() && (millis() - lastRoll) > 500) {
-        roll();
+    // Rolls and rotation all come in through onEvent()
+}
+
+bool DiceMode::isAnimating() const {
+    return false;
+}
+
+void DiceMode::onEvent(const Event& event) {
+    switch (event.type) {
+        case EVENT_BUTTON:
+            if (event.arg == BUTTON_PRESS) roll();
+            break;
+        case EVENT_GESTURE:
+            // Auto-roll on shake
+            if (event.arg == GESTURE_SHAKE && (millis() - lastRoll) > 500) roll();
+            break;
+        case EVENT_ORIENTATION:
+            lc->setRotation(normalizeAngle(ROTATION_OFFSET + event.value));
+            break;
+        case EVENT_COMMAND:
+            if (event.arg == CMD_ROLL_DICE) roll();
+            break;
     }
-    
-    // Update rotation
-    int angle = mpu->getAngle();
-    lc->setRotation(normalizeAngle(ROTATION_OFFSET + angle));
 }
 
 void DiceMode::roll() {
     currentValue = random(1, 7); // 1-6
     lastRoll = millis();
-    displayDice(currentValue);
+    // Commands reach the mode while another one is showing; enter() draws then
+    if (active) displayDice(currentValue);
 }
 
 int DiceMode::getValue() {
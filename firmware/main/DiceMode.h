@@ -3,6 +3,7 @@
 
 #include "LedControl.h"
 #include "MPU6050.h"
+#include "EventBus.h"
 #include "config.h"
 
 class DiceMode {
@@ -11,6 +12,7 @@ private:
     MPU6050* mpu;
     int currentValue;
     unsigned long lastRoll;
+    bool active;            // Between enter() and exit()
     
 public:
     DiceMode(LedControl* lc, MPU6050* mpu);
@@ -18,6 +20,8 @@ public:
     void enter();
     void exit();
     void update();
+    bool isAnimating() const;
+    void onEvent(const Event& event);
     void roll();
     int getValue();
     
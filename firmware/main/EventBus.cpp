@@ -0,0 +1,47 @@
+#include "EventBus.h"
+#include "TraceRing.h"
+
+EventBus eventBus;
+
+EventBus::EventBus() {
+    handler = NULL;
+}
+
+void EventBus::begin(EventHandler handler) {
+    this->handler = handler;
+}
+
+bool EventBus::postFromIsr(uint8_t type, uint8_t arg, uint32_t value) {
+    return isrEvents.push(type, arg, value);
+}
+
+bool EventBus::post(uint8_t type, uint8_t arg, uint32_t value) {
+    if (events.push(type, arg, value)) return true;
+    TRACE(TRACE_QUEUE_FULL, type);
+    return false;
+}
+
+void EventBus::send(uint8_t type, uint8_t arg, uint32_t value) {
+    Event event = { type, arg, value };
+    if (handler) handler(event);
+}
+
+uint8_t EventBus::dispatch() {
+    uint8_t count = 0;
+    Event event;
+    // Handlers may post more; those are delivered in the same pass
+    for (;;) {
+        if (!isrEvents.pop(&event) && !events.pop(&event)) break;
+        if (handler) handler(event);
+        count++;
+    }
+    return count;
+}
+
+bool EventBus::isPending() const {
+    return !isrEvents.isEmpty() || !events.isEmpty();
+}
+
+uint8_t EventBus::getOverflows() const {
+    return isrEvents.getOverflows() + events.getOverflows();
+}
@@ -0,0 +1,132 @@
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * Typed events between input sources, interrupt handlers and modes.
+ *
+ * Sources post into fixed-size single-producer/single-consumer rings:
+ * one is filled by the button interrupt, the other by the main loop.
+ * dispatch() drains both from loop() into the handler set by begin(),
+ * which routes them to main.ino and to the modes subscribed to them
+ * (see ModeRegistry.h). send() skips the queue for commands whose
+ * reply needs the result, such as ROLL_DICE.
+ */
+
+// Event types, one bit each in a mode's subscription mask
+#define EVENT_EDGE 0         // Raw button edge from INT0: arg level, value millis()
+#define EVENT_BUTTON 1       // arg: BUTTON_* from Button.h
+#define EVENT_GESTURE 2      // arg: GESTURE_*
+#define EVENT_ORIENTATION 3  // value: angle (0-359), posted when it changes
+#define EVENT_COMMAND 4      // arg: CMD_*, value: its argument
+#define EVENT_TIMER 5        // arg: TIMER_*
+#define EVENT_SOUND 6        // arg: SOUND_*, played by the buzzer
+#define EVENT_BIT(type) (1 << (type))
+
+// Gestures, detected on every IMU tick
+#define GESTURE_SHAKE 1
+#define GESTURE_FLIP 2
+
+// Commands from the protocols. They reach every mode subscribed to
+// EVENT_COMMAND, active or not; other events only the active mode.
+#define CMD_SET_MODE 1       // value: MODE_*
+#define CMD_SET_BRIGHTNESS 2 // value: 0-15
+#define CMD_SET_TIME 3       // value: minutes since midnight
+#define CMD_SET_HG 4         // value: duration in minutes
+#define CMD_RESET_HG 5
+#define CMD_HG_START_AT 6    // value: host time of day in ms, see TimeSync.h
+#define CMD_ROLL_DICE 7
+#define CMD_RESET_FLIP 8
+#define CMD_HG_PAUSE 9
+#define CMD_HG_RESUME 10
+#define CMD_SET_SCRUB 11     // value: ms between register rewrites, 0 stops
+
+// Sounds, PROGMEM patterns in Buzzer.cpp. One only starts if nothing
+// of higher priority is playing
+#define SOUND_OFF 0          // Stop whatever plays
+#define SOUND_CLICK 1        // Grain through the neck
+#define SOUND_ALARM 2        // Hourglass ran out
+#define SOUND_COUNT 2
+
+// Timers
+#define TIMER_MODE_TICK 1    // The active mode's tick is due: sample the IMU
+#define TIMER_MODE_UPDATE 2  // Then run the mode, after the events the sample raised
+
+struct Event {
+    uint8_t type;
+    uint8_t arg;
+    uint32_t value;
+};
+
+typedef void (*EventHandler)(const Event& event);
+
+/**
+ * Lock-free ring for one producer and one consumer. Indices are single
+ * bytes, so each side's update is atomic on the AVR.
+ */
+template <uint8_t SIZE>
+class EventQueue {
+private:
+    static_assert((SIZE & (SIZE - 1)) == 0, "Event queue size must be a power of two");
+    volatile Event events[SIZE];
+    volatile uint8_t head;       // Advanced by the producer only
+    volatile uint8_t tail;       // Advanced by the consumer only
+    volatile uint8_t overflows;
+
+public:
+    EventQueue() : head(0), tail(0), overflows(0) {}
+
+    bool push(uint8_t type, uint8_t arg, uint32_t value) {
+        uint8_t next = (head + 1) & (SIZE - 1);
+        if (next == tail) {
+            overflows++;
+            return false;  // Consumer is behind, drop newest
+        }
+        events[head].type = type;
+        events[head].arg = arg;
+        events[head].value = value;
+        head = next;
+        return true;
+    }
+
+    bool pop(Event* out) {
+        if (tail == head) return false;
+        out->type = events[tail].type;
+        out->arg = events[tail].arg;
+        out->value = events[tail].value;
+        tail = (tail + 1) & (SIZE - 1);
+        return true;
+    }
+
+    bool isEmpty() const { return tail == head; }
+    uint8_t getOverflows() const { return overflows; }
+};
+
+class EventBus {
+private:
+    EventQueue<EVENT_ISR_QUEUE> isrEvents;
+    EventQueue<EVENT_QUEUE> events;
+    EventHandler handler;
+
+public:
+    EventBus();
+    void begin(EventHandler handler);
+
+    // From the one interrupt handler that posts (the button's)
+    bool postFromIsr(uint8_t type, uint8_t arg = 0, uint32_t value = 0);
+    // From loop() context
+    bool post(uint8_t type, uint8_t arg = 0, uint32_t value = 0);
+    // Delivers right away, for loop() code that needs the effect now
+    void send(uint8_t type, uint8_t arg = 0, uint32_t value = 0);
+
+    // Delivers queued events, interrupt events first. Returns the count
+    uint8_t dispatch();
+    bool isPending() const;
+    uint8_t getOverflows() const;
+};
+
+extern EventBus eventBus;
+
+#endif
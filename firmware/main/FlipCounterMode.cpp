@@ -1,4 +1,5 @@
 #include "FlipCounterMode.h"
+#include "Button.h"
 #include "config.h"
 #include "utils.h"
 
@@ -6,8 +7,7 @@ FlipCounterMode::FlipCounterMode(LedControl* lc, MPU6050* mpu) {
     this->lc = lc;
     this->mpu = mpu;
     flipCount = 0;
-    lastZ = 0;
-    flipDetected = false;
+    active = false;
 }
 
 void FlipCounterMode::init() {
@@ -15,38 +15,57 @@ void FlipCounterMode::init() {
 }
 
 void FlipCounterMode::enter() {
+    active = true;
     displayCount();
 }
 
 void FlipCounterMode::exit() {
-    // Cleanup
+    active = false;
 }
 
 void FlipCounterMode::update() {
-    // Detect flip once per update cycle
-    bool flipped = mpu->detectFlip();
-    if (flipped && !flipDetected) {
-        flipCount++;
-        flipDetected = true;
-        displayCount();
-    } else if (!flipped) {
-        flipDetected = false;
+    // Flips and rotation all come in through onEvent()
+}
+
+bool FlipCounterMode::isAnimating() const {
+    return false;
+}
+
+void FlipCounterMode::onEvent(const Event& event) {
+    switch (event.type) {
+        case EVENT_BUTTON:
+            if (event.arg == BUTTON_DOUBLE_CLICK) reset();
+            break;
+        case EVENT_GESTURE:
+            // Posted once per flip, on the tick it completes
+            if (event.arg == GESTURE_FLIP) {
+                flipCount++;
+                if (active) displayCount();
+            }
+            break;
+        case EVENT_ORIENTATION:
+            lc->setRotation(normalizeAngle(ROTATION_OFFSET + event.value));
+            break;
+        case EVENT_COMMAND:
+            if (event.arg == CMD_RESET_FLIP) reset();
+            break;
     }
-    
-    // Update rotation
-    int angle = mpu->getAngle();
-    lc->setRotation(normalizeAngle(ROTATION_OFFSET + angle));
 }
 
 void FlipCounterMode::reset() {
     flipCount = 0;
-    displayCount();
+    // Commands reach the mode while another one is showing; enter() draws then
+    if (active) displayCount();
 }
 
 int FlipCounterMode::getCount() {
     return flipCount;
 }
 
+void FlipCounterMode::setCount(int count) {
+    flipCount = max(count, 0);
+}
+
 void FlipCounterMode::displayCount() {
     lc->clearDisplay(MATRIX_A);
     lc->clearDisplay(MATRIX_B);
@@ -3,6 +3,7 @@
 
 #include "LedControl.h"
 #include "MPU6050.h"
+#include "EventBus.h"
 #include "config.h"
 
 class FlipCounterMode {
@@ -10,8 +11,7 @@ private:
     LedControl* lc;
     MPU6050* mpu;
     int flipCount;
-    float lastZ;
-    bool flipDetected;
+    bool active;            // Between enter() and exit()
     
 public:
     FlipCounterMode(LedControl* lc, MPU6050* mpu);
@@ -19,8 +19,11 @@ public:
     void enter();
     void exit();
     void update();
+    bool isAnimating() const;
+    void onEvent(const Event& event);
     void reset();
     int getCount();
+    void setCount(int count);
     
 private:
     void displayCount();
@@ -1,5 +1,7 @@
 #include "HourglassMode.h"
-#include "utils.h"
+#include "Button.h"
+#include "TimeSync.h"
+#include "SandMirror.h"
 #include <Arduino.h>
 
 HourglassMode::HourglassMode(LedControl* lc, MPU6050* mpu) {
@@ -8,63 +10,91 @@ HourglassMode::HourglassMode(LedControl* lc, MPU6050* mpu) {
     durationHours = 0;
     durationMinutes = 1;
     alarmWentOff = false;
-    gravity = 0;
+    animating = false;
+    active = false;
+    banked = 0;
+    runStart = 0;
+    running = true;
+    grainsDropped = 0;
+    tick = 0;
+    topMatrix = MATRIX_A;
 }
 
 void HourglassMode::init() {
+    sand.attach(lc->getBuffer(MATRIX_A), lc->getBuffer(MATRIX_B));
     durationHours = 0;
     durationMinutes = 1;
     alarmWentOff = false;
+    runStart = millis();
 }
 
 void HourglassMode::enter() {
-    reset();
+    // The timeline kept running while away; draw where it got to
+    updateGravity();
+    render();
+    // Time that ran out in the background doesn't sound the alarm on return
+    alarmWentOff = getElapsed() >= getDuration();
+    animating = true;
+    active = true;
 }
 
 void HourglassMode::exit() {
+    active = false;
     alarmWentOff = false;
+    eventBus.post(EVENT_SOUND, SOUND_OFF);
+#if GREYSCALE_BITS > 0
+    lc->setLevel(MATRIX_A, GREY_MAX);
+    lc->setLevel(MATRIX_B, GREY_MAX);
+#endif
 }
 
 void HourglassMode::update() {
-    // Get gravity/orientation (matching reference code logic)
-    gravity = mpu->getAngle();
-
-    // Update rotation based on orientation
-    lc->setRotation(normalizeAngle(ROTATION_OFFSET + gravity));
-
-    // Handle non-blocking alarm state
-    if (alarmActive) {
-        unsigned long alarmElapsed = millis() - alarmStartTime;
-        // Alarm pattern: cycles of 200ms tone + 800ms silence = 1000ms per cycle
-        unsigned long cycleTime = alarmElapsed % 1000;  // Each cycle is 1000ms
-        unsigned long totalCycleCount = alarmElapsed / 1000;
-        
-        if (totalCycleCount >= HOURGLASS_ALARM_CYCLES) {
-            // Alarm complete
-            alarmActive = false;
-            noTone(PIN_BUZZER);
-        } else {
-            // First 200ms of each cycle: play tone
-            if (cycleTime < 200) {
-                tone(PIN_BUZZER, HOURGLASS_TONE_FREQ);
-            } else {
-                noTone(PIN_BUZZER);
-            }
-        }
-    }
+    updateGravity();
 
     // Update particle animation
-    bool moved = updateMatrix();
+    tick++;
+    sandMirror.noteMotion(tick, sand);
+    bool moved = sand.step();
     bool dropped = dropParticle();
+    sandMirror.endTick(tick, sand);
 
-    // Check if hourglass is complete (all particles in bottom)
-    if (!moved && !dropped && !alarmWentOff && (countParticles(getTopMatrix()) == 0)) {
+    // Done once the time is up and the last grain has come to rest
+    if (!moved && !dropped && !alarmWentOff && grainsDropped == HOURGLASS_PARTICLE_COUNT) {
         alarmWentOff = true;
-        alarm();
+        // The buzzer plays the whole alarm from Timer2
+        eventBus.post(EVENT_SOUND, SOUND_ALARM);
     }
 
-    if (dropped) {
-        alarmWentOff = false;
+    animating = moved || dropped;
+}
+
+bool HourglassMode::isAnimating() const {
+    return animating;
+}
+
+void HourglassMode::onEvent(const Event& event) {
+    if (event.type == EVENT_BUTTON) {
+        if (event.arg == BUTTON_PRESS) reset();
+        return;
+    }
+    switch (event.arg) {
+        case CMD_SET_HG:
+            setDuration(event.value / 60, event.value % 60);
+            break;
+        case CMD_RESET_HG:
+            reset();
+            break;
+        case CMD_HG_START_AT: {
+            long wait = timeSync.untilHostTime(event.value);
+            startAt(millis() + (wait > 0 ? wait : 0));
+            break;
+        }
+        case CMD_HG_PAUSE:
+            pause();
+            break;
+        case CMD_HG_RESUME:
+            resume();
+            break;
     }
 }
 
@@ -79,190 +109,139 @@ void HourglassMode::setDuration(int h, int m) {
     reset();
 }
 
-void HourglassMode::reset() {
-    for (byte i = 0; i < 2; i++) {
-        lc->clearDisplay(i);
-    }
-    fill(getTopMatrix(), HOURGLASS_PARTICLE_COUNT); // Start with defined particle count
-    dropDelay.Delay((unsigned long)getDelayDrop() * 1000UL); // Fix overflow
-    alarmWentOff = false;
-    alarmActive = false;
-    noTone(PIN_BUZZER);
-}
-
-int HourglassMode::getProgress() {
-    int topCount = countParticles(getTopMatrix());
-    int totalParticles = HOURGLASS_PARTICLE_COUNT; // Use config constant
-    int bottomCount = totalParticles - topCount;
-    return (bottomCount * 100) / totalParticles;
-}
-
-// Helper functions matching reference code exactly
-long HourglassMode::getDelayDrop() {
-    return durationMinutes + durationHours * 60;
-}
-
-coord HourglassMode::getDown(int x, int y) {
-    coord xy;
-    xy.x = x - 1;
-    xy.y = y + 1;
-    return xy;
+int HourglassMode::getDurationHours() const {
+    return durationHours;
 }
 
-coord HourglassMode::getLeft(int x, int y) {
-    coord xy;
-    xy.x = x - 1;
-    xy.y = y;
-    return xy;
+int HourglassMode::getDurationMinutes() const {
+    return durationMinutes;
 }
 
-coord HourglassMode::getRight(int x, int y) {
-    coord xy;
-    xy.x = x;
-    xy.y = y + 1;
-    return xy;
+void HourglassMode::reset() {
+    // A fresh run gets fresh slide ties; mirrors learn the seed from the SYNC
+    sand.seed(random(1, 0x10000));
+    banked = 0;
+    runStart = millis();
+    running = true;
+    // Commands reach the mode while another one is showing; enter() draws then
+    if (active) {
+        updateGravity();
+        render();
+    }
+    alarmWentOff = false;
+    animating = true;
+    eventBus.post(EVENT_SOUND, SOUND_OFF);
 }
 
-bool HourglassMode::canGoLeft(int addr, int x, int y) {
-    if (x == 0) return false;
-    return !lc->getXY(addr, getLeft(x, y));
+void HourglassMode::startAt(unsigned long startMs) {
+    reset();
+    runStart = startMs;
 }
 
-bool HourglassMode::canGoRight(int addr, int x, int y) {
-    if (y == 7) return false;
-    return !lc->getXY(addr, getRight(x, y));
+void HourglassMode::pause() {
+    if (!running) return;
+    banked = getElapsed();
+    running = false;
 }
 
-bool HourglassMode::canGoDown(int addr, int x, int y) {
-    if (y == 7) return false;
-    if (x == 0) return false;
-    if (!canGoLeft(addr, x, y)) return false;
-    if (!canGoRight(addr, x, y)) return false;
-    return !lc->getXY(addr, getDown(x, y));
+void HourglassMode::resume() {
+    if (running) return;
+    runStart = millis();
+    running = true;
 }
 
-void HourglassMode::goDown(int addr, int x, int y) {
-    lc->setXY(addr, x, y, false);
-    lc->setXY(addr, getDown(x, y), true);
+unsigned long HourglassMode::getDuration() const {
+    return (durationHours * 60UL + durationMinutes) * 60000UL;
 }
 
-void HourglassMode::goLeft(int addr, int x, int y) {
-    lc->setXY(addr, x, y, false);
-    lc->setXY(addr, getLeft(x, y), true);
+unsigned long HourglassMode::getElapsed() const {
+    unsigned long elapsed = banked;
+    // A start still ahead (startAt) adds nothing yet
+    long run = (long)(millis() - runStart);
+    if (running && run > 0) elapsed += run;
+    return min(elapsed, getDuration());
 }
 
-void HourglassMode::goRight(int addr, int x, int y) {
-    lc->setXY(addr, x, y, false);
-    lc->setXY(addr, getRight(x, y), true);
+bool HourglassMode::isRunning() const {
+    return running;
 }
 
-bool HourglassMode::moveParticle(int addr, int x, int y) {
-    if (!lc->getXY(addr, x, y)) {
-        return false;
-    }
-
-    bool can_GoLeft = canGoLeft(addr, x, y);
-    bool can_GoRight = canGoRight(addr, x, y);
+// Durations are whole minutes, so dividing them first is exact and keeps
+// both in 32 bits (no 64-bit divide from libgcc)
+static_assert(60000UL % 100 == 0 && 60000UL % HOURGLASS_PARTICLE_COUNT == 0,
+              "a minute must split evenly into percent and grains");
 
-    if (!can_GoLeft && !can_GoRight) {
-        return false;
-    }
-
-    bool can_GoDown = canGoDown(addr, x, y);
-
-    if (can_GoDown) {
-        goDown(addr, x, y);
-    } else if (can_GoLeft && !can_GoRight) {
-        goLeft(addr, x, y);
-    } else if (can_GoRight && !can_GoLeft) {
-        goRight(addr, x, y);
-    } else if (random(2) == 1) {
-        goLeft(addr, x, y);
-    } else {
-        goRight(addr, x, y);
-    }
-    return true;
-}
-
-int HourglassMode::countParticles(int addr) {
-    int c = 0;
-    for (byte y = 0; y < 8; y++) {
-        for (byte x = 0; x < 8; x++) {
-            if (lc->getXY(addr, x, y)) {
-                c++;
-            }
-        }
+int HourglassMode::getProgress() {
+    return getElapsed() / (getDuration() / 100);
+}
+
+uint8_t HourglassMode::grainsDue() {
+    return getElapsed() / (getDuration() / HOURGLASS_PARTICLE_COUNT);
+}
+
+void HourglassMode::updateGravity() {
+    // Project the accel vector into raw matrix coordinates (~90 units per g).
+    // At 0 degrees (+X down) grains run towards (0,0), i.e. from A into B.
+    int16_t ax = mpu->getRawX() >> 8;
+    int16_t ay = mpu->getRawY() >> 8;
+    sand.setGravity(ay - ax, -(ax + ay));
+
+    // Keep the last top chamber while there is no flow through the neck
+    int top = topMatrix;
+    if (sand.getFlow() > 0) top = MATRIX_A;
+    else if (sand.getFlow() < 0) top = MATRIX_B;
+    if (top != topMatrix && running && (long)(millis() - runStart) < 0) {
+        // Turned over before an HG_START_AT start: the run still starts
+        // then, full, from whichever chamber is now on top
+        topMatrix = top;
+        if (active) render();
+    } else if (top != topMatrix) {
+        // Turned over: what has run through is now what is left to run
+        banked = getDuration() - getElapsed();
+        runStart = millis();
+        grainsDropped = HOURGLASS_PARTICLE_COUNT - grainsDropped;
+        topMatrix = top;
+        alarmWentOff = false;
     }
-    return c;
-}
 
-void HourglassMode::fill(int addr, int maxcount) {
-    int n = 8;
-    byte x, y;
-    int count = 0;
-    for (byte slice = 0; slice < 2 * n - 1; ++slice) {
-        byte z = slice < n ? 0 : slice - n + 1;
-        for (byte j = z; j <= slice - z; ++j) {
-            y = 7 - j;
-            x = (slice - j);
-            lc->setXY(addr, x, y, (++count <= maxcount));
-        }
-    }
+#if GREYSCALE_BITS > 0
+    // Sand that has run through sits dimmer than the sand still to go
+    lc->setLevel(getTopMatrix(), GREY_MAX);
+    lc->setLevel(getBottomMatrix(), HOURGLASS_BOTTOM_LEVEL);
+#endif
 }
 
 int HourglassMode::getTopMatrix() {
-    // Match reference logic: gravity 90 means MATRIX_A is top
-    return (gravity == 90) ? MATRIX_A : MATRIX_B;
+    return topMatrix;
 }
 
 int HourglassMode::getBottomMatrix() {
-    return (gravity != 90) ? MATRIX_A : MATRIX_B;
-}
-
-bool HourglassMode::updateMatrix() {
-    int n = 8;
-    bool somethingMoved = false;
-    byte x, y;
-    bool direction;
-    for (byte slice = 0; slice < 2 * n - 1; ++slice) {
-        direction = (random(2) == 1);
-        byte z = slice < n ? 0 : slice - n + 1;
-        for (byte j = z; j <= slice - z; ++j) {
-            y = direction ? (7 - j) : (7 - (slice - j));
-            x = direction ? (slice - j) : j;
-            if (moveParticle(MATRIX_B, x, y)) {
-                somethingMoved = true;
-            }
-            if (moveParticle(MATRIX_A, x, y)) {
-                somethingMoved = true;
-            }
-        }
-    }
-    return somethingMoved;
+    return (topMatrix == MATRIX_A) ? MATRIX_B : MATRIX_A;
 }
 
 bool HourglassMode::dropParticle() {
-    if (dropDelay.Timeout()) {
-        dropDelay.Delay((unsigned long)getDelayDrop() * 1000UL); // Fix overflow
-        // Only drop when horizontal (gravity 0 or 180)
-        if (gravity == 0 || gravity == 180) {
-            if ((lc->getRawXY(MATRIX_A, 0, 0) && !lc->getRawXY(MATRIX_B, 7, 7)) ||
-                (!lc->getRawXY(MATRIX_A, 0, 0) && lc->getRawXY(MATRIX_B, 7, 7))
-            ) {
-                lc->invertRawXY(MATRIX_A, 0, 0);
-                lc->invertRawXY(MATRIX_B, 7, 7);
-                // Buzzer feedback for particle drop
-                tone(PIN_BUZZER, HOURGLASS_TONE_FREQ, HOURGLASS_TONE_DURATION);
-                return true;
-            }
-        }
+    uint8_t due = grainsDue();
+    if (due <= grainsDropped) return false;
+    if (due - grainsDropped > HOURGLASS_CATCHUP_GRAINS) {
+        // Far behind (back from another mode, or lying flat for a while):
+        // draw the settled state instead of running every grain through
+        render();
+        return true;
     }
-    return false;
-}
 
-void HourglassMode::alarm() {
-    // Initiate non-blocking alarm state
-    alarmActive = true;
-    alarmStartTime = millis();
+    // The neck passes one grain per tick, and none while lying flat
+    if (!sand.dropGrain()) return false;
+    sandMirror.noteDrop(tick);
+    grainsDropped++;
+    eventBus.post(EVENT_SOUND, SOUND_CLICK);
+    return true;
 }
 
+void HourglassMode::render() {
+    // Both chambers settled, as far as the timeline has got
+    grainsDropped = grainsDue();
+    bool originDown = getTopMatrix() == MATRIX_A;
+    SandCore::fill(lc->getBuffer(getTopMatrix()), HOURGLASS_PARTICLE_COUNT - grainsDropped, originDown);
+    SandCore::fill(lc->getBuffer(getBottomMatrix()), grainsDropped, originDown);
+    sandMirror.requestSync();
+}
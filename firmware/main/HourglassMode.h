@@ -3,42 +3,42 @@
 
 #include "LedControl.h"
 #include "MPU6050.h"
-#include "Delay.h"
+#include "SandCore.h"
+#include "EventBus.h"
 #include "config.h"
-#include "Coord.h"
 
+/**
+ * Hourglass timer. An elapsed-time timeline is the source of truth: it
+ * runs from millis() whether the mode is showing or not, and the sand
+ * is drawn from it - grain k passes the neck at k/N of the duration.
+ * Turning the device over mirrors the timeline, like a real hourglass.
+ */
 class HourglassMode {
 private:
     LedControl* lc;
     MPU6050* mpu;
+    SandCore sand;
+    uint16_t tick;          // update() calls, the step count a mirror keeps to
     int durationHours;
     int durationMinutes;
-    NonBlockDelay dropDelay;
     bool alarmWentOff;
-    bool alarmActive;
-    unsigned long alarmStartTime;
-    int alarmRepeatCount;
-    int gravity;
-    
-    // Helper functions matching reference code
-    coord getDown(int x, int y);
-    coord getLeft(int x, int y);
-    coord getRight(int x, int y);
-    bool canGoLeft(int addr, int x, int y);
-    bool canGoRight(int addr, int x, int y);
-    bool canGoDown(int addr, int x, int y);
-    void goDown(int addr, int x, int y);
-    void goLeft(int addr, int x, int y);
-    void goRight(int addr, int x, int y);
-    bool moveParticle(int addr, int x, int y);
-    int countParticles(int addr);
-    void fill(int addr, int maxcount);
+    bool animating;
+    bool active;            // Between enter() and exit()
+
+    // Timeline: elapsed = banked + (millis() - runStart) while running.
+    // runStart may lie ahead (startAt), elapsed stays 0 until then.
+    unsigned long banked;
+    unsigned long runStart;
+    bool running;
+    uint8_t grainsDropped;  // Grains drawn below the neck so far
+    int topMatrix;
+
+    void updateGravity();
     int getTopMatrix();
     int getBottomMatrix();
-    long getDelayDrop();
-    bool updateMatrix();
+    uint8_t grainsDue();
     bool dropParticle();
-    void alarm();
+    void render();
     
 public:
     HourglassMode(LedControl* lc, MPU6050* mpu);
@@ -46,8 +46,19 @@ public:
     void enter();
     void exit();
     void update();
+    bool isAnimating() const;
+    void onEvent(const Event& event);
     void setDuration(int h, int m);
+    int getDurationHours() const;
+    int getDurationMinutes() const;
     void reset();
+    // Reset now, but hold the sand at the neck until millis() reaches startMs
+    void startAt(unsigned long startMs);
+    void pause();
+    void resume();
+    unsigned long getDuration() const;  // ms
+    unsigned long getElapsed() const;   // ms, up to getDuration()
+    bool isRunning() const;             // Not paused (finished still counts)
     int getProgress();
 };
 
@@ -0,0 +1,123 @@
+#include "ImuStream.h"
+#include "MPU6050.h"
+#include "BinaryProtocol.h"
+#include "Recorder.h"
+#include "TraceRing.h"
+
+ImuStream imuStream;
+
+ImuStream::ImuStream() {
+    active = false;
+    framer = NULL;
+    periodUs = 0;
+    nextSampleAt = 0;
+    summed = 0;
+    decimation = 1;
+    cleanRecords = 0;
+    dropped = 0;
+    seq = 0;
+    totalSent = 0;
+    totalDropped = 0;
+}
+
+void ImuStream::start(uint16_t hz, BinaryProtocol* binary) {
+    hz = constrain(hz, 1, IMU_STREAM_MAX_HZ);
+    framer = binary;
+    periodUs = 1000000UL / hz;
+    nextSampleAt = micros();
+    memset(sums, 0, sizeof(sums));
+    summed = 0;
+    decimation = 1;
+    cleanRecords = 0;
+    dropped = 0;
+    seq = 0;
+    totalSent = 0;
+    totalDropped = 0;
+    active = true;
+}
+
+void ImuStream::stop() {
+    active = false;
+}
+
+bool ImuStream::isActive() const {
+    return active;
+}
+
+unsigned long ImuStream::getSent() const {
+    return totalSent;
+}
+
+unsigned long ImuStream::getDropped() const {
+    return totalDropped;
+}
+
+void ImuStream::update(MPU6050* mpu) {
+    if (!active) return;
+
+    unsigned long now = micros();
+    if ((long)(now - nextSampleAt) < 0) return;
+
+    // Periods missed while the loop was busy count as dropped samples
+    unsigned long missed = (now - nextSampleAt) / periodUs;
+    if (missed > 0) {
+        dropped = (dropped + missed > 255) ? 255 : dropped + missed;
+        totalDropped += missed;
+    }
+    nextSampleAt += (missed + 1) * periodUs;
+
+    mpu->update();
+    recorder.recordImu(mpu);
+
+    sums[0] += mpu->getRawX();
+    sums[1] += mpu->getRawY();
+    sums[2] += mpu->getRawZ();
+    sums[3] += mpu->getGyroX();
+    sums[4] += mpu->getGyroY();
+    sums[5] += mpu->getGyroZ();
+    if (++summed >= decimation) emit();
+}
+
+void ImuStream::emit() {
+    uint8_t record[IMU_STREAM_PAYLOAD];
+    uint16_t ms = (uint16_t)millis();
+    record[0] = (uint8_t)(seq & 0xFF);
+    record[1] = (uint8_t)(seq >> 8);
+    record[2] = (uint8_t)(ms & 0xFF);
+    record[3] = (uint8_t)(ms >> 8);
+    record[4] = dropped;
+    record[5] = decimation;
+    for (uint8_t i = 0; i < 6; i++) {
+        int16_t avg = (int16_t)(sums[i] / summed);
+        record[6 + i * 2] = (uint8_t)(avg & 0xFF);
+        record[7 + i * 2] = (uint8_t)((uint16_t)avg >> 8);
+        sums[i] = 0;
+    }
+    summed = 0;
+
+    // COBS adds a code byte and the delimiter to opcode, status and CRC
+    int needed = framer ? IMU_STREAM_PAYLOAD + 5 : IMU_STREAM_PAYLOAD + 1;
+    if (Serial.availableForWrite() < needed) {
+        TRACE(TRACE_DROP, TRACE_DROP_IMU);
+        if (dropped < 255) dropped++;
+        totalDropped++;
+        if (decimation < IMU_STREAM_MAX_DECIMATION) decimation <<= 1;
+        cleanRecords = 0;
+        return;
+    }
+
+    if (framer) {
+        framer->send(BIN_OP_IMU_SAMPLE, BIN_OK, record, sizeof(record));
+    } else {
+        Serial.write((uint8_t)IMU_STREAM_MARK);
+        Serial.write(record, sizeof(record));
+    }
+    seq++;
+    totalSent++;
+    dropped = 0;
+
+    if (decimation > 1 && ++cleanRecords >= IMU_STREAM_RECOVER_RECORDS) {
+        decimation >>= 1;
+        cleanRecords = 0;
+    }
+}
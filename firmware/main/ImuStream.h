@@ -0,0 +1,57 @@
+#ifndef IMU_STREAM_H
+#define IMU_STREAM_H
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * Streams raw accelerometer/gyro samples for threshold tuning.
+ *
+ * In text mode each sample goes out as IMU_STREAM_MARK followed by a
+ * fixed 18-byte payload (little endian):
+ *   seq u16, time ms u16, dropped u8, decimation u8, ax ay az gx gy gz i16
+ * In binary mode the same payload is sent as a BIN_OP_IMU_SAMPLE frame.
+ *
+ * Samples are only written when they fit in the TX buffer, so the main
+ * loop never blocks on the link. When one does not fit it is counted in
+ * "dropped" and the stream halves its rate, averaging "decimation" sensor
+ * reads per record; the rate steps back up after a run of clean records.
+ */
+
+#define IMU_STREAM_MARK 0xA6
+#define IMU_STREAM_PAYLOAD 18
+
+class MPU6050;
+class BinaryProtocol;
+
+class ImuStream {
+private:
+    bool active;
+    BinaryProtocol* framer;     // NULL in text mode
+    unsigned long periodUs;
+    unsigned long nextSampleAt;
+    int32_t sums[6];
+    uint8_t summed;
+    uint8_t decimation;
+    uint8_t cleanRecords;
+    uint8_t dropped;            // Since the last record sent
+    uint16_t seq;
+    unsigned long totalSent;
+    unsigned long totalDropped;
+
+    void emit();
+
+public:
+    ImuStream();
+    void start(uint16_t hz, BinaryProtocol* framer = NULL);
+    void stop();
+    bool isActive() const;
+    void update(MPU6050* mpu);
+
+    unsigned long getSent() const;
+    unsigned long getDropped() const;
+};
+
+extern ImuStream imuStream;
+
+#endif
@@ -0,0 +1,94 @@
+#include "JsonWriter.h"
+
+JsonWriter::JsonWriter(Print& out) : out(out) {
+    depth = 0;
+    hasItems = 0;
+}
+
+void JsonWriter::separate() {
+    if (hasItems & (1 << depth)) out.print(',');
+    hasItems |= 1 << depth;
+}
+
+void JsonWriter::key(const __FlashStringHelper* name) {
+    separate();
+    if (!name) return;
+    out.print('"');
+    out.print(name);
+    out.print(F("\":"));
+}
+
+void JsonWriter::beginObject(const __FlashStringHelper* name) {
+    key(name);
+    out.print('{');
+    depth++;
+    hasItems &= ~(1 << depth);
+}
+
+void JsonWriter::endObject() {
+    depth--;
+    out.print('}');
+}
+
+void JsonWriter::beginArray(const __FlashStringHelper* name) {
+    key(name);
+    out.print('[');
+    depth++;
+    hasItems &= ~(1 << depth);
+}
+
+void JsonWriter::endArray() {
+    depth--;
+    out.print(']');
+}
+
+void JsonWriter::field(const __FlashStringHelper* name, long value) {
+    key(name);
+    out.print(value);
+}
+
+void JsonWriter::field(const __FlashStringHelper* name, unsigned long value) {
+    key(name);
+    out.print(value);
+}
+
+void JsonWriter::field(const __FlashStringHelper* name, bool value) {
+    key(name);
+    out.print(value ? F("true") : F("false"));
+}
+
+void JsonWriter::field(const __FlashStringHelper* name, const char* value) {
+    key(name);
+    out.print('"');
+    out.print(value);
+    out.print('"');
+}
+
+void JsonWriter::field(const __FlashStringHelper* name, const __FlashStringHelper* value) {
+    key(name);
+    out.print('"');
+    out.print(value);
+    out.print('"');
+}
+
+void JsonWriter::fixed(const __FlashStringHelper* name, long value, uint8_t decimals) {
+    key(name);
+    if (value < 0) {
+        out.print('-');
+        value = -value;
+    }
+    long scale = 1;
+    for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+    out.print(value / scale);
+    if (decimals == 0) return;
+    out.print('.');
+    // Leading zeros of the fraction
+    long fraction = value % scale;
+    for (long digit = scale / 10; digit > 1 && fraction < digit; digit /= 10) out.print('0');
+    out.print(fraction);
+}
+
+void JsonWriter::value(long value) {
+    separate();
+    out.print(value);
+}
@@ -0,0 +1,43 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <Arduino.h>
+
+/**
+ * Streams JSON straight into a Print (normally Serial) with no buffer.
+ * Keys and string values are written as is, so they must not need
+ * escaping. Numbers are integers; fractions go out as fixed point.
+ */
+class JsonWriter {
+private:
+    Print& out;
+    uint8_t depth;
+    uint8_t hasItems;  // Bit n set once level n has an element (needs a comma)
+
+    void separate();
+    void key(const __FlashStringHelper* name);
+
+public:
+    JsonWriter(Print& out);
+
+    void beginObject(const __FlashStringHelper* name = NULL);
+    void endObject();
+    void beginArray(const __FlashStringHelper* name = NULL);
+    void endArray();
+
+    // Object members
+    void field(const __FlashStringHelper* name, long value);
+    void field(const __FlashStringHelper* name, unsigned long value);
+    void field(const __FlashStringHelper* name, int value) { field(name, (long)value); }
+    void field(const __FlashStringHelper* name, unsigned int value) { field(name, (unsigned long)value); }
+    void field(const __FlashStringHelper* name, bool value);
+    void field(const __FlashStringHelper* name, const char* value);
+    void field(const __FlashStringHelper* name, const __FlashStringHelper* value);
+    // value / 10^decimals, e.g. fixed(F("x"), -5, 2) writes "x":-0.05
+    void fixed(const __FlashStringHelper* name, long value, uint8_t decimals);
+
+    // Array elements
+    void value(long value);
+};
+
+#endif
@@ -27,6 +27,10 @@
 
 #include "LedControl.h"
 
+#if GREYSCALE_BITS > 0
+#include <util/atomic.h>
+#endif
+
 //the opcodes for the MAX7221 and MAX7219
 #define OP_NOOP   0
 #define OP_DIGIT0 1
@@ -43,6 +47,28 @@
 #define OP_SHUTDOWN    12
 #define OP_DISPLAYTEST 15
 
+//the ATmega328P's hardware SPI pins, used when the chain is wired to them
+#if defined(__AVR_ATmega328P__) || defined(ARDUINO_HOST_SHIM)
+#define HW_SPI_MOSI 11
+#define HW_SPI_SCK  13
+#define HW_SPI_SS   10
+#endif
+
+#if GREYSCALE_BITS > 0
+//Timer1 runs at clk/64, 4us per tick
+#define GREY_SLOT_TICKS (GREY_SLOT_US / 4)
+//ticks between two updates of the load figure, about a second
+#define GREY_LOAD_WINDOW 250000UL
+
+//the instance the Timer1 interrupt refreshes
+static LedControl* refreshTarget = NULL;
+
+ISR(TIMER1_COMPA_vect) {
+    if (refreshTarget)
+        refreshTarget->refresh();
+}
+#endif
+
 LedControl::LedControl(int dataPin, int clkPin, int csPin, int numDevices) {
     SPI_MOSI=dataPin;
     SPI_CLK=clkPin;
@@ -51,22 +77,59 @@ LedControl::LedControl(int dataPin, int clkPin, int csPin, int numDevices) {
         numDevices=8;
     maxDevices=numDevices;
     rotation=0;
+    transitionKind=TRANSITION_NONE;
+    transitionStep=0;
+    transitionFrames=0;
+    memset(status, 0, sizeof(status));  // Changed from 64 to 16 (2 matrices * 8 bytes)
+    memset(frontStatus, 0, sizeof(frontStatus));
+    memset(intensity, 0, sizeof(intensity));
+    memset(scanLimit, 7, sizeof(scanLimit));
+    shutdownMask=0xFF;
+    scrubStep=0;
+    fastSpi=false;
+#ifdef HW_SPI_MOSI
+    fastSpi=(dataPin==HW_SPI_MOSI && clkPin==HW_SPI_SCK);
+#endif
+#if GREYSCALE_BITS > 0
+    memset(greyStatus, 0, sizeof(greyStatus));
+    memset(planes, 0, sizeof(planes));
+    memset(panelRows, 0, sizeof(panelRows));
+    monoLevel[0]=monoLevel[1]=GREY_MAX;
+    shownSet=0;
+    planesPending=false;
+    resendRows=0;
+    greyActive=false;
+    greyPlane=0;
+    greyBusy=0;
+    greyTicks=0;
+    refreshLoad=0;
+#endif
+}
+
+void LedControl::begin() {
     pinMode(SPI_MOSI,OUTPUT);
     pinMode(SPI_CLK,OUTPUT);
     pinMode(SPI_CS,OUTPUT);
     digitalWrite(SPI_CS,HIGH);
-    for(int i=0;i<16;i++)  // Changed from 64 to 16 (2 matrices * 8 bytes)
-        status[i]=0x00;
+#ifdef HW_SPI_MOSI
+    if(fastSpi) {
+        //SS has to be an output or the SPI drops out of master mode
+        pinMode(HW_SPI_SS,OUTPUT);
+        //master, mode 0, MSB first, fosc/2 (8MHz, the MAX7219 takes 10)
+        SPCR=_BV(SPE) | _BV(MSTR);
+        SPSR=_BV(SPI2X);
+    }
+#endif
     for(int i=0;i<maxDevices;i++) {
         spiTransfer(i,OP_DISPLAYTEST,0);
         //scanlimit is set to max on startup
         setScanLimit(i,7);
         //decode is done in source
         spiTransfer(i,OP_DECODEMODE,0);
-        clearDisplay(i);
         //we go into shutdown-mode on startup
         shutdown(i,true);
     }
+    flush();
 }
 
 int LedControl::getDeviceCount() {
@@ -76,6 +139,21 @@ int LedControl::getDeviceCount() {
 void LedControl::shutdown(int addr, bool b) {
     if(addr<0 || addr>=maxDevices)
         return;
+#if GREYSCALE_BITS > 0
+    //no point waking the CPU for a dark panel
+    if(greyActive) {
+        if(b)
+            TIMSK1&=~_BV(OCIE1A);
+        else
+            TIMSK1|=_BV(OCIE1A);
+    }
+#endif
+    if(addr<2) {
+        if(b)
+            shutdownMask|=1<<addr;
+        else
+            shutdownMask&=~(1<<addr);
+    }
     if(b)
         spiTransfer(addr, OP_SHUTDOWN,0);
     else
@@ -85,15 +163,48 @@ void LedControl::shutdown(int addr, bool b) {
 void LedControl::setScanLimit(int addr, int limit) {
     if(addr<0 || addr>=maxDevices)
         return;
-    if(limit>=0 && limit<8)
+    if(limit>=0 && limit<8) {
+        if(addr<2)
+            scanLimit[addr]=limit;
         spiTransfer(addr, OP_SCANLIMIT,limit);
+    }
 }
 
 void LedControl::setIntensity(int addr, int intensity) {
     if(addr<0 || addr>=maxDevices)
         return;
-    if(intensity>=0 && intensity<16)
+    if(intensity>=0 && intensity<16) {
+        if(addr<2)
+            this->intensity[addr]=intensity;
         spiTransfer(addr, OP_INTENSITY,intensity);
+    }
+}
+
+void LedControl::scrub() {
+    //one register per call: the 8 digit rows, then the control registers
+    byte step=scrubStep;
+    if(++scrubStep>=SCRUB_STEPS)
+        scrubStep=0;
+    if(step<8) {
+#if GREYSCALE_BITS > 0
+        if(greyActive) {
+            //the refresh owns the digit registers, have it resend the row
+            resendRows|=1<<step;
+            return;
+        }
+#endif
+        writeRow(step, frontStatus);
+        return;
+    }
+    for(int addr=0;addr<maxDevices && addr<2;addr++) {
+        switch(step) {
+            case 8: spiTransfer(addr, OP_DISPLAYTEST,0); break;
+            case 9: spiTransfer(addr, OP_DECODEMODE,0); break;
+            case 10: spiTransfer(addr, OP_SCANLIMIT,scanLimit[addr]); break;
+            case 11: spiTransfer(addr, OP_INTENSITY,intensity[addr]); break;
+            case 12: spiTransfer(addr, OP_SHUTDOWN,(shutdownMask>>addr)&1 ? 0 : 1); break;
+        }
+    }
 }
 
 void LedControl::clearDisplay(int addr) {
@@ -102,10 +213,8 @@ void LedControl::clearDisplay(int addr) {
     if(addr<0 || addr>=maxDevices)
         return;
     offset=addr*8;
-    for(int i=0;i<8;i++) {
+    for(int i=0;i<8;i++)
         status[offset+i]=0;
-        spiTransfer(addr, i+1,status[offset+i]);
-    }
 }
 
 void LedControl::setRotation(int rot) {
@@ -199,7 +308,6 @@ void LedControl::setLed(int addr, int row, int column, boolean state) {
         val=~val;
         status[offset+row]=status[offset+row]&val;
     }
-    spiTransfer(addr, row+1,status[offset+row]);
 }
 
 void LedControl::invertRawXY(int addr, int x, int y) {
@@ -235,7 +343,6 @@ void LedControl::setRow(int addr, int row, byte value) {
         return;
     offset=addr*8;
     status[offset+row]=value;
-    spiTransfer(addr, row+1,status[offset+row]);
 }
 
 void LedControl::setColumn(int addr, int col, byte value) {
@@ -265,7 +372,6 @@ void LedControl::setDigit(int addr, int digit, byte value, boolean dp) {
     if(dp)
         v|=B10000000;
     status[offset+digit]=v;
-    spiTransfer(addr, digit+1,v);
 }
 
 void LedControl::setChar(int addr, int digit, char value, boolean dp) {
@@ -286,38 +392,311 @@ void LedControl::setChar(int addr, int digit, char value, boolean dp) {
     if(dp)
         v|=B10000000;
     status[offset+digit]=v;
-    spiTransfer(addr, digit+1,v);
+}
+
+void LedControl::sendByte(byte data) {
+#ifdef HW_SPI_MOSI
+    if(fastSpi) {
+        SPDR=data;
+        while(!(SPSR & _BV(SPIF)))
+            ;
+        return;
+    }
+#endif
+    shiftOut(SPI_MOSI,SPI_CLK,MSBFIRST,data);
 }
 
 void LedControl::spiTransfer(int addr, volatile byte opcode, volatile byte data) {
-    //Create an array with the data to shift out
-    int offset=addr*2;
+#if GREYSCALE_BITS > 0
+    //the refresh interrupt shares spidata and the chain
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#endif
+    {
+        //Create an array with the data to shift out
+        int offset=addr*2;
+        int maxbytes=maxDevices*2;
+
+        for(int i=0;i<maxbytes;i++)
+            spidata[i]=(byte)0;
+        //put our device data into the array
+        spidata[offset+1]=opcode;
+        spidata[offset]=data;
+        //enable the line
+        digitalWrite(SPI_CS,LOW);
+        //Now shift out the data
+        for(int i=maxbytes;i>0;i--)
+            sendByte(spidata[i-1]);
+        //latch the data onto the display
+        digitalWrite(SPI_CS,HIGH);
+    }
+}
+
+void LedControl::writeRow(int row, const byte* rows) {
     int maxbytes=maxDevices*2;
 
-    for(int i=0;i<maxbytes;i++)
-        spidata[i]=(byte)0;
-    //put our device data into the array
-    spidata[offset+1]=opcode;
-    spidata[offset]=data;
-    //enable the line
+    //one opcode/data pair per device, so all devices latch together
+    for(int addr=0;addr<maxDevices;addr++) {
+        spidata[addr*2+1]=row+1;
+        spidata[addr*2]=rows[addr*8+row];
+    }
     digitalWrite(SPI_CS,LOW);
-    //Now shift out the data
     for(int i=maxbytes;i>0;i--)
-        shiftOut(SPI_MOSI,SPI_CLK,MSBFIRST,spidata[i-1]);
-    //latch the data onto the display
+        sendByte(spidata[i-1]);
     digitalWrite(SPI_CS,HIGH);
 }
 
+byte* LedControl::getBuffer(int addr) {
+  if (addr<0 || addr>=maxDevices)
+    return NULL;
+  return &status[addr*8];
+}
+
 void LedControl::backup() {
   memcpy(backupStatus, status, 16);  // Changed from 64 to 16
 }
 void LedControl::restore() {
   memcpy(status, backupStatus, 16);  // Changed from 64 to 16
-  int offset;
-  for (int addr=0; addr<maxDevices; addr++) {
-    offset=addr*8;
-    for(int i=0;i<8;i++) {
-      spiTransfer(addr, i+1,status[offset+i]);
+  flush();
+}
+
+void LedControl::flush() {
+  memcpy(frontStatus, status, 16);
+#if GREYSCALE_BITS > 0
+  if (greyActive) {
+    publishPlanes(frontStatus);
+    resendRows = 0xFF;
+    return;
+  }
+#endif
+  for (int row=0; row<8; row++) {
+    writeRow(row, frontStatus);
+  }
+}
+
+void LedControl::startTransition(byte kind, byte frames) {
+  if (frames < 1) frames = 1;
+  if (frames > 64) frames = 64;
+  // The panel content becomes the "from" frame, the back buffer the "to" frame
+  memcpy(backupStatus, frontStatus, 16);
+  transitionKind = kind;
+  transitionFrames = frames;
+  transitionStep = 0;
+}
+
+boolean LedControl::isTransitioning() {
+  return transitionKind != TRANSITION_NONE;
+}
+
+/*
+ * Dissolve order: pixel index with its 6 bits reversed gives a
+ * permutation of 0..63 that scatters evenly over the matrix.
+ */
+static byte dissolveRank(int row, int col) {
+  byte i = (row << 3) | col;
+  byte r = 0;
+  for (byte b = 0; b < 6; b++) {
+    r = (r << 1) | (i & 1);
+    i >>= 1;
+  }
+  return r;
+}
+
+byte LedControl::composeRow(int addr, int row) {
+  int offset = addr*8;
+  byte from = backupStatus[offset+row];
+  byte to = status[offset+row];
+  // Progress of the transition in 1/64ths
+  byte done = ((transitionStep + 1) * 64) / transitionFrames;
+
+  if (transitionKind == TRANSITION_WIPE) {
+    byte cols = done >> 3;
+    byte mask = (byte)(0xFF00 >> cols);
+    return (to & mask) | (from & ~mask);
+  }
+  if (transitionKind == TRANSITION_SLIDE) {
+    // New frame pushes the old one up, row by row
+    int shift = done >> 3;
+    if (row + shift < 8) return backupStatus[offset+row+shift];
+    return status[offset+row+shift-8];
+  }
+  if (transitionKind == TRANSITION_DISSOLVE) {
+    byte value = 0;
+    for (int col = 0; col < 8; col++) {
+      byte bit = B10000000 >> col;
+      byte src = (dissolveRank(row, col) < done) ? to : from;
+      value |= src & bit;
+    }
+    return value;
+  }
+  return to;
+}
+
+boolean LedControl::commit() {
+  byte frame[16];
+  const byte* rows = status;
+  boolean sent = false;
+
+  if (transitionKind != TRANSITION_NONE) {
+    for (int addr=0; addr<maxDevices; addr++) {
+      for (int row=0; row<8; row++) {
+        frame[addr*8+row] = composeRow(addr, row);
+      }
+    }
+    rows = frame;
+    if (++transitionStep >= transitionFrames) {
+      transitionKind = TRANSITION_NONE;
+    }
+  }
+
+#if GREYSCALE_BITS > 0
+  if (greyActive) {
+    memcpy(frontStatus, rows, 16);
+    return publishPlanes(rows);
+  }
+#endif
+
+  for (int row=0; row<8; row++) {
+    boolean changed = false;
+    for (int addr=0; addr<maxDevices; addr++) {
+      if (frontStatus[addr*8+row] != rows[addr*8+row]) {
+        frontStatus[addr*8+row] = rows[addr*8+row];
+        changed = true;
+      }
+    }
+    if (changed) {
+      writeRow(row, frontStatus);
+      sent = true;
+    }
+  }
+  return sent;
+}
+
+#if GREYSCALE_BITS > 0
+boolean LedControl::publishPlanes(const byte* rows) {
+  //keep the interrupt off the spare set while it is being written
+  planesPending = false;
+  byte next = shownSet ^ 1;
+  boolean changed = false;
+  for (int b=0; b<GREYSCALE_BITS; b++) {
+    for (int i=0; i<maxDevices*8; i++) {
+      byte mono = ((monoLevel[i >> 3] >> b) & 1) ? 0xFF : 0x00;
+      byte value = (rows[i] & mono) | (~rows[i] & greyStatus[b][i]);
+      planes[next][b][i] = value;
+      if (value != planes[shownSet][b][i]) changed = true;
+    }
+  }
+  planesPending = changed;
+  return changed;
+}
+
+boolean LedControl::beginGreyscale() {
+  if (!fastSpi) return false;
+  if (greyActive) return true;
+  //the devices hold the last committed frame
+  memcpy(panelRows, frontStatus, 16);
+  publishPlanes(frontStatus);
+  refreshTarget = this;
+  //the first interrupt starts a new cycle
+  greyPlane = GREYSCALE_BITS - 1;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    //CTC on OCR1A, clk/64
+    TCCR1A = 0;
+    TCCR1B = _BV(WGM12) | _BV(CS11) | _BV(CS10);
+    OCR1A = GREY_SLOT_TICKS - 1;
+    TCNT1 = 0;
+    TIMSK1 |= _BV(OCIE1A);
+    greyActive = true;
+  }
+  return true;
+}
+
+boolean LedControl::isGreyscale() {
+  return greyActive;
+}
+
+void LedControl::setLevel(int addr, byte level) {
+  if (addr<0 || addr>=maxDevices || addr>1)
+    return;
+  monoLevel[addr] = level > GREY_MAX ? GREY_MAX : level;
+}
+
+void LedControl::setGrey(int addr, int row, int col, byte level) {
+  if (addr<0 || addr>=maxDevices)
+    return;
+  if (row<0 || row>7 || col<0 || col>7)
+    return;
+  byte bit = B10000000 >> col;
+  for (int b=0; b<GREYSCALE_BITS; b++) {
+    if ((level >> b) & 1)
+      greyStatus[b][addr*8+row] |= bit;
+    else
+      greyStatus[b][addr*8+row] &= ~bit;
+  }
+}
+
+byte LedControl::getGrey(int addr, int row, int col) {
+  if (addr<0 || addr>=maxDevices)
+    return 0;
+  if (row<0 || row>7 || col<0 || col>7)
+    return 0;
+  byte bit = B10000000 >> col;
+  byte level = 0;
+  for (int b=0; b<GREYSCALE_BITS; b++) {
+    if (greyStatus[b][addr*8+row] & bit)
+      level |= 1 << b;
+  }
+  return level;
+}
+
+void LedControl::clearGrey(int addr) {
+  if (addr<0 || addr>=maxDevices)
+    return;
+  for (int b=0; b<GREYSCALE_BITS; b++)
+    memset(&greyStatus[b][addr*8], 0, 8);
+}
+
+unsigned int LedControl::getRefreshLoad() {
+  unsigned int load;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    load = refreshLoad;
+  }
+  return load;
+}
+
+void LedControl::refresh() {
+  //OCR1A still holds the length of the slot that just ended
+  greyTicks += OCR1A + 1;
+  if (++greyPlane >= GREYSCALE_BITS) {
+    greyPlane = 0;
+    //new frames only start with a cycle, so a frame never mixes planes
+    if (planesPending) {
+      shownSet ^= 1;
+      planesPending = false;
     }
   }
+  OCR1A = (GREY_SLOT_TICKS << greyPlane) - 1;
+
+  //bit planes of a steady mono frame are all the same, nothing goes out
+  const byte* rows = planes[shownSet][greyPlane];
+  for (int row=0; row<8; row++) {
+    boolean changed = resendRows & (1 << row);
+    for (int addr=0; addr<maxDevices; addr++) {
+      if (panelRows[addr*8+row] != rows[addr*8+row]) {
+        panelRows[addr*8+row] = rows[addr*8+row];
+        changed = true;
+      }
+    }
+    if (changed)
+      writeRow(row, rows);
+  }
+  resendRows = 0;
+
+  //TCNT1 restarted at the compare match: it is our own run time
+  greyBusy += TCNT1;
+  if (greyTicks >= GREY_LOAD_WINDOW) {
+    refreshLoad = (greyBusy * 1000) / greyTicks;
+    greyBusy = 0;
+    greyTicks = 0;
+  }
 }
+#endif
@@ -36,6 +36,20 @@
 #include <WProgram.h>
 #endif
 
+#include "config.h"
+
+/*
+ * Greyscale needs the AVR's hardware SPI and Timer1; on other targets
+ * the bit-plane refresh is compiled out
+ */
+#if !defined(__AVR_ATmega328P__) && !defined(ARDUINO_HOST_SHIM)
+#undef GREYSCALE_BITS
+#define GREYSCALE_BITS 0
+#endif
+#if GREYSCALE_BITS > 0
+#define GREY_MAX ((1 << GREYSCALE_BITS) - 1)
+#endif
+
 /*
  * Segments to be switched on for characters and digits on
  * 7-Segment Displays
@@ -59,16 +73,68 @@ const static byte charTable [] PROGMEM  = {
     B00000000,B00000000,B00000000,B00000000,B00000000,B00000000,B00000000,B00000000
 };
 
+/*
+ * Transitions that commit() can play between the frame on the panel
+ * and the newly drawn back buffer
+ */
+#define TRANSITION_NONE     0
+#define TRANSITION_WIPE     1
+#define TRANSITION_SLIDE    2
+#define TRANSITION_DISSOLVE 3
+
+/* Calls to scrub() that rewrite every register once */
+#define SCRUB_STEPS 13
+
 class LedControl {
     private :
         /* The array for shifting the data to the devices - reduced for 2 matrices */
         byte spidata[4];  // Changed from 16 to 4 (2 devices * 2 bytes)
         /* Send out a single command to the device */
         void spiTransfer(int addr, byte opcode, byte data);
+        /* Send the same row of every device in a single latch */
+        void writeRow(int row, const byte* rows);
+        /* Row of the frame being shown while a transition is running */
+        byte composeRow(int addr, int row);
+        /* Clock one byte out, through the SPI hardware when the pins allow it */
+        void sendByte(byte data);
+        /* Data and clock are the hardware MOSI/SCK pins */
+        boolean fastSpi;
+#if GREYSCALE_BITS > 0
+        /* Put a composed frame into the plane set the refresh picks up next */
+        boolean publishPlanes(const byte* rows);
+
+        /* Grey level bit planes of the pixels that are off in the back buffer */
+        byte greyStatus[GREYSCALE_BITS][16];
+        /* Level the lit pixels of each device are shown at */
+        byte monoLevel[2];
+        /* Output bit planes: one set is being shown, the other is the next frame */
+        byte planes[2][GREYSCALE_BITS][16];
+        /* Rows the devices are holding right now */
+        byte panelRows[16];
+        volatile byte shownSet;
+        volatile boolean planesPending;
+        /* Rows the next refresh sends whether they changed or not, bit per row */
+        volatile byte resendRows;
+        boolean greyActive;
+        byte greyPlane;
+        /* Timer1 ticks spent in refresh() against ticks elapsed, for the load figure */
+        unsigned long greyBusy;
+        unsigned long greyTicks;
+        volatile unsigned int refreshLoad;
+#endif
 
         /* We keep track of the led-status for 2 devices (16 bytes instead of 64) */
-        byte status[16];  // Reduced from 64 - only need 2 matrices * 8 bytes = 16
-        byte backupStatus[16];  // Reduced from 64
+        byte status[16];  // Back buffer - all drawing goes here
+        byte frontStatus[16];  // What the panel is currently showing
+        byte backupStatus[16];  // Backup slot, also the "from" frame of a transition
+        /* Control registers as last set, for scrub() */
+        byte intensity[2];
+        byte scanLimit[2];
+        byte shutdownMask;
+        byte scrubStep;
+        byte transitionKind;
+        byte transitionStep;
+        byte transitionFrames;
         /* Data is shifted out of this pin*/
         int SPI_MOSI;
         /* The clock is signaled on this pin */
@@ -91,6 +157,12 @@ class LedControl {
          */
         LedControl(int dataPin, int clkPin, int csPin, int numDevices=1);
 
+        /*
+         * Set up the pins and the devices. Kept out of the constructor
+         * so global instances don't talk to the hardware before setup().
+         */
+        void begin();
+
         void setRotation(int rot);
 
         /*
@@ -128,7 +200,17 @@ class LedControl {
         void setIntensity(int addr, int intensity);
 
         /*
-         * Switch all Leds on the display off.
+         * Rewrite one device register from the state we hold: the next
+         * digit row, or display test, decode mode, scan limit, intensity
+         * or shutdown, SCRUB_STEPS calls for all of them. Called at a
+         * steady rate it repairs registers the chain picked up noise in,
+         * at a few bytes per call.
+         */
+        void scrub();
+
+        /*
+         * Switch all Leds on the display off. Like all drawing calls this
+         * only changes the back buffer, commit() puts it on the panel.
          * Params:
          * addr	address of the display to control
          */
@@ -163,9 +245,88 @@ class LedControl {
         coord rotate180(coord xy);
         coord rotate270(coord xy);
 
+        /*
+         * Direct access to the 8 back buffer rows of a device, for
+         * code that simulates on whole rows (bit 7 is column 0).
+         * Returns :
+         * byte*	the rows, or NULL for an invalid address
+         */
+        byte* getBuffer(int addr);
+
         void backup();
         void restore();
 
+        /*
+         * Push the back buffer to the panel. Only rows that differ from
+         * what the panel is showing are sent, one latch per row for all
+         * devices. While a transition is running every call advances it
+         * by one frame.
+         * Returns :
+         * boolean	true if anything was sent to the devices
+         */
+        boolean commit();
+
+        /*
+         * Resend every row of the back buffer, whether it changed or not.
+         */
+        void flush();
+
+        /*
+         * Start a transition from the frame currently on the panel to
+         * whatever gets drawn into the back buffer next. The transition
+         * is played by the following commit() calls.
+         * Params:
+         * kind	one of the TRANSITION_* values
+         * frames	number of commit() calls the transition lasts (1..64)
+         */
+        void startTransition(byte kind, byte frames);
+        boolean isTransitioning();
+
+#if GREYSCALE_BITS > 0
+        /*
+         * Start showing grey levels. Timer1 then cycles through the bit
+         * planes, holding plane b for GREY_SLOT_US << b, and owns the
+         * digit registers; commit() only hands it the next frame. Needs
+         * data and clock on the hardware SPI pins.
+         * Returns :
+         * boolean	false if the pins can't drive the refresh
+         */
+        boolean beginGreyscale();
+        boolean isGreyscale();
+
+        /*
+         * Set the level the lit pixels of a device are shown at.
+         * Params:
+         * addr	address of the display
+         * level	0 (off) .. GREY_MAX (full brightness, the default)
+         */
+        void setLevel(int addr, byte level);
+
+        /*
+         * Set the grey level of a single Led. It shows while the Led is
+         * off in the back buffer; a lit Led uses the device level.
+         * Params:
+         * addr	address of the display
+         * row	the row of the Led (0..7)
+         * col	the column of the Led (0..7)
+         * level	0 (off) .. GREY_MAX
+         */
+        void setGrey(int addr, int row, int col, byte level);
+        byte getGrey(int addr, int row, int col);
+        void clearGrey(int addr);
+
+        /*
+         * Share of the CPU the refresh interrupt took over about the
+         * last second.
+         * Returns :
+         * unsigned int	load in 1/1000
+         */
+        unsigned int getRefreshLoad();
+
+        /* Show the next bit plane. Called from the Timer1 interrupt */
+        void refresh();
+#endif
+
         /*
          * Set all 8 Led's in a row to a new state
          * Params:
@@ -1,9 +1,15 @@
 #include "MPU6050.h"
 #include "config.h"
+#include "TraceRing.h"
 
 #define MPU6050_ADDR 0x68
 #define MPU6050_WHO_AM_I 0x75
 #define MPU6050_PWR_MGMT_1 0x6B
+#define MPU6050_PWR_MGMT_2 0x6C
+#define MPU6050_CYCLE 0x20
+#define MPU6050_TEMP_DIS 0x08
+#define MPU6050_LP_WAKE_5HZ 0x40
+#define MPU6050_STBY_GYRO 0x07
 #define MPU6050_ACCEL_XOUT_H 0x3B
 
 MPU6050::MPU6050() {
@@ -15,6 +21,8 @@ MPU6050::MPU6050() {
     sensorX_missing = false;
     sensorY_missing = false;
     sensorZ_missing = false;
+    probePin = 3;
+    readyAt = 0;
     lastShakeX = lastShakeY = lastShakeZ = 0.0;
     lastFlipZ = 0.0;
 }
@@ -26,19 +34,36 @@ bool MPU6050::init() {
     byte error = Wire.endTransmission();
     
     if (error != 0) {
-        // MPU6050 not available, check for analog sensors
+        TRACE(TRACE_I2C_FAIL, error);
+        // MPU6050 not available, probe the analog sensors from update(),
+        // one axis per call, and use 1g defaults until then
         usingAnalogFallback = true;
-        sensorX_missing = isAnalogSensorMissing(A1);
-        sensorY_missing = isAnalogSensorMissing(A2);
-        sensorZ_missing = isAnalogSensorMissing(A3);
+        sensorX_missing = sensorY_missing = sensorZ_missing = true;
+        probePin = 0;
         return false;
     }
     
-    delay(100);
+    // Don't block while the sensor wakes up - update() skips reads until then
+    readyAt = millis() + MPU6050_STARTUP_MS;
     usingAnalogFallback = false;
     return true;
 }
 
+void MPU6050::setLowPower(bool enabled) {
+    if (usingAnalogFallback) return;
+
+    // Gyros off and accel woken at 5 Hz in low-power mode
+    Wire.beginTransmission(MPU6050_ADDR);
+    Wire.write(MPU6050_PWR_MGMT_2);
+    Wire.write(enabled ? (MPU6050_LP_WAKE_5HZ | MPU6050_STBY_GYRO) : 0);
+    Wire.endTransmission();
+
+    Wire.beginTransmission(MPU6050_ADDR);
+    Wire.write(MPU6050_PWR_MGMT_1);
+    Wire.write(enabled ? (MPU6050_CYCLE | MPU6050_TEMP_DIS) : 0);
+    Wire.endTransmission();
+}
+
 bool MPU6050::isAnalogSensorMissing(int pin, int samples) {
     // NOTE: This detection assumes floating analog pins read ~512 (mid-rail)
     // This may vary on different Arduino boards. Test on your hardware!
@@ -66,6 +91,18 @@ bool MPU6050::isAnalogSensorMissing(int pin, int samples) {
 
 void MPU6050::update() {
     unsigned long now = millis();
+
+    if (probePin < 3) {
+        bool missing = isAnalogSensorMissing(A1 + probePin);
+        if (probePin == 0) sensorX_missing = missing;
+        else if (probePin == 1) sensorY_missing = missing;
+        else sensorZ_missing = missing;
+        probePin++;
+    }
+
+    if (!usingAnalogFallback && (long)(now - readyAt) < 0) {
+        return;
+    }
     
     // Try to read from MPU6050
     Wire.beginTransmission(MPU6050_ADDR);
@@ -73,8 +110,11 @@ void MPU6050::update() {
     Wire.endTransmission(false);
     
     // Check if we got the expected number of bytes
-    if (Wire.requestFrom(MPU6050_ADDR, 14, true) != 14) {
-        // I2C communication failed, use analog fallback
+    uint8_t received = Wire.requestFrom(MPU6050_ADDR, 14, true);
+    if (received != 14) {
+        // I2C communication failed, use analog fallback. Traced once per
+        // outage, not on every retry
+        if (!usingAnalogFallback) TRACE(TRACE_I2C_FAIL, received);
         usingAnalogFallback = true;
         
         // Sample accelX from A1
@@ -169,6 +209,30 @@ bool MPU6050::isAnalogFallbackActive() const {
     return usingAnalogFallback;
 }
 
+int16_t MPU6050::getRawX() const {
+    return accelX;
+}
+
+int16_t MPU6050::getRawY() const {
+    return accelY;
+}
+
+int16_t MPU6050::getRawZ() const {
+    return accelZ;
+}
+
+int16_t MPU6050::getGyroX() const {
+    return gyroX;
+}
+
+int16_t MPU6050::getGyroY() const {
+    return gyroY;
+}
+
+int16_t MPU6050::getGyroZ() const {
+    return gyroZ;
+}
+
 float MPU6050::getX() const {
     return constrain(accelX / 16384.0, -1.0, 1.0);
 }
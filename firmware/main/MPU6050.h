@@ -14,6 +14,8 @@ private:
     bool sensorX_missing;
     bool sensorY_missing;
     bool sensorZ_missing;
+    uint8_t probePin;          // Next analog axis to probe (3 = done)
+    unsigned long readyAt;     // MPU6050 output is valid from here on
     
     // State for shake/flip detection
     float lastShakeX, lastShakeY, lastShakeZ;
@@ -24,8 +26,12 @@ private:
     
 public:
     MPU6050();
+    // Wakes the sensor and returns at once - readings start once it has settled
     bool init();
     void update();
+
+    // Switch between full rate and low-power accel-only cycle mode
+    void setLowPower(bool enabled);
     
     // Check if using analog fallback
     bool isAnalogFallbackActive() const;
@@ -33,6 +39,14 @@ public:
     // Get orientation angle (0-360 degrees)
     int getAngle() const;
     
+    // Get raw acceleration (16384 per g)
+    int16_t getRawX() const;
+    int16_t getRawY() const;
+    int16_t getRawZ() const;
+    int16_t getGyroX() const;
+    int16_t getGyroY() const;
+    int16_t getGyroZ() const;
+
     // Get normalized acceleration (-1.0 to 1.0)
     float getX() const;
     float getY() const;
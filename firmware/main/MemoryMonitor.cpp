@@ -0,0 +1,44 @@
+#include "MemoryMonitor.h"
+
+#ifdef __AVR__
+extern uint8_t __data_start, __data_end;
+extern uint8_t __bss_start, __bss_end;
+extern uint8_t __heap_start;
+extern uint8_t* __brkval;
+
+// Runs from .init3: the stack pointer is at RAMEND and nothing is on it
+// yet, so the whole gap can be painted. Naked, so no frame of its own.
+void paintMemory(void) __attribute__((naked, used, section(".init3")));
+void paintMemory(void) {
+    uint8_t* p = &__heap_start;
+    while (p <= (uint8_t*)RAMEND) *p++ = MEMORY_PAINT;
+    (&__heap_start)[0] = MEMORY_CANARY & 0xFF;
+    (&__heap_start)[1] = MEMORY_CANARY >> 8;
+}
+
+void getMemoryStats(MemoryStats* stats) {
+    uint8_t* heapTop = __brkval ? __brkval : &__heap_start;
+    uint8_t top;  // Its address is (close to) the stack pointer
+
+    stats->data = &__data_end - &__data_start;
+    stats->bss = &__bss_end - &__bss_start;
+    stats->heap = heapTop - &__heap_start;
+    stats->freeNow = &top - heapTop;
+
+    // The stack grows down into the painted bytes; skip the canary
+    uint8_t* p = &__heap_start + 2;
+    if (p < heapTop) p = heapTop;
+    while (p <= (uint8_t*)RAMEND && *p == MEMORY_PAINT) p++;
+    stats->freeMin = p - heapTop;
+    stats->stackPeak = (uint8_t*)RAMEND - p + 1;
+
+    // malloc legitimately takes the canary bytes over
+    stats->canaryOk = __brkval ||
+        ((&__heap_start)[0] == (MEMORY_CANARY & 0xFF) && (&__heap_start)[1] == (MEMORY_CANARY >> 8));
+}
+#else
+void getMemoryStats(MemoryStats* stats) {
+    memset(stats, 0, sizeof(MemoryStats));
+    stats->canaryOk = true;
+}
+#endif
@@ -0,0 +1,33 @@
+#ifndef MEMORY_MONITOR_H
+#define MEMORY_MONITOR_H
+
+#include <Arduino.h>
+
+/**
+ * SRAM margins measured on the running device.
+ *
+ * Before the constructors run, everything between the end of .bss and
+ * the top of RAM is painted with MEMORY_PAINT, and a canary goes at the
+ * bottom of that gap. The lowest byte the stack has overwritten since
+ * then is its high-water mark. A broken canary means the stack ran into
+ * the globals at some point.
+ *
+ * On targets without the AVR linker symbols every figure reads 0.
+ */
+
+#define MEMORY_PAINT 0xC5
+#define MEMORY_CANARY 0x5AA5
+
+struct MemoryStats {
+    uint16_t data;       // Initialised globals, RAM strings included
+    uint16_t bss;        // Zeroed globals
+    uint16_t heap;       // Handed out by malloc
+    uint16_t freeNow;    // Between the heap top and the stack pointer
+    uint16_t stackPeak;  // Deepest the stack has been since boot
+    uint16_t freeMin;    // Smallest the gap has been since boot
+    bool canaryOk;
+};
+
+void getMemoryStats(MemoryStats* stats);
+
+#endif
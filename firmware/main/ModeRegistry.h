@@ -0,0 +1,66 @@
+#ifndef MODE_REGISTRY_H
+#define MODE_REGISTRY_H
+
+#include <Arduino.h>
+#include <avr/pgmspace.h>
+#include "EventBus.h"
+
+// Mode flags
+#define MODE_NEEDS_IMU 0x01  // Refresh the MPU6050 before every tick
+
+/**
+ * One entry of the PROGMEM mode table.
+ * Dispatch goes through plain function pointers generated per mode
+ * object, so no vtables end up in SRAM.
+ */
+struct ModeDescriptor {
+    void (*enter)();
+    void (*exit)();
+    void (*update)();
+    bool (*isAnimating)();
+    void (*onEvent)(const Event& event);
+    uint16_t activeTickMs;  // Tick period while animating, moved or talked to
+    uint16_t idleTickMs;    // Tick period once all that settled (FRAME_SETTLE_MS)
+    uint8_t flags;
+    uint8_t events;         // EVENT_BIT()s the mode subscribes to
+};
+
+template <class M, M* mode> void modeEnterThunk() { mode->enter(); }
+template <class M, M* mode> void modeExitThunk() { mode->exit(); }
+template <class M, M* mode> void modeUpdateThunk() { mode->update(); }
+template <class M, M* mode> bool modeAnimatingThunk() { return mode->isAnimating(); }
+template <class M, M* mode> void modeEventThunk(const Event& event) { mode->onEvent(event); }
+inline void modeIgnoreEvent(const Event&) {}
+
+/**
+ * Registers a statically allocated mode object.
+ * The object must provide enter(), exit(), update() and isAnimating(),
+ * and onEvent(const Event&) for the events it subscribes to.
+ */
+#define MODE_ENTRY(obj, activeMs, idleMs, flags, events) \
+    { &modeEnterThunk<decltype(obj), &obj>, \
+      &modeExitThunk<decltype(obj), &obj>, \
+      &modeUpdateThunk<decltype(obj), &obj>, \
+      &modeAnimatingThunk<decltype(obj), &obj>, \
+      &modeEventThunk<decltype(obj), &obj>, \
+      (activeMs), (idleMs), (flags), (events) }
+
+/**
+ * Registers a mode that takes no events and has no onEvent()
+ */
+#define MODE_ENTRY_NO_EVENTS(obj, activeMs, idleMs, flags) \
+    { &modeEnterThunk<decltype(obj), &obj>, \
+      &modeExitThunk<decltype(obj), &obj>, \
+      &modeUpdateThunk<decltype(obj), &obj>, \
+      &modeAnimatingThunk<decltype(obj), &obj>, \
+      &modeIgnoreEvent, \
+      (activeMs), (idleMs), (flags), 0 }
+
+/**
+ * Copy a table entry out of flash
+ */
+inline void readModeDescriptor(const ModeDescriptor* table, uint8_t index, ModeDescriptor* out) {
+    memcpy_P(out, &table[index], sizeof(ModeDescriptor));
+}
+
+#endif
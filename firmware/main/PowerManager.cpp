@@ -0,0 +1,99 @@
+#include "PowerManager.h"
+#include <avr/sleep.h>
+
+PowerManager::PowerManager(LedControl* lc, MPU6050* mpu) {
+    this->lc = lc;
+    this->mpu = mpu;
+    state = POWER_ACTIVE;
+    lastActivity = 0;
+    lastX = lastY = lastZ = 0.0;
+    windowStart = 0;
+    windowSleepUs = 0;
+    sleepPercent = 0;
+}
+
+void PowerManager::init() {
+    state = POWER_ACTIVE;
+    lastActivity = millis();
+    windowStart = millis();
+}
+
+bool PowerManager::noteActivity() {
+    lastActivity = millis();
+    if (state == POWER_STANDBY) {
+        leaveStandby();
+        return true;
+    }
+    return false;
+}
+
+void PowerManager::noteMotion() {
+    float x = mpu->getX();
+    float y = mpu->getY();
+    float z = mpu->getZ();
+    float delta = abs(x - lastX) + abs(y - lastY) + abs(z - lastZ);
+    lastX = x;
+    lastY = y;
+    lastZ = z;
+    if (delta > POWER_MOTION_THRESHOLD) {
+        noteActivity();
+    }
+}
+
+void PowerManager::update(bool animating) {
+    if (animating) {
+        // Running sand or a ringing alarm must stay visible
+        noteActivity();
+        return;
+    }
+    if (state == POWER_ACTIVE && (millis() - lastActivity) >= POWER_STANDBY_TIMEOUT_MS) {
+        enterStandby();
+    }
+}
+
+void PowerManager::enterStandby() {
+    state = POWER_STANDBY;
+    for (int i = 0; i < lc->getDeviceCount(); i++) {
+        lc->shutdown(i, true);
+    }
+    mpu->setLowPower(true);
+}
+
+void PowerManager::leaveStandby() {
+    state = POWER_ACTIVE;
+    mpu->setLowPower(false);
+    for (int i = 0; i < lc->getDeviceCount(); i++) {
+        lc->shutdown(i, false);
+    }
+}
+
+void PowerManager::idle() {
+#if POWER_SLEEP_ENABLED
+    // Idle mode keeps clkIO running, so Timer0 (millis), Timer2 (buzzer),
+    // USART RX and the button interrupt all wake us up again
+    unsigned long start = micros();
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    sleep_enable();
+    sleep_cpu();
+    sleep_disable();
+    windowSleepUs += micros() - start;
+#endif
+
+    if (millis() - windowStart >= 1000) {
+        sleepPercent = min(windowSleepUs / ((millis() - windowStart) * 10UL), 100UL);
+        windowStart = millis();
+        windowSleepUs = 0;
+    }
+}
+
+uint8_t PowerManager::getState() const {
+    return state;
+}
+
+uint8_t PowerManager::getSleepPercent() const {
+    return sleepPercent;
+}
+
+unsigned long PowerManager::getIdleTime() const {
+    return millis() - lastActivity;
+}
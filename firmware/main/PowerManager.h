@@ -0,0 +1,50 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include "LedControl.h"
+#include "MPU6050.h"
+#include "config.h"
+
+// Power states
+#define POWER_ACTIVE 0   // Display on, IMU at full rate
+#define POWER_STANDBY 1  // Drivers shut down, IMU in low-power cycle mode
+
+class PowerManager {
+private:
+    LedControl* lc;
+    MPU6050* mpu;
+    uint8_t state;
+    unsigned long lastActivity;
+    float lastX, lastY, lastZ;
+
+    // Sleep accounting over a one second window
+    unsigned long windowStart;
+    unsigned long windowSleepUs;
+    uint8_t sleepPercent;
+
+    void enterStandby();
+    void leaveStandby();
+
+public:
+    PowerManager(LedControl* lc, MPU6050* mpu);
+    void init();
+
+    // Record user/host activity. Returns true if this woke the device
+    bool noteActivity();
+
+    // Feed a fresh IMU sample - motion counts as activity
+    void noteMotion();
+
+    // Apply the inactivity policy
+    void update(bool animating);
+
+    // Sleep the CPU until the next interrupt
+    void idle();
+
+    uint8_t getState() const;
+    uint8_t getSleepPercent() const;
+    unsigned long getIdleTime() const;
+};
+
+#endif
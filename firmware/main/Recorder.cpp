@@ -0,0 +1,67 @@
+#include "Recorder.h"
+#include "MPU6050.h"
+
+Recorder recorder;
+
+Recorder::Recorder() {
+    active = false;
+    lastTime = 0;
+}
+
+void Recorder::start() {
+    active = true;
+    lastTime = millis();
+}
+
+void Recorder::stop() {
+    active = false;
+}
+
+bool Recorder::isActive() const {
+    return active;
+}
+
+void Recorder::writeHeader(uint8_t type, unsigned long time) {
+    // Edges drained late may carry a stamp before the previous record
+    unsigned long delta = (time > lastTime) ? time - lastTime : 0;
+    lastTime += delta;
+
+    while (delta > 0xFFFF) {
+        uint8_t gap[4] = { REC_MARK, REC_GAP, 0xFF, 0xFF };
+        Serial.write(gap, sizeof(gap));
+        delta -= 0xFFFF;
+    }
+
+    uint8_t header[4] = { REC_MARK, type, (uint8_t)(delta & 0xFF), (uint8_t)(delta >> 8) };
+    Serial.write(header, sizeof(header));
+}
+
+static void writeInt16(uint8_t* out, int16_t value) {
+    out[0] = (uint8_t)(value & 0xFF);
+    out[1] = (uint8_t)((uint16_t)value >> 8);
+}
+
+void Recorder::recordImu(const MPU6050* mpu) {
+    if (!active) return;
+    uint8_t payload[12];
+    writeInt16(payload + 0, mpu->getRawX());
+    writeInt16(payload + 2, mpu->getRawY());
+    writeInt16(payload + 4, mpu->getRawZ());
+    writeInt16(payload + 6, mpu->getGyroX());
+    writeInt16(payload + 8, mpu->getGyroY());
+    writeInt16(payload + 10, mpu->getGyroZ());
+    writeHeader(REC_IMU, millis());
+    Serial.write(payload, sizeof(payload));
+}
+
+void Recorder::recordButton(uint8_t level, unsigned long time) {
+    if (!active) return;
+    writeHeader(REC_BUTTON, time);
+    Serial.write(level);
+}
+
+void Recorder::recordSerial(uint8_t c) {
+    if (!active) return;
+    writeHeader(REC_SERIAL, millis());
+    Serial.write(c);
+}
@@ -0,0 +1,46 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * Streams a binary trace of everything that drives the modes
+ * (IMU samples, raw button edges, serial input) so a session can be
+ * replayed on the host by tools/replay.
+ *
+ * Every record goes out as REC_MARK, type, 16-bit ms delta to the
+ * previous record (little endian), then a fixed payload for the type.
+ * Text responses never contain REC_MARK, so the host can split them.
+ */
+
+#define REC_MARK 0xA5
+
+#define REC_IMU 0x01     // ax, ay, az, gx, gy, gz (int16 LE)
+#define REC_BUTTON 0x02  // pin level
+#define REC_SERIAL 0x03  // one received byte
+#define REC_GAP 0x04     // no payload, advances 65535 ms
+
+class MPU6050;
+
+class Recorder {
+private:
+    bool active;
+    unsigned long lastTime;
+
+    void writeHeader(uint8_t type, unsigned long time);
+
+public:
+    Recorder();
+    void start();
+    void stop();
+    bool isActive() const;
+
+    void recordImu(const MPU6050* mpu);
+    void recordButton(uint8_t level, unsigned long time);
+    void recordSerial(uint8_t c);
+};
+
+extern Recorder recorder;
+
+#endif
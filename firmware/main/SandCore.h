@@ -0,0 +1,256 @@
+#ifndef SAND_CORE_H
+#define SAND_CORE_H
+
+#include <stdint.h>
+#include <string.h>
+#include "utils.h"
+
+/**
+ * Grain simulation for the two hourglass chambers.
+ *
+ * Header-only and free of Arduino calls, so the host tools compile the
+ * very same code: given the same rows, random state and inputs, a host
+ * mirror reproduces every step bit for bit (see SandMirror.h).
+ *
+ * Works directly on the raw row bytes of both matrices (bit 7 = x 0).
+ * In raw coordinates the upper chamber (MATRIX_A) has its neck at (0,0)
+ * and the lower one (MATRIX_B) at (7,7), so both share one gravity
+ * vector and grains pass between (0,0) and (7,7).
+ */
+
+// Tuning. Part of the simulation, so here rather than in config.h: the
+// device and its mirror must agree on them
+#define SAND_MIN_GRAVITY 20     // Below this (~0.2 g, ~90 units per g) the sand stays put
+#define SAND_NECK_MIN_TILT 128  // Min cosine (x255) to the neck axis for grains to pass
+#define SAND_TIE_MARGIN 32      // Slide directions closer than this (x256) are picked at random
+
+class SandCore {
+private:
+    uint8_t* upper;
+    uint8_t* lower;
+
+    // Directions chosen for the current gravity vector (index into the 8-neighbourhood)
+    uint8_t fall;       // Closest to gravity
+    uint8_t slide;      // Preferred 45 degree neighbour
+    uint8_t slideAlt;   // The other one
+    bool slideTie;      // Both neighbours equally downhill - pick at random
+    bool settled;       // Gravity too weak in the display plane to move anything
+    int8_t flow;        // +1 upper -> lower, -1 lower -> upper, 0 no flow through the neck
+    uint16_t rng;       // xorshift16 state, never 0
+
+    // 8-neighbourhood, counter-clockwise starting at +x, packed two bits
+    // per direction (value + 1) instead of a table
+    static int8_t dirX(uint8_t d) { return (int8_t)((0x901AU >> (d * 2)) & 3) - 1; }
+    static int8_t dirY(uint8_t d) { return dirX((d + 6) & 7); }
+
+    static bool getGrain(const uint8_t* rows, int8_t x, int8_t y) {
+        return rows[y] & (0x80 >> x);
+    }
+
+    static void setGrain(uint8_t* rows, int8_t x, int8_t y, bool on) {
+        if (on) rows[y] |= (0x80 >> x);
+        else rows[y] &= ~(0x80 >> x);
+    }
+
+    static int32_t absolute(int32_t v) { return v < 0 ? -v : v; }
+
+    bool coinFlip() {
+        rng ^= rng << 7;
+        rng ^= rng >> 9;
+        rng ^= rng << 8;
+        return rng & 1;
+    }
+
+    bool tryMove(uint8_t* rows, uint8_t* moved, int8_t x, int8_t y, uint8_t dir) {
+        int8_t nx = x + dirX(dir);
+        int8_t ny = y + dirY(dir);
+        if (nx < 0 || nx > 7 || ny < 0 || ny > 7) return false;
+        if (getGrain(rows, nx, ny)) return false;
+
+        setGrain(rows, x, y, false);
+        setGrain(rows, nx, ny, true);
+        moved[ny] |= (0x80 >> nx);
+        return true;
+    }
+
+    bool stepChamber(uint8_t* rows) {
+        uint8_t moved[8] = {0};
+        bool somethingMoved = false;
+
+        // Visit the downhill end first so a whole column can flow in one step
+        int8_t fx = dirX(fall);
+        int8_t fy = dirY(fall);
+        int8_t y0 = (fy > 0) ? 7 : 0;
+        int8_t ys = (fy > 0) ? -1 : 1;
+        int8_t x0 = (fx > 0) ? 7 : 0;
+        int8_t xs = (fx > 0) ? -1 : 1;
+
+        for (int8_t j = 0, y = y0; j < 8; j++, y += ys) {
+            if (rows[y] == 0) continue;
+            for (int8_t i = 0, x = x0; i < 8; i++, x += xs) {
+                if (!getGrain(rows, x, y) || (moved[y] & (0x80 >> x))) continue;
+
+                if (tryMove(rows, moved, x, y, fall)) {
+                    somethingMoved = true;
+                    continue;
+                }
+                uint8_t first = slide;
+                uint8_t second = slideAlt;
+                if (slideTie && coinFlip()) {
+                    first = slideAlt;
+                    second = slide;
+                }
+                if (tryMove(rows, moved, x, y, first) || tryMove(rows, moved, x, y, second)) {
+                    somethingMoved = true;
+                }
+            }
+        }
+        return somethingMoved;
+    }
+
+public:
+    SandCore() {
+        upper = NULL;
+        lower = NULL;
+        fall = 5;
+        slide = 4;
+        slideAlt = 6;
+        slideTie = true;
+        settled = true;
+        flow = 0;
+        rng = 1;
+    }
+
+    void attach(uint8_t* upper, uint8_t* lower) {
+        this->upper = upper;
+        this->lower = lower;
+    }
+
+    // The random state decides slide ties; a mirror needs the same one
+    void seed(uint16_t state) { rng = state ? state : 1; }
+    uint16_t getSeed() const { return rng; }
+
+    // Gravity in raw matrix coordinates, about 90 units per g
+    void setGravity(int16_t gx, int16_t gy) {
+        // Cheap magnitude estimate: max + min/2 (within ~12%)
+        int16_t ax = absolute(gx);
+        int16_t ay = absolute(gy);
+        int16_t mag = (ax > ay) ? ax + ay / 2 : ay + ax / 2;
+
+        settled = mag < SAND_MIN_GRAVITY;
+        if (settled) {
+            flow = 0;
+            return;
+        }
+
+        // Projection onto each direction, diagonals scaled by 1/sqrt(2) (181/256)
+        int32_t proj[8];
+        for (uint8_t d = 0; d < 8; d++) {
+            int32_t p = (int32_t)gx * dirX(d) + (int32_t)gy * dirY(d);
+            proj[d] = (d & 1) ? p * 181 : p * 256;
+        }
+
+        fall = 0;
+        for (uint8_t d = 1; d < 8; d++) {
+            if (proj[d] > proj[fall]) fall = d;
+        }
+        uint8_t left = (fall + 1) & 7;
+        uint8_t right = (fall + 7) & 7;
+        slide = (proj[left] >= proj[right]) ? left : right;
+        slideAlt = (slide == left) ? right : left;
+        slideTie = absolute(proj[left] - proj[right]) < (int32_t)mag * SAND_TIE_MARGIN;
+
+        // Cosine between gravity and the neck axis (-1,-1) as -255..255
+        int32_t cosine = (proj[5] / mag) * 255 / 256;
+        if (cosine > 255) cosine = 255;
+        if (cosine < -255) cosine = -255;
+
+        if (cosine >= SAND_NECK_MIN_TILT) flow = 1;
+        else if (cosine <= -SAND_NECK_MIN_TILT) flow = -1;
+        else flow = 0;
+    }
+
+    /*
+     * The part of setGravity()'s outcome that step() and dropGrain()
+     * depend on, packed: fall, slide, tie, settled, flow. It changes far
+     * less often than the raw vector, so it is what a mirror is sent.
+     */
+    uint16_t getMotion() const {
+        return fall | (slide << 3) | (slideTie << 6) | (settled << 7) | ((uint16_t)(flow & 3) << 8);
+    }
+
+    void setMotion(uint16_t motion) {
+        fall = motion & 7;
+        slide = (motion >> 3) & 7;
+        slideAlt = (slide == ((fall + 1) & 7)) ? (fall + 7) & 7 : (fall + 1) & 7;
+        slideTie = (motion >> 6) & 1;
+        settled = (motion >> 7) & 1;
+        flow = (int8_t)((motion >> 8) & 3);
+        if (flow == 3) flow = -1;
+    }
+
+    // Move every grain at most one cell. Returns true if anything moved
+    bool step() {
+        if (settled || !upper || !lower) return false;
+        bool movedUpper = stepChamber(upper);
+        bool movedLower = stepChamber(lower);
+        return movedUpper || movedLower;
+    }
+
+    // Pass one grain through the neck in the flow direction
+    bool dropGrain() {
+        if (!upper || !lower) return false;
+        if (flow > 0 && getGrain(upper, 0, 0) && !getGrain(lower, 7, 7)) {
+            setGrain(upper, 0, 0, false);
+            setGrain(lower, 7, 7, true);
+            return true;
+        }
+        if (flow < 0 && getGrain(lower, 7, 7) && !getGrain(upper, 0, 0)) {
+            setGrain(lower, 7, 7, false);
+            setGrain(upper, 0, 0, true);
+            return true;
+        }
+        return false;
+    }
+
+    const uint8_t* getUpper() const { return upper; }
+    const uint8_t* getLower() const { return lower; }
+    int8_t getFlow() const { return flow; }
+
+    // CRC-8 over both chambers and the random state, for mirror checks
+    uint8_t checksum() const {
+        uint8_t state[2] = { (uint8_t)rng, (uint8_t)(rng >> 8) };
+        uint8_t crc = crc8(upper, 8);
+        crc = crc8(lower, 8, crc);
+        return crc8(state, 2, crc);
+    }
+
+    // Fill a chamber with grains settled against its neck
+    static void fill(uint8_t* rows, uint8_t count, bool neckAtOrigin) {
+        memset(rows, 0, 8);
+        // Diagonals outward from the neck, i.e. the shape of settled sand
+        for (uint8_t dist = 0; dist < 15 && count > 0; dist++) {
+            for (uint8_t y = 0; y < 8 && count > 0; y++) {
+                int8_t x = dist - y;
+                if (x < 0 || x > 7) continue;
+                if (neckAtOrigin) setGrain(rows, x, y, true);
+                else setGrain(rows, 7 - x, 7 - y, true);
+                count--;
+            }
+        }
+    }
+
+    static uint8_t count(const uint8_t* rows) {
+        uint8_t c = 0;
+        for (uint8_t y = 0; y < 8; y++) {
+            uint8_t v = rows[y];
+            while (v) {
+                v &= v - 1;
+                c++;
+            }
+        }
+        return c;
+    }
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include "SandMirror.h"
+#include "BinaryProtocol.h"
+#include "BinaryOpcodes.h"
+#include "TraceRing.h"
+
+SandMirror sandMirror;
+
+SandMirror::SandMirror() {
+    framer = NULL;
+    syncPending = false;
+    motion = 0;
+    sinceCheck = 0;
+    sent = 0;
+    syncs = 0;
+}
+
+void SandMirror::start(BinaryProtocol* binary) {
+    framer = binary;
+    syncPending = true;
+    sinceCheck = 0;
+    sent = 0;
+    syncs = 0;
+}
+
+void SandMirror::stop() {
+    framer = NULL;
+}
+
+bool SandMirror::isActive() const {
+    return framer != NULL;
+}
+
+void SandMirror::requestSync() {
+    syncPending = true;
+}
+
+bool SandMirror::emit(const uint8_t* record, uint8_t len) {
+    // COBS adds a code byte and the delimiter to opcode, status and CRC
+    if (Serial.availableForWrite() < len + 5) {
+        if (!syncPending) TRACE(TRACE_DROP, TRACE_DROP_SAND);
+        syncPending = true;
+        return false;
+    }
+    framer->send(BIN_OP_SAND_EVENT, BIN_OK, record, len);
+    sent++;
+    return true;
+}
+
+void SandMirror::noteMotion(uint16_t tick, const SandCore& sand) {
+    if (!framer || syncPending || sand.getMotion() == motion) return;
+    motion = sand.getMotion();
+    uint8_t record[5] = { SAND_MOTION, (uint8_t)tick, (uint8_t)(tick >> 8),
+                          (uint8_t)motion, (uint8_t)(motion >> 8) };
+    emit(record, sizeof(record));
+}
+
+void SandMirror::noteDrop(uint16_t tick) {
+    if (!framer || syncPending) return;
+    uint8_t record[3] = { SAND_DROP, (uint8_t)tick, (uint8_t)(tick >> 8) };
+    emit(record, sizeof(record));
+}
+
+void SandMirror::endTick(uint16_t tick, const SandCore& sand) {
+    if (!framer) return;
+    if (syncPending) {
+        uint8_t record[SAND_SYNC_PAYLOAD];
+        uint16_t seed = sand.getSeed();
+        motion = sand.getMotion();
+        record[0] = SAND_SYNC;
+        record[1] = (uint8_t)tick;
+        record[2] = (uint8_t)(tick >> 8);
+        record[3] = (uint8_t)seed;
+        record[4] = (uint8_t)(seed >> 8);
+        record[5] = (uint8_t)motion;
+        record[6] = (uint8_t)(motion >> 8);
+        memcpy(record + 7, sand.getUpper(), 8);
+        memcpy(record + 15, sand.getLower(), 8);
+        syncPending = false;
+        if (emit(record, sizeof(record))) syncs++;
+        sinceCheck = 0;
+        return;
+    }
+    if (++sinceCheck >= SAND_MIRROR_CHECK_TICKS) {
+        sinceCheck = 0;
+        uint8_t record[4] = { SAND_CHECK, (uint8_t)tick, (uint8_t)(tick >> 8), sand.checksum() };
+        emit(record, sizeof(record));
+    }
+}
+
+unsigned long SandMirror::getSent() const {
+    return sent;
+}
+
+unsigned long SandMirror::getSyncs() const {
+    return syncs;
+}
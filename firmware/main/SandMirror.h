@@ -0,0 +1,62 @@
+#ifndef SAND_MIRROR_H
+#define SAND_MIRROR_H
+
+#include <Arduino.h>
+#include "SandCore.h"
+#include "BinaryOpcodes.h"
+#include "config.h"
+
+/**
+ * Lockstep feed of the hourglass simulation for a host mirror.
+ *
+ * Rather than frames, the host is sent what SandCore's steps depend on
+ * and runs the same code on its side (tools/common/SandReplica.h). Each
+ * record is a BIN_OP_SAND_EVENT frame, little endian, tagged with the
+ * hourglass tick it belongs to. Within a tick the device applies the
+ * motion, steps once, then drops:
+ *   SYNC   kind u8, tick u16, seed u16, motion u16, A rows[8], B rows[8]
+ *          (the whole state after the tick)
+ *   MOTION kind u8, tick u16, motion u16 (SandCore::getMotion, before the step)
+ *   DROP   kind u8, tick u16 (dropGrain after the step)
+ *   CHECK  kind u8, tick u16, crc u8 (SandCore::checksum after the tick)
+ *
+ * A record that does not fit in the TX buffer would leave the mirror
+ * behind for good, so instead the feed goes quiet until a SYNC fits.
+ * Redraws that are not simulation steps (enter, reset, catch-up) are
+ * sent as a SYNC too; so is the first tick after start().
+ */
+
+class BinaryProtocol;
+
+class SandMirror {
+private:
+    BinaryProtocol* framer;     // NULL while stopped
+    bool syncPending;
+    uint16_t motion;            // Last one sent
+    uint8_t sinceCheck;
+    unsigned long sent;
+    unsigned long syncs;
+
+    bool emit(const uint8_t* record, uint8_t len);
+
+public:
+    SandMirror();
+    void start(BinaryProtocol* framer);
+    void stop();
+    bool isActive() const;
+
+    // State changed outside a step: send all of it after the next tick
+    void requestSync();
+
+    // From HourglassMode::update(), in this order within one tick
+    void noteMotion(uint16_t tick, const SandCore& sand);
+    void noteDrop(uint16_t tick);
+    void endTick(uint16_t tick, const SandCore& sand);
+
+    unsigned long getSent() const;
+    unsigned long getSyncs() const;
+};
+
+extern SandMirror sandMirror;
+
+#endif
@@ -1,25 +1,38 @@
 #include "SerialProtocol.h"
 #include "config.h"
+#include "Recorder.h"
+#include "DeviceApi.h"
+#include "EventBus.h"
+#include "ImuStream.h"
+#include "AnimationMode.h"
+#include "TimeSync.h"
+#include "JsonWriter.h"
+#include "TraceRing.h"
 
-// ===== Externals from main.ino =====
-extern void setMode(int mode);
-extern void setClockTime(int hours, int minutes);
-extern void setHourglassDuration(int hours, int minutes);
-extern void resetHourglass();
-extern void rollDice();
-extern void resetFlipCounter();
-extern int getCurrentMode();
-extern int getDiceValue();
-extern int getFlipCount();
-extern void setBrightness(int level);
-extern const char* getStatusJSON();
-extern const char* getOrientationJSON();
-extern const char* getDisplayJSON();
-// ==================================
+static int hexDigit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Parses pairs of hex digits, skipping spaces. Returns the byte count or -1
+static int parseHex(const char* text, uint8_t* out, int maxBytes) {
+    int n = 0;
+    while (*text) {
+        if (*text == ' ') { text++; continue; }
+        int hi = hexDigit(text[0]);
+        int lo = hi < 0 ? -1 : hexDigit(text[1]);
+        if (lo < 0 || n >= maxBytes) return -1;
+        out[n++] = (hi << 4) | lo;
+        text += 2;
+    }
+    return n;
+}
 
 SerialProtocol::SerialProtocol() {
     inputPos = 0;
     lastCommandTime = 0;
+    receivedAt = 0;
     memset(inputBuffer, 0, sizeof(inputBuffer));
 }
 
@@ -30,9 +43,21 @@ void SerialProtocol::init() {
 void SerialProtocol::update() {
     while (Serial.available() > 0) {
         char c = Serial.read();
+        recorder.recordSerial(c);
+
+        if (binary.isActive()) {
+            binary.feed((uint8_t)c);
+            continue;
+        }
+        if ((uint8_t)c == BIN_MAGIC) {
+            inputPos = 0;  // Drop any partial text command
+            binary.begin();
+            continue;
+        }
 
         if (c == '\n' || c == '\r') {
             if (inputPos > 0) {
+                receivedAt = millis();
                 inputBuffer[inputPos] = '\0';
                 processCommand(inputBuffer);
                 inputPos = 0;
@@ -48,10 +73,8 @@ void SerialProtocol::update() {
     }
 }
 
-void SerialProtocol::processCommand(const char* command) {
-    char cmd[32];  // Reduced from 48 - matches input buffer
-    strlcpy(cmd, command, sizeof(cmd));
-
+void SerialProtocol::processCommand(char* cmd) {
+    // Trim and uppercase in the input buffer itself, no second copy on the stack
     int len = strlen(cmd);
     while (len > 0 && cmd[len - 1] <= 32) cmd[--len] = '\0';
     while (len > 0 && cmd[0] <= 32) memmove(cmd, cmd + 1, len--);
@@ -59,6 +82,7 @@ void SerialProtocol::processCommand(const char* command) {
 
     if (len == 0) return;
 
+    noteHostActivity();
     parseCommand(cmd);
     lastCommandTime = millis();
 }
@@ -68,17 +92,58 @@ void SerialProtocol::parseCommand(const char* cmd) {
     int cmdLen = spacePtr ? (spacePtr - cmd) : strlen(cmd);
     const char* args = spacePtr ? (spacePtr + 1) : "";
 
-    #define CMD_MATCH(s) (cmdLen == strlen(s) && strncmp(cmd, s, cmdLen) == 0)
+    // Command names stay in flash; only the line being parsed is in SRAM
+    #define CMD_MATCH(s) (cmdLen == (int)sizeof(s) - 1 && strncmp_P(cmd, PSTR(s), cmdLen) == 0)
 
     // ===== STATUS & INFO COMMANDS =====
     if (CMD_MATCH("GET_STATUS")) {
-        sendJSON(getStatusJSON());
+        sendJSON(writeStatusJSON);
     }
     else if (CMD_MATCH("GET_ORIENTATION")) {
-        sendJSON(getOrientationJSON());
+        sendJSON(writeOrientationJSON);
     }
     else if (CMD_MATCH("GET_DISPLAY")) {
-        sendJSON(getDisplayJSON());
+        sendJSON(writeDisplayJSON);
+    }
+    else if (CMD_MATCH("GET_POWER")) {
+        sendJSON(writePowerJSON);
+    }
+    else if (CMD_MATCH("GET_CPU")) {
+        sendJSON(writeCpuJSON);
+    }
+    else if (CMD_MATCH("GET_MEM")) {
+        sendJSON(writeMemJSON);
+    }
+    else if (CMD_MATCH("GET_BOOT")) {
+        sendJSON(writeBootJSON);
+    }
+
+    else if (CMD_MATCH("STREAM_IMU")) {
+        int hz;
+        if (sscanf(args, "%d", &hz) != 1 || hz < 0 || hz > IMU_STREAM_MAX_HZ) {
+            sendError(F("Usage: STREAM_IMU HZ (0 stops)"));
+        } else if (hz == 0) {
+            imuStream.stop();
+            Serial.print(F("{\"sent\":"));
+            Serial.print(imuStream.getSent());
+            Serial.print(F(",\"dropped\":"));
+            Serial.print(imuStream.getDropped());
+            Serial.println(F("}"));
+        } else {
+            sendResponse(F("OK"));
+            imuStream.start(hz);
+        }
+    }
+
+    // ===== TRACE RECORDING =====
+    else if (CMD_MATCH("REC_START")) {
+        sendResponse(F("OK"));
+        Serial.flush();
+        recorder.start();
+    }
+    else if (CMD_MATCH("REC_STOP")) {
+        recorder.stop();
+        sendResponse(F("OK"));
     }
     
     // ===== MODE COMMANDS =====
@@ -88,9 +153,11 @@ void SerialProtocol::parseCommand(const char* cmd) {
         else if (!strcmp(args, "HOURGLASS")) mode = MODE_HOURGLASS;
         else if (!strcmp(args, "DICE")) mode = MODE_DICE;
         else if (!strcmp(args, "FLIPCOUNTER") || !strcmp(args, "FLIP")) mode = MODE_FLIPCOUNTER;
+        else if (!strcmp(args, "ANIMATION")) mode = MODE_ANIMATION;
+        else if (!strcmp(args, "STREAM")) mode = MODE_STREAM;
         else { sendError(F("Invalid mode")); return; }
 
-        setMode(mode);
+        eventBus.send(EVENT_COMMAND, CMD_SET_MODE, mode);
         sendResponse(F("OK"));
     }
     
@@ -99,7 +166,7 @@ void SerialProtocol::parseCommand(const char* cmd) {
         int hours, minutes;
         if (sscanf(args, "%d %d", &hours, &minutes) == 2) {
             if (hours >= 0 && hours <= 23 && minutes >= 0 && minutes <= 59) {
-                setClockTime(hours, minutes);
+                eventBus.send(EVENT_COMMAND, CMD_SET_TIME, hours * 60 + minutes);
                 sendResponse(F("OK"));
             } else {
                 sendError(F("Time out of range (HH: 0-23, MM: 0-59)"));
@@ -109,6 +176,47 @@ void SerialProtocol::parseCommand(const char* cmd) {
         }
     }
     
+    // ===== TIME SYNC =====
+    else if (CMD_MATCH("TSYNC")) {
+        unsigned int seq;
+        unsigned long hostSent;
+        if (sscanf(args, "%u %lu", &seq, &hostSent) != 2 || seq > 255 || hostSent >= TSYNC_DAY_MS) {
+            sendError(F("Usage: TSYNC SEQ HOST_MS"));
+            return;
+        }
+        unsigned long sentAt = millis();
+        timeSync.exchange(seq, hostSent, receivedAt, sentAt);
+        Serial.print(F("{\"seq\":"));
+        Serial.print(seq);
+        Serial.print(F(",\"rx\":"));
+        Serial.print(receivedAt);
+        Serial.print(F(",\"tx\":"));
+        Serial.print(sentAt);
+        Serial.println(F("}"));
+    }
+    else if (CMD_MATCH("TSYNC_FIN")) {
+        unsigned int seq;
+        unsigned long hostReceived;
+        int32_t step;
+        if (sscanf(args, "%u %lu", &seq, &hostReceived) != 2 || hostReceived >= TSYNC_DAY_MS) {
+            sendError(F("Usage: TSYNC_FIN SEQ HOST_MS"));
+        } else if (!timeSync.finish(seq, hostReceived, &step)) {
+            sendError(F("No open TSYNC"));
+        } else {
+            JsonWriter json(Serial);
+            json.beginObject();
+            json.field(F("step"), (long)step);
+            json.fixed(F("ppm"), timeSync.getRate() / 100, 1);
+            json.field(F("delay"), timeSync.getDelay());
+            json.field(F("samples"), timeSync.getSamples());
+            json.endObject();
+            Serial.println();
+        }
+    }
+    else if (CMD_MATCH("GET_TIME")) {
+        sendJSON(writeTimeJSON);
+    }
+
     // ===== HOURGLASS MODE COMMANDS =====
     else if (CMD_MATCH("SET_HG")) {
         int hours, minutes;
@@ -117,7 +225,7 @@ void SerialProtocol::parseCommand(const char* cmd) {
                 if (hours == 0 && minutes == 0) {
                     sendError(F("Duration must be greater than 0"));
                 } else {
-                    setHourglassDuration(hours, minutes);
+                    eventBus.send(EVENT_COMMAND, CMD_SET_HG, hours * 60 + minutes);
                     sendResponse(F("OK"));
                 }
             } else {
@@ -127,14 +235,34 @@ void SerialProtocol::parseCommand(const char* cmd) {
             sendError(F("Usage: SET_HG HH MM"));
         }
     }
+    else if (CMD_MATCH("HG_START_AT")) {
+        unsigned long at;
+        if (sscanf(args, "%lu", &at) != 1 || at >= TSYNC_DAY_MS) {
+            sendError(F("Usage: HG_START_AT HOST_MS"));
+        } else {
+            eventBus.send(EVENT_COMMAND, CMD_HG_START_AT, at);
+            sendResponse(F("OK"));
+        }
+    }
     else if (CMD_MATCH("RESET_HG")) {
-        resetHourglass();
+        eventBus.send(EVENT_COMMAND, CMD_RESET_HG);
+        sendResponse(F("OK"));
+    }
+    else if (CMD_MATCH("HG_PAUSE")) {
+        eventBus.send(EVENT_COMMAND, CMD_HG_PAUSE);
+        sendResponse(F("OK"));
+    }
+    else if (CMD_MATCH("HG_RESUME")) {
+        eventBus.send(EVENT_COMMAND, CMD_HG_RESUME);
         sendResponse(F("OK"));
     }
+    else if (CMD_MATCH("GET_HG")) {
+        sendJSON(writeHourglassJSON);
+    }
     
     // ===== DICE MODE COMMANDS =====
     else if (CMD_MATCH("ROLL_DICE")) {
-        rollDice();
+        eventBus.send(EVENT_COMMAND, CMD_ROLL_DICE);
         Serial.print(F("{\"diceValue\":"));
         Serial.print(getDiceValue());
         Serial.println(F("}"));
@@ -147,16 +275,93 @@ void SerialProtocol::parseCommand(const char* cmd) {
         Serial.println(F("}"));
     }
     else if (CMD_MATCH("RESET_FLIP")) {
-        resetFlipCounter();
+        eventBus.send(EVENT_COMMAND, CMD_RESET_FLIP);
         sendResponse(F("OK"));
     }
     
+    // ===== ANIMATION MODE COMMANDS =====
+    else if (CMD_MATCH("ANIM_INFO")) {
+        Serial.print(F("{\"length\":"));
+        Serial.print(getAnimationLength());
+        Serial.print(F(",\"state\":\""));
+        switch (getAnimationState()) {
+            case ANIM_RUNNING: Serial.print(F("running")); break;
+            case ANIM_WAITING: Serial.print(F("waiting")); break;
+            case ANIM_HALTED: Serial.print(F("halted")); break;
+            case ANIM_FAULT: Serial.print(F("fault")); break;
+            default: Serial.print(F("none")); break;
+        }
+        Serial.print(F("\",\"pc\":"));
+        Serial.print(getAnimationPc());
+        Serial.println(F("}"));
+    }
+
+    // ===== HOST FRAME STREAM =====
+    else if (CMD_MATCH("PUSH_FRAME") || CMD_MATCH("PUSH_DELTA")) {
+        uint8_t data[16];
+        int fill;
+        if (CMD_MATCH("PUSH_FRAME")) {
+            if (parseHex(args, data, 16) != 16) { sendError(F("Usage: PUSH_FRAME <32 hex digits>")); return; }
+            fill = pushFrame(data);
+        } else {
+            // Three digits per change: row (0-F), then the row byte
+            int pairs = 0;
+            const char* p = args;
+            while (*p) {
+                if (*p == ' ') { p++; continue; }
+                int row = hexDigit(p[0]);
+                int hi = row < 0 ? -1 : hexDigit(p[1]);
+                int lo = hi < 0 ? -1 : hexDigit(p[2]);
+                if (lo < 0 || pairs >= 8) {
+                    sendError(F("Usage: PUSH_DELTA <row hex><byte hex> ..."));
+                    return;
+                }
+                data[pairs * 2] = row;
+                data[pairs * 2 + 1] = (hi << 4) | lo;
+                pairs++;
+                p += 3;
+            }
+            fill = pushFrameDelta(data, pairs);
+        }
+        if (fill < 0) {
+            sendError(F("Queue full"));
+            return;
+        }
+        Serial.print(F("{\"fill\":"));
+        Serial.print(fill);
+        Serial.print(F(",\"free\":"));
+        Serial.print(STREAM_QUEUE_DEPTH - fill);
+        Serial.println(F("}"));
+    }
+    else if (CMD_MATCH("STREAM_FPS")) {
+        int fps;
+        if (sscanf(args, "%d", &fps) == 1 && fps >= 1 && fps <= STREAM_MAX_FPS) {
+            setStreamFps(fps);
+            sendResponse(F("OK"));
+        } else {
+            sendError(F("FPS out of range (1-50)"));
+        }
+    }
+    else if (CMD_MATCH("STREAM_INFO")) {
+        Serial.print(F("{\"fill\":"));
+        Serial.print(getStreamFill());
+        Serial.print(F(",\"depth\":"));
+        Serial.print(STREAM_QUEUE_DEPTH);
+        Serial.print(F(",\"fps\":"));
+        Serial.print(getStreamFps());
+        Serial.print(F(",\"played\":"));
+        Serial.print(getStreamPlayed());
+        Serial.print(F(",\"underruns\":"));
+        Serial.print(getStreamUnderruns());
+        Serial.println(F("}"));
+    }
+
     // ===== DISPLAY COMMANDS =====
     else if (CMD_MATCH("SET_BRIGHTNESS")) {
         int level;
         if (args[0] != '\0' && sscanf(args, "%d", &level) == 1) {
             if (level >= 0 && level <= 15) {
-                setBrightness(level);
+                eventBus.send(EVENT_COMMAND, CMD_SET_BRIGHTNESS, level);
                 sendResponse(F("OK"));
             } else {
                 sendError(F("Brightness must be 0-15"));
@@ -165,6 +370,15 @@ void SerialProtocol::parseCommand(const char* cmd) {
             sendError(F("Brightness must be 0-15"));
         }
     }
+    else if (CMD_MATCH("SET_SCRUB")) {
+        long ms;
+        if (sscanf(args, "%ld", &ms) == 1 && ms >= 0 && ms <= DISPLAY_SCRUB_MAX_MS) {
+            eventBus.send(EVENT_COMMAND, CMD_SET_SCRUB, ms);
+            sendResponse(F("OK"));
+        } else {
+            sendError(F("Usage: SET_SCRUB MS (0-60000, 0 stops)"));
+        }
+    }
     
     // ===== UNKNOWN COMMAND =====
     else {
@@ -184,16 +398,20 @@ void SerialProtocol::sendResponse(const __FlashStringHelper* response) {
     Serial.println(response);
 }
 
-void SerialProtocol::sendJSON(const char* json) {
-    Serial.println(json);
+void SerialProtocol::sendJSON(void (*write)(JsonWriter& json)) {
+    JsonWriter json(Serial);
+    write(json);
+    Serial.println();
 }
 
 void SerialProtocol::sendError(const char* message) {
+    TRACE(TRACE_ERROR, 0);
     Serial.print(F("ERR "));
     Serial.println(message);
 }
 
 void SerialProtocol::sendError(const __FlashStringHelper* message) {
+    TRACE(TRACE_ERROR, 0);
     Serial.print(F("ERR "));
     Serial.println(message);
 }
@@ -2,24 +2,29 @@
 #define SERIAL_PROTOCOL_H
 
 #include <Arduino.h>
+#include "BinaryProtocol.h"
+#include "JsonWriter.h"
 
 class SerialProtocol {
 private:
-    char inputBuffer[32];  // Reduced from 48 - longest command is ~25 chars
+    char inputBuffer[48];  // PUSH_FRAME with 32 hex digits is the longest command
     uint8_t inputPos;
     unsigned long lastCommandTime;
+    unsigned long receivedAt;  // millis() when the current command's line ended
+    BinaryProtocol binary;  // Takes over the link after BIN_MAGIC
 
 public:
     SerialProtocol();
     void init();
     void update();
-    void processCommand(const char* command);
+    void processCommand(char* command);  // Normalised in place
 
     // --- OUTPUT (SRAM + FLASH safe) ---
     void sendResponse(const char* response);
     void sendResponse(const __FlashStringHelper* response);
 
-    void sendJSON(const char* json);
+    // Streams the object straight to Serial and ends the line
+    void sendJSON(void (*write)(JsonWriter& json));
 
     void sendError(const char* message);
     void sendError(const __FlashStringHelper* message);
@@ -0,0 +1,72 @@
+#include "Settings.h"
+#include "utils.h"
+#include <avr/eeprom.h>
+
+Settings::Settings() {
+    memset(&saved, 0, sizeof(saved));
+    sequence = 0;
+    nextSlot = 0;
+    dirty = false;
+    dirtySince = 0;
+    writes = 0;
+}
+
+uint8_t Settings::slotCrc(const Slot& slot) {
+    return crc8((const uint8_t*)&slot, sizeof(Slot) - 1);
+}
+
+Settings::Slot* Settings::slotAddress(uint8_t index) {
+    return (Slot*)(SETTINGS_EEPROM_BASE + index * sizeof(Slot));
+}
+
+bool Settings::load(SettingsRecord* out) {
+    bool found = false;
+    Slot slot;
+
+    for (uint8_t i = 0; i < SETTINGS_SLOTS; i++) {
+        eeprom_read_block(&slot, slotAddress(i), sizeof(Slot));
+        if (slot.version != SETTINGS_VERSION || slot.crc != slotCrc(slot)) continue;
+
+        // Sequence numbers wrap, compare by signed distance
+        if (!found || (int16_t)(slot.sequence - sequence) > 0) {
+            found = true;
+            sequence = slot.sequence;
+            nextSlot = (i + 1) % SETTINGS_SLOTS;
+            saved = slot.data;
+        }
+    }
+
+    if (found) *out = saved;
+    return found;
+}
+
+void Settings::update(const SettingsRecord& current) {
+    if (memcmp(&current, &saved, sizeof(SettingsRecord)) == 0) {
+        dirty = false;  // Changed back before the write was due
+        return;
+    }
+    if (!dirty) {
+        dirty = true;
+        dirtySince = millis();
+    } else if (millis() - dirtySince >= SETTINGS_WRITE_DELAY_MS) {
+        flush(current);
+    }
+}
+
+void Settings::flush(const SettingsRecord& current) {
+    Slot slot;
+    slot.sequence = ++sequence;
+    slot.version = SETTINGS_VERSION;
+    slot.data = current;
+    slot.crc = slotCrc(slot);
+
+    eeprom_update_block(&slot, slotAddress(nextSlot), sizeof(Slot));
+    nextSlot = (nextSlot + 1) % SETTINGS_SLOTS;
+    saved = current;
+    dirty = false;
+    writes++;
+}
+
+uint16_t Settings::getWriteCount() const {
+    return writes;
+}
@@ -0,0 +1,61 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * Persistent device state.
+ * Bump SETTINGS_VERSION whenever the layout changes - old records are
+ * then ignored and defaults are used.
+ */
+struct SettingsRecord {
+    uint8_t brightness;
+    uint8_t mode;
+    uint8_t hourglassHours;
+    uint8_t hourglassMinutes;
+    uint16_t flipCount;
+} __attribute__((packed));
+
+/**
+ * Wear-levelled EEPROM store.
+ * Each save goes to the next slot of a ring, tagged with a sequence
+ * number and CRC-8; the valid slot with the newest sequence wins on
+ * load. Changes are coalesced and written SETTINGS_WRITE_DELAY_MS after
+ * the first one, so bursts (e.g. flip counting) cost a single write.
+ */
+class Settings {
+private:
+    struct Slot {
+        uint16_t sequence;
+        uint8_t version;
+        SettingsRecord data;
+        uint8_t crc;
+    } __attribute__((packed));
+
+    SettingsRecord saved;      // Last record written or loaded
+    uint16_t sequence;
+    uint8_t nextSlot;
+    bool dirty;
+    unsigned long dirtySince;
+    uint16_t writes;
+
+    static uint8_t slotCrc(const Slot& slot);
+    static Slot* slotAddress(uint8_t index);
+
+public:
+    Settings();
+
+    // Returns false if no valid record was found
+    bool load(SettingsRecord* out);
+
+    // Compare with the last saved record and schedule a write if it changed
+    void update(const SettingsRecord& current);
+
+    // Write a pending change right away
+    void flush(const SettingsRecord& current);
+
+    uint16_t getWriteCount() const;
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include "StreamMode.h"
+#include "TraceRing.h"
+
+StreamMode::StreamMode(LedControl* lc) {
+    this->lc = lc;
+    memset(frames, 0, sizeof(frames));
+    head = 0;
+    count = 0;
+    fps = STREAM_DEFAULT_FPS;
+    playing = false;
+    nextFrameAt = 0;
+    played = 0;
+    underruns = 0;
+}
+
+void StreamMode::init() {
+    head = 0;
+    count = 0;
+    playing = false;
+}
+
+void StreamMode::enter() {
+    show(lastPushed());
+}
+
+void StreamMode::exit() {
+    playing = false;
+}
+
+void StreamMode::update() {
+    unsigned long now = millis();
+
+    if (!playing) {
+        if (count < STREAM_PREFILL) return;
+        playing = true;
+        nextFrameAt = now;
+    }
+    if ((long)(now - nextFrameAt) < 0) return;
+
+    if (count == 0) {
+        // Hold the last frame and rebuild the cushion
+        playing = false;
+        underruns++;
+        TRACE(TRACE_DROP, TRACE_DROP_STREAM);
+        return;
+    }
+
+    show(frames[head]);
+    head = (head + 1) % STREAM_QUEUE_DEPTH;
+    count--;
+    played++;
+
+    // Advance from the schedule, not from now, so the rate doesn't drift
+    nextFrameAt += 1000 / fps;
+    if ((long)(now - nextFrameAt) > 1000 / fps) nextFrameAt = now;
+}
+
+bool StreamMode::isAnimating() const {
+    return playing || count > 0;
+}
+
+byte* StreamMode::lastPushed() {
+    // Played slots keep their data until overwritten, so this stays valid
+    return frames[(head + count + STREAM_QUEUE_DEPTH - 1) % STREAM_QUEUE_DEPTH];
+}
+
+void StreamMode::show(const byte* frame) {
+    memcpy(lc->getBuffer(MATRIX_A), frame, 8);
+    memcpy(lc->getBuffer(MATRIX_B), frame + 8, 8);
+}
+
+bool StreamMode::push(const byte* frame) {
+    if (count >= STREAM_QUEUE_DEPTH) return false;
+    memcpy(frames[(head + count) % STREAM_QUEUE_DEPTH], frame, 16);
+    count++;
+    return true;
+}
+
+bool StreamMode::pushDelta(const byte* pairs, uint8_t pairCount) {
+    if (count >= STREAM_QUEUE_DEPTH) return false;
+    byte* base = lastPushed();
+    byte* slot = frames[(head + count) % STREAM_QUEUE_DEPTH];
+    memcpy(slot, base, 16);
+    for (uint8_t i = 0; i < pairCount; i++) {
+        slot[pairs[i * 2] & 15] = pairs[i * 2 + 1];
+    }
+    count++;
+    return true;
+}
+
+void StreamMode::setFps(uint8_t fps) {
+    this->fps = constrain(fps, 1, STREAM_MAX_FPS);
+}
+
+uint8_t StreamMode::getFps() const {
+    return fps;
+}
+
+uint8_t StreamMode::getFill() const {
+    return count;
+}
+
+uint16_t StreamMode::getPlayed() const {
+    return played;
+}
+
+uint16_t StreamMode::getUnderruns() const {
+    return underruns;
+}
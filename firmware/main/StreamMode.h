@@ -0,0 +1,51 @@
+#ifndef STREAM_MODE_H
+#define STREAM_MODE_H
+
+#include "LedControl.h"
+#include "config.h"
+
+/**
+ * Plays frames pushed by the host from a small ring at a device-timed
+ * rate, so USB and host jitter don't show on the display.
+ *
+ * A frame is 16 row bytes, matrix A rows 0-7 then matrix B rows 0-7
+ * (the GET_DISPLAY layout). Delta pushes patch (row, value) pairs into a
+ * copy of the last frame pushed. Playback starts once STREAM_PREFILL
+ * frames are queued; if the ring runs dry the last frame stays up and
+ * playback waits for the prefill again (counted as an underrun).
+ */
+class StreamMode {
+private:
+    LedControl* lc;
+    byte frames[STREAM_QUEUE_DEPTH][16];
+    uint8_t head;               // Next frame to play
+    uint8_t count;
+    uint8_t fps;
+    bool playing;
+    unsigned long nextFrameAt;
+    uint16_t played;
+    uint16_t underruns;
+
+    byte* lastPushed();
+    void show(const byte* frame);
+
+public:
+    StreamMode(LedControl* lc);
+    void init();
+    void enter();
+    void exit();
+    void update();
+    bool isAnimating() const;
+
+    // Return false when the ring is full
+    bool push(const byte* frame);
+    bool pushDelta(const byte* pairs, uint8_t pairCount);
+
+    void setFps(uint8_t fps);
+    uint8_t getFps() const;
+    uint8_t getFill() const;
+    uint16_t getPlayed() const;
+    uint16_t getUnderruns() const;
+};
+
+#endif
@@ -0,0 +1,183 @@
+#include "TimeSync.h"
+
+TimeSync timeSync;
+
+// Signed difference of two times of day, within half a day
+static int32_t dayDiff(uint32_t a, uint32_t b) {
+    int32_t d = (int32_t)(a - b) % (int32_t)TSYNC_DAY_MS;
+    if (d > (int32_t)(TSYNC_DAY_MS / 2)) d -= TSYNC_DAY_MS;
+    if (d <= -(int32_t)(TSYNC_DAY_MS / 2)) d += TSYNC_DAY_MS;
+    return d;
+}
+
+// A time of day off by less than a day either way, back into the day
+static uint32_t dayWrap(int32_t ms) {
+    if (ms < 0) ms += TSYNC_DAY_MS;
+    else if (ms >= (int32_t)TSYNC_DAY_MS) ms -= TSYNC_DAY_MS;
+    return ms;
+}
+
+// ms * ppb / 10^9, truncated like the division, without pulling in
+// libgcc's 64-bit divide: long multiplication in base 1000 keeps every
+// partial product in 32 bits, and only the digits from 10^9 up are kept
+static int32_t scaleByPpb(uint32_t ms, int32_t ppb) {
+    uint32_t r = ppb < 0 ? -(uint32_t)ppb : ppb;
+    uint16_t e[4] = { (uint16_t)(ms % 1000), (uint16_t)(ms / 1000 % 1000),
+                      (uint16_t)(ms / 1000000 % 1000), (uint16_t)(ms / 1000000000) };
+    uint16_t p[3] = { (uint16_t)(r % 1000), (uint16_t)(r / 1000 % 1000), (uint16_t)(r / 1000000) };
+    uint32_t carry = 0, result = 0, scale = 1;
+    for (uint8_t k = 0; k < 7; k++) {
+        uint32_t sum = carry;
+        for (uint8_t i = 0; i < 4; i++) {
+            if (k >= i && k - i < 3) sum += (uint32_t)e[i] * p[k - i];
+        }
+        if (k >= 3) {
+            result += sum % 1000 * scale;
+            scale *= 1000;
+        }
+        carry = sum / 1000;
+    }
+    return ppb < 0 ? -(int32_t)result : (int32_t)result;
+}
+
+TimeSync::TimeSync() {
+    count = 0;
+    newest = 0;
+    pending = false;
+    pendingSeq = 0;
+    t1 = t2 = t3 = 0;
+    baseLocal = 0;
+    baseHost = 12UL * 3600000UL;  // Noon until set, as the clock always showed
+    rate = 0;
+    synced = false;
+    lastDelay = 0;
+}
+
+void TimeSync::exchange(uint8_t seq, uint32_t hostSent, uint32_t localReceived, uint32_t localSent) {
+    pending = true;
+    pendingSeq = seq;
+    t1 = hostSent;
+    t2 = localReceived;
+    t3 = localSent;
+}
+
+bool TimeSync::finish(uint8_t seq, uint32_t hostReceived, int32_t* step) {
+    if (!pending || seq != pendingSeq) return false;
+    pending = false;
+
+    // Round trip less the time the device held the request
+    int32_t roundTrip = dayDiff(hostReceived, t1);
+    int32_t delay = roundTrip - (int32_t)(t3 - t2);
+    if (delay < 0) delay = 0;
+    uint32_t local = t2 + (t3 - t2) / 2;
+    uint32_t host = dayWrap((int32_t)t1 + roundTrip / 2);
+
+    uint32_t before = timeOfDay();
+    addSample(local, host, delay);
+    fit();
+    synced = true;
+    lastDelay = delay;
+    *step = dayDiff(timeOfDay(), before);
+    return true;
+}
+
+void TimeSync::addSample(uint32_t local, uint32_t host, uint16_t delay) {
+    uint8_t d = delay > 255 ? 255 : delay;
+    if (count > 0 && local - samples[newest].local < TSYNC_SAMPLE_SPACING_MS) {
+        // Same burst: keep whichever exchange was fastest
+        if (d <= samples[newest].delay) {
+            samples[newest].local = local;
+            samples[newest].host = host;
+            samples[newest].delay = d;
+        }
+        return;
+    }
+    if (count > 0) newest = (newest + 1) % TSYNC_SAMPLES;
+    samples[newest].local = local;
+    samples[newest].host = host;
+    samples[newest].delay = d;
+    if (count < TSYNC_SAMPLES) count++;
+}
+
+void TimeSync::fit() {
+    uint8_t fastest = 255;
+    for (uint8_t i = 0; i < count; i++) {
+        if (samples[i].delay < fastest) fastest = samples[i].delay;
+    }
+
+    // Relative to the newest sample: x = local ms, y = how far the host
+    // clock got ahead of millis() since then
+    const Sample& ref = samples[newest];
+    int32_t xs[TSYNC_SAMPLES];
+    int32_t ys[TSYNC_SAMPLES];
+    uint8_t n = 0;
+    int32_t span = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        if (samples[i].delay > fastest + TSYNC_DELAY_MARGIN_MS) continue;
+        xs[n] = (int32_t)(samples[i].local - ref.local);
+        ys[n] = dayDiff(dayWrap((int32_t)samples[i].host - xs[n] % (int32_t)TSYNC_DAY_MS), ref.host);
+        if (-xs[n] > span) span = -xs[n];
+        n++;
+    }
+
+    float mx = 0, my = 0;
+    for (uint8_t i = 0; i < n; i++) {
+        mx += xs[i];
+        my += ys[i];
+    }
+    mx /= n;
+    my /= n;
+
+    if (n >= 2 && span >= (int32_t)TSYNC_MIN_SPAN_MS) {
+        float sxx = 0, sxy = 0;
+        for (uint8_t i = 0; i < n; i++) {
+            sxx += (xs[i] - mx) * (xs[i] - mx);
+            sxy += (xs[i] - mx) * (ys[i] - my);
+        }
+        float ppb = sxy / sxx * 1e9;
+        rate = constrain((long)ppb, -TSYNC_MAX_PPM * 1000L, TSYNC_MAX_PPM * 1000L);
+    }
+
+    // The line through the samples' mean, at the newest sample
+    float offset = my - mx * (rate / 1e9);
+    baseLocal = ref.local;
+    baseHost = dayWrap((int32_t)ref.host + (long)(offset + (offset < 0 ? -0.5 : 0.5)));
+}
+
+void TimeSync::setTimeOfDay(uint32_t ms) {
+    baseLocal = millis();
+    baseHost = ms % TSYNC_DAY_MS;
+    count = 0;
+    newest = 0;
+    pending = false;
+    synced = false;
+}
+
+uint32_t TimeSync::timeOfDay() const {
+    uint32_t elapsed = millis() - baseLocal;
+    uint32_t ms = baseHost + elapsed % TSYNC_DAY_MS;  // Under two days
+    if (ms >= TSYNC_DAY_MS) ms -= TSYNC_DAY_MS;
+    return dayWrap((int32_t)ms + scaleByPpb(elapsed, rate) % (int32_t)TSYNC_DAY_MS);
+}
+
+long TimeSync::untilHostTime(uint32_t hostMs) const {
+    int32_t ahead = dayDiff(hostMs, timeOfDay());
+    // Host ms to local ms
+    return ahead < 0 ? ahead + scaleByPpb(-ahead, rate) : ahead - scaleByPpb(ahead, rate);
+}
+
+bool TimeSync::isSynced() const {
+    return synced;
+}
+
+int32_t TimeSync::getRate() const {
+    return rate;
+}
+
+uint16_t TimeSync::getDelay() const {
+    return lastDelay;
+}
+
+uint8_t TimeSync::getSamples() const {
+    return count;
+}
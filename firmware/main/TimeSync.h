@@ -0,0 +1,81 @@
+#ifndef TIME_SYNC_H
+#define TIME_SYNC_H
+
+#include <Arduino.h>
+#include "config.h"
+
+/**
+ * Time of day disciplined by the host, NTP style.
+ *
+ * Each exchange is two requests. TSYNC carries the host's send time t1;
+ * the device answers with its receive and transmit times t2 and t3
+ * (millis). TSYNC_FIN then carries the host's receive time t4, and the
+ * exchange becomes a sample: at local time (t2 + t3) / 2 the host clock
+ * read (t1 + t4) / 2, give or take half the round trip
+ * (t4 - t1) - (t3 - t2). The host takes the time the frames spend on
+ * the wire off t1 and t4, so only the USB latency is left in the delay.
+ *
+ * Samples slower than the fastest one by more than TSYNC_DELAY_MARGIN_MS
+ * are left out. A line through the rest gives the offset and, once they
+ * span TSYNC_MIN_SPAN_MS, the resonator's frequency error, which keeps
+ * the clock on time between syncs.
+ *
+ * Host times are ms since midnight and wrap at TSYNC_DAY_MS.
+ */
+
+#define TSYNC_DAY_MS 86400000UL
+
+class TimeSync {
+private:
+    struct Sample {
+        uint32_t local;  // millis() at the middle of the exchange
+        uint32_t host;   // Host time of day at the same moment
+        uint8_t delay;   // Round trip, ms (capped at 255)
+    };
+
+    Sample samples[TSYNC_SAMPLES];
+    uint8_t count;
+    uint8_t newest;
+
+    // The exchange waiting for its TSYNC_FIN
+    bool pending;
+    uint8_t pendingSeq;
+    uint32_t t1, t2, t3;
+
+    // Host time of day = baseHost + elapsed + elapsed * rate / 10^9,
+    // elapsed being millis() - baseLocal
+    uint32_t baseLocal;
+    uint32_t baseHost;
+    int32_t rate;  // Parts per billion the host clock runs ahead of millis()
+    bool synced;
+    uint16_t lastDelay;
+
+    void addSample(uint32_t local, uint32_t host, uint16_t delay);
+    void fit();
+
+public:
+    TimeSync();
+
+    // TSYNC: stamps taken by the protocol when the request's last byte
+    // was read and right before the answer is written
+    void exchange(uint8_t seq, uint32_t hostSent, uint32_t localReceived, uint32_t localSent);
+    // TSYNC_FIN: completes the exchange and stores the step it made to
+    // the clock in ms. False if seq doesn't match the open exchange.
+    bool finish(uint8_t seq, uint32_t hostReceived, int32_t* step);
+
+    // SET_TIME: a manual setting drops the samples but keeps the rate
+    void setTimeOfDay(uint32_t ms);
+    uint32_t timeOfDay() const;
+    // Local ms from now until the host clock reads hostMs, negative if
+    // that was in the last 12 hours
+    long untilHostTime(uint32_t hostMs) const;
+
+    bool isSynced() const;
+    int32_t getRate() const;  // ppb
+    uint16_t getDelay() const;
+    uint8_t getSamples() const;
+};
+
+extern TimeSync timeSync;
+
+#endif
@@ -0,0 +1,72 @@
+#include "TraceRing.h"
+
+#if TRACE_ENABLED
+
+TraceRing traceRing;
+
+static void writeU16(uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)(value & 0xFF);
+    out[1] = (uint8_t)(value >> 8);
+}
+
+static void writeU32(uint8_t* out, uint32_t value) {
+    writeU16(out, (uint16_t)(value & 0xFFFF));
+    writeU16(out + 2, (uint16_t)(value >> 16));
+}
+
+TraceRing::TraceRing() {
+    head = 0;
+    written = 0;
+    lastTime = 0;
+}
+
+void TraceRing::push(uint16_t delta, uint8_t id, uint8_t arg) {
+    records[head].delta = delta;
+    records[head].id = id;
+    records[head].arg = arg;
+    head = (head + 1 < TRACE_DEPTH) ? head + 1 : 0;
+    written++;
+}
+
+void TraceRing::record(uint8_t id, uint8_t arg) {
+    unsigned long now = millis();
+    unsigned long delta = now - lastTime;
+    lastTime = now;
+
+    if (delta > 0xFFFF) {
+        unsigned long seconds = delta / 1000;
+        push(seconds > 0xFFFF ? 0xFFFF : seconds, TRACE_GAP, 0);
+        delta %= 1000;
+    }
+    push(delta, id, arg);
+}
+
+uint8_t TraceRing::dump(uint16_t from, uint8_t* out) {
+    uint8_t kept = written < TRACE_DEPTH ? written : TRACE_DEPTH;
+    uint16_t oldest = written - kept;
+    // Numbers wrap, so compare distances back from the newest
+    if ((uint16_t)(written - from) > kept) from = oldest;
+
+    uint8_t count = written - from;
+    if (count > TRACE_DUMP_RECORDS) count = TRACE_DUMP_RECORDS;
+
+    writeU16(out, from);
+    writeU16(out + 2, written);
+    writeU32(out + 4, millis());
+    writeU32(out + 8, millis() - lastTime);
+
+    // Slot of record number from: head is where number written would go
+    uint8_t back = written - from;
+    uint8_t slot = (head >= back) ? head - back : head + TRACE_DEPTH - back;
+    uint8_t* p = out + 12;
+    for (uint8_t i = 0; i < count; i++) {
+        writeU16(p, records[slot].delta);
+        p[2] = records[slot].id;
+        p[3] = records[slot].arg;
+        p += 4;
+        slot = (slot + 1 < TRACE_DEPTH) ? slot + 1 : 0;
+    }
+    return 12 + count * 4;
+}
+
+#endif
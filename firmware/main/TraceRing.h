@@ -0,0 +1,59 @@
+#ifndef TRACE_RING_H
+#define TRACE_RING_H
+
+#include <Arduino.h>
+#include "BinaryOpcodes.h"
+#include "config.h"
+
+/**
+ * Post-mortem event trace: the last TRACE_DEPTH things that happened,
+ * kept in SRAM and read back with DUMP_TRACE.
+ *
+ * Each record is 4 bytes - ms since the previous record u16, TRACE_* id,
+ * argument - so no clock is stored and the host rebuilds the timeline
+ * backwards from the age of the newest record. A silence longer than
+ * the u16 allows goes in as a TRACE_GAP record counting whole seconds.
+ *
+ * Records are numbered from boot (u16, wrapping); a dump names the first
+ * one it wants and gets the oldest still kept if that one is gone.
+ * Trace points call TRACE() from loop() code only, never from an ISR,
+ * and cost nothing with TRACE_ENABLED 0.
+ */
+
+#if TRACE_ENABLED
+
+struct TraceRecord {
+    uint16_t delta;  // ms since the previous record (seconds for TRACE_GAP)
+    uint8_t id;
+    uint8_t arg;
+};
+
+class TraceRing {
+private:
+    TraceRecord records[TRACE_DEPTH];
+    uint8_t head;            // Slot the next record goes into
+    uint16_t written;        // Records since boot, the next one's number
+    unsigned long lastTime;  // millis() of the newest record
+
+    void push(uint16_t delta, uint8_t id, uint8_t arg);
+
+public:
+    TraceRing();
+    void record(uint8_t id, uint8_t arg);
+
+    // Fills out with the DUMP_TRACE response for up to TRACE_DUMP_RECORDS
+    // records from number from onwards and returns its length
+    uint8_t dump(uint16_t from, uint8_t* out);
+};
+
+extern TraceRing traceRing;
+
+#define TRACE(id, arg) traceRing.record((id), (arg))
+
+#else
+
+#define TRACE(id, arg) ((void)0)
+
+#endif
+
+#endif
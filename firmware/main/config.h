@@ -42,6 +42,15 @@
 #define MATRIX_B 0
 #define DISPLAY_INTENSITY 8
 #define ROTATION_OFFSET 90
+#define MODE_TRANSITION TRANSITION_WIPE  // Transition played on mode change
+#define MODE_TRANSITION_FRAMES 4         // Length of the transition in frames
+#define DISPLAY_SCRUB_MS 50              // One driver register rewritten this often (0 = off), SET_SCRUB
+#define DISPLAY_SCRUB_MAX_MS 60000
+
+// Greyscale (Timer1 bit-plane refresh, needs the hardware SPI pins)
+#define GREYSCALE_BITS 2                 // Bit planes per pixel, 0 compiles greyscale out
+#define GREY_SLOT_US 2000                // Length of the shortest plane; cycle is (2^bits - 1) slots
+#define HOURGLASS_BOTTOM_LEVEL 1         // Grey level of the settled sand in the lower chamber
 
 // Sensor Thresholds
 #define ACC_THRESHOLD_LOW 300
@@ -55,14 +64,71 @@
 #define DELAY_FRAME 100           // Main loop delay (ms)
 #define BUTTON_LONG_PRESS_MS 2000 // Long press duration
 #define DEBOUNCE_DELAY 50         // Button debounce (ms)
+#define BUTTON_DOUBLE_CLICK_MS 300 // Max gap between clicks of a double click
+#define BUTTON_HOLD_DELAY_MS 600  // Hold time before repeat events start
+#define BUTTON_HOLD_REPEAT_MS 200 // Hold-repeat interval
 #define UPDATE_INTERVAL 1000      // Status update interval (ms)
+#define MPU6050_STARTUP_MS 100    // Sensor settle time after wake-up
+
+// Event Bus (6 bytes per queued event)
+#define EVENT_ISR_QUEUE 8         // Button edges not yet handled, power of two
+#define EVENT_QUEUE 8             // Events posted from loop() per pass, power of two
+
+// IMU Telemetry Stream
+#define IMU_STREAM_MAX_HZ 200             // Highest STREAM_IMU rate accepted
+#define IMU_STREAM_MAX_DECIMATION 16      // Most sensor reads averaged into one record
+#define IMU_STREAM_RECOVER_RECORDS 32     // Clean records before the rate steps back up
+
+// Power Management
+#define POWER_SLEEP_ENABLED 1             // Idle-sleep the CPU between loop passes
+#define POWER_STANDBY_TIMEOUT_MS 300000UL // Inactivity before display/IMU standby (5 min)
+#define POWER_MOTION_THRESHOLD 0.15       // Accel change (g) that counts as activity
+
+// Settings Storage (EEPROM)
+#define SETTINGS_VERSION 2                // Bump when SettingsRecord changes
+#define SETTINGS_EEPROM_BASE 0            // First byte of the slot ring
+#define SETTINGS_SLOTS 16                 // Slots in the ring (16 x 10 bytes)
+#define SETTINGS_WRITE_DELAY_MS 10000UL   // Coalesce changes for this long
 
 // Mode Definitions
 #define MODE_CLOCK 0
 #define MODE_HOURGLASS 1
 #define MODE_DICE 2
 #define MODE_FLIPCOUNTER 3
-#define NUM_MODES 4
+#define MODE_ANIMATION 4
+#define MODE_STREAM 5
+#define NUM_MODES 6
+
+// Mode Tick Rates (ms) - active while animating or handled, idle once settled
+#define FRAME_SETTLE_MS 2000                 // No animation, motion or host traffic for this long
+#define CLOCK_IDLE_TICK_MS 1000
+#define HOURGLASS_TICK_MS 33                 // ~30 Hz while sand runs
+#define HOURGLASS_IDLE_TICK_MS 250
+#define DICE_IDLE_TICK_MS DELAY_FRAME        // Shake detection needs every frame
+#define FLIPCOUNTER_IDLE_TICK_MS DELAY_FRAME // Flip detection needs every frame
+#define ANIMATION_TICK_MS 20                 // WAIT resolution while a program runs
+#define ANIMATION_IDLE_TICK_MS 500
+#define STREAM_TICK_MS 5                     // Playback jitter bound while frames are queued
+#define STREAM_IDLE_TICK_MS 250
+
+// Host Frame Stream
+#define STREAM_QUEUE_DEPTH 6              // Frames buffered on the device (16 bytes each)
+#define STREAM_PREFILL 2                  // Frames queued before playback (re)starts
+#define STREAM_DEFAULT_FPS 10
+#define STREAM_MAX_FPS 50
+
+// Animation VM
+#define ANIM_EEPROM_BASE 256              // Program header, after the settings ring
+#define ANIM_MAX_PROGRAM 512              // Bytes of bytecode
+#define ANIM_STACK_DEPTH 8
+#define ANIM_STEPS_PER_TICK 200           // Instructions per tick before yielding
+
+// Time Sync (host TSYNC exchanges disciplining the clock)
+#define TSYNC_SAMPLES 6                   // Exchanges kept for the offset and drift fit
+#define TSYNC_SAMPLE_SPACING_MS 10000     // Closer exchanges compete for one slot, the fastest wins
+#define TSYNC_MIN_SPAN_MS 30000UL         // Sample span before the frequency error is fitted
+#define TSYNC_DELAY_MARGIN_MS 4           // Exchanges slower than the fastest by more are left out
+#define TSYNC_MAX_PPM 20000               // Largest frequency error accepted (resonators are ~5000)
 
 // API Configuration
 #define API_PORT 80
@@ -72,11 +138,19 @@
 #define DEBUG_OUTPUT 0  // Changed from 1 to 0 - saves ~200 bytes of RAM
 #define SERIAL_BAUD 9600  // Changed to 9600 for compatibility with reference and Web Serial
 
+// Event Trace (4 bytes per record, read back with DUMP_TRACE)
+#define TRACE_ENABLED 1                   // 0 compiles every trace point out
+#define TRACE_DEPTH 16                    // Records kept; the oldest is overwritten
+
 // Hourglass Configuration
 #define HOURGLASS_PARTICLE_COUNT 48     // Reduced from 60 - still smooth animation
 #define HOURGLASS_TONE_FREQ 440         // Buzzer frequency in Hz
 #define HOURGLASS_TONE_DURATION 10      // Buzzer duration in ms
 #define HOURGLASS_ALARM_CYCLES 5        // Number of alarm beep cycles
+#define HOURGLASS_CATCHUP_GRAINS 4      // Further behind the timeline than this, redraw instead of dropping
+
+// Sand mirror (tuning of the simulation itself is in SandCore.h)
+#define SAND_MIRROR_CHECK_TICKS 32      // Hourglass ticks between checksums sent to a mirror
 
 // Firmware Version
 #define FIRMWARE_VERSION "1.0.2-OPT"  // Further optimized for stability
@@ -86,10 +160,25 @@
 #if DISPLAY_INTENSITY > 15
     #error "DISPLAY_INTENSITY must be 0-15"
 #endif
+#if GREYSCALE_BITS > 3
+    #error "GREYSCALE_BITS must be 0-3"
+#endif
+#if GREYSCALE_BITS > 0 && ((GREY_SLOT_US / 4) << (GREYSCALE_BITS - 1)) > 65536
+    #error "GREY_SLOT_US is too long for the Timer1 compare register"
+#endif
 
 #if DELAY_FRAME < 10
     #error "DELAY_FRAME too small - may cause instability"
 #endif
 
+// Settings slots are 10 bytes, the animation header 4
+#if SETTINGS_EEPROM_BASE + SETTINGS_SLOTS * 10 > ANIM_EEPROM_BASE
+    #error "Settings ring overlaps the animation program"
+#endif
+
+#if ANIM_EEPROM_BASE + 4 + ANIM_MAX_PROGRAM > 1024
+    #error "Animation program does not fit in EEPROM"
+#endif
+
 #endif
 
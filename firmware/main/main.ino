@@ -8,27 +8,27 @@
 #include <Wire.h>
 #include "config.h"
 
+#include "Settings.h"
+#include "DeviceApi.h"
+#include "EventBus.h"
+
 /* ========= FORWARD DECLARATIONS (REQUIRED) ========= */
 void initDisplay();
 void initSensors();
-void handleButtonInput();
-void updateCurrentMode();
-void cycleMode();
-
+void dispatchEvent(const Event& event);
+void handleCommand(const Event& event);
+void scheduleModeTick();
+bool isFrameActive();
+void runModeTick();
+void updateMode();
+void postMotionEvents();
+void restoreSettings();
+SettingsRecord captureSettings();
 void setMode(int mode);
-void setClockTime(int hours, int minutes);
-void setHourglassDuration(int hours, int minutes);
-void resetHourglass();
-void rollDice();
-void resetFlipCounter();
-int getCurrentMode();
-int getDiceValue();
-int getFlipCount();
+void cycleMode();
 void setBrightness(int level);
-const char* getStatusJSON();
-const char* getOrientationJSON();
-const char* getDisplayJSON();
-void matrixToJson(int matrixAddr, char* buf, size_t bufsize);
+
+void writeMatrixJSON(JsonWriter& json, const __FlashStringHelper* name, int matrixAddr);
 /* ================================================== */
 
 #include "LedControl.h"
@@ -40,12 +40,24 @@ void matrixToJson(int matrixAddr, char* buf, size_t bufsize);
 #include "HourglassMode.h"
 #include "DiceMode.h"
 #include "FlipCounterMode.h"
+#include "AnimationMode.h"
+#include "StreamMode.h"
+#include "ModeRegistry.h"
+#include "PowerManager.h"
+#include "Recorder.h"
+#include "ImuStream.h"
+#include "MemoryMonitor.h"
+#include "TimeSync.h"
+#include "TraceRing.h"
+#include "Buzzer.h"
 
 /* ========= GLOBAL OBJECTS ========= */
 LedControl lc(PIN_DATAIN, PIN_CLK, PIN_LOAD, NUM_MATRICES);
 MPU6050 mpu;
 Button button(PIN_BUTTON);
 SerialProtocol serialProtocol;
+PowerManager power(&lc, &mpu);
+Settings settings;
 // Removed NonBlockDelay statusUpdateDelay - saves 8 bytes RAM
 
 /* ========= MODE OBJECTS ========= */
@@ -53,16 +65,47 @@ ClockMode clockMode(&lc, &mpu);
 HourglassMode hourglassMode(&lc, &mpu);
 DiceMode diceMode(&lc, &mpu);
 FlipCounterMode flipCounterMode(&lc, &mpu);
+AnimationMode animationMode(&lc, &mpu);
+StreamMode streamMode(&lc);
+
+/* ========= MODE TABLE ========= */
+// Indexed by the MODE_* ids in config.h - adding a mode is one entry here
+#define MOTION_MODE_EVENTS (EVENT_BIT(EVENT_BUTTON) | EVENT_BIT(EVENT_GESTURE) | \
+                              EVENT_BIT(EVENT_ORIENTATION) | EVENT_BIT(EVENT_COMMAND))
+const ModeDescriptor MODES[] PROGMEM = {
+  MODE_ENTRY(clockMode,       DELAY_FRAME, CLOCK_IDLE_TICK_MS,       MODE_NEEDS_IMU,
+             EVENT_BIT(EVENT_ORIENTATION) | EVENT_BIT(EVENT_COMMAND)),
+  MODE_ENTRY(hourglassMode,   HOURGLASS_TICK_MS, HOURGLASS_IDLE_TICK_MS,   MODE_NEEDS_IMU,
+             EVENT_BIT(EVENT_BUTTON) | EVENT_BIT(EVENT_COMMAND)),
+  MODE_ENTRY(diceMode,        DELAY_FRAME, DICE_IDLE_TICK_MS,        MODE_NEEDS_IMU, MOTION_MODE_EVENTS),
+  MODE_ENTRY(flipCounterMode, DELAY_FRAME, FLIPCOUNTER_IDLE_TICK_MS, MODE_NEEDS_IMU, MOTION_MODE_EVENTS),
+  MODE_ENTRY_NO_EVENTS(animationMode, ANIMATION_TICK_MS, ANIMATION_IDLE_TICK_MS, MODE_NEEDS_IMU),
+  MODE_ENTRY_NO_EVENTS(streamMode,    STREAM_TICK_MS,    STREAM_IDLE_TICK_MS,    0),
+};
+static_assert(sizeof(MODES) / sizeof(MODES[0]) == NUM_MODES, "MODES table must match NUM_MODES");
 
 /* ========= STATE ========= */
 int currentMode = MODE_HOURGLASS;
+ModeDescriptor activeMode;            // SRAM copy of the current table entry
+int currentBrightness = DISPLAY_INTENSITY;
+
+// Boot phase timestamps (micros since reset), BOOT_* in DeviceApi.h
+unsigned long bootTimes[BOOT_PHASES];
+unsigned long lastModeTick = 0;
+bool modeTickPosted = false;
+uint16_t tickPeriod = 0;              // Period the last tick was due at, for GET_CPU
+uint16_t scrubMs = DISPLAY_SCRUB_MS;
+unsigned long lastScrub = 0;
+int lastAngle = -1;                   // Last EVENT_ORIENTATION value, -1 to post the next one
+bool wasShaking = false;              // Shake seen on the last IMU tick
 bool deviceInitialized = false;
 // Removed unused lastUpdate variable - saves 4 bytes RAM
 
 /* ========= SETUP ========= */
 void setup() {
+  // Opening the port resets the board through DTR, so everything here is
+  // on the host's critical path: restored frame first, the rest after it
   Serial.begin(SERIAL_BAUD);
-  delay(1000);
 
 #if DEBUG_OUTPUT
   Serial.println(F("\n=== Smart Hourglass System ==="));
@@ -70,21 +113,33 @@ void setup() {
   Serial.println(FIRMWARE_VERSION);
 #endif
 
-  pinMode(PIN_BUZZER, OUTPUT);
-  digitalWrite(PIN_BUZZER, LOW);
+  // Reset cause, where the bootloader leaves it
+  TRACE(TRACE_BOOT, MCUSR);
 
-  initDisplay();
-  initSensors();
+  buzzer.begin();
+  bootTimes[BOOT_SERIAL] = micros();
 
-  button.init();
-  serialProtocol.init();
+  initDisplay();
+  bootTimes[BOOT_DISPLAY] = micros();
 
+  eventBus.begin(dispatchEvent);
   clockMode.init();
   hourglassMode.init();
   diceMode.init();
   flipCounterMode.init();
+  animationMode.init();
+  streamMode.init();
 
-  setMode(MODE_HOURGLASS);
+  restoreSettings();
+  lc.commit();
+  bootTimes[BOOT_FIRST_FRAME] = micros();
+
+  button.init();
+  serialProtocol.init();
+  power.init();
+  // Non-blocking: the MPU6050 settles and analog probing runs from mpu.update()
+  initSensors();
+  bootTimes[BOOT_READY] = micros();
 
   deviceInitialized = true;
 
@@ -95,25 +150,51 @@ void setup() {
 
 /* ========= LOOP ========= */
 void loop() {
-  delay(DELAY_FRAME);
+  // Button timing only matters around a press
+  if (button.isBusy()) button.update();
+
+  serialProtocol.update();
 
-  button.update();
-  handleButtonInput();
+  scheduleModeTick();
+  eventBus.dispatch();
+  if (!lc.isTransitioning()) {
+    // Drawing done by events between ticks
+    lc.commit();
+  }
 
-  mpu.update();
-  updateCurrentMode();
+  // Noise on the chain can corrupt any driver register; a full cycle
+  // takes SCRUB_STEPS calls, spread out so no frame pays for all of them
+  if (scrubMs && millis() - lastScrub >= scrubMs) {
+    lastScrub = millis();
+    lc.scrub();
+  }
 
-  serialProtocol.update();
-  // Removed unused status update code - already handled by modes
+  if (imuStream.isActive()) {
+    imuStream.update(&mpu);
+    power.noteActivity();  // Keep the IMU out of its 5 Hz low-power cycle
+  }
+
+  // Schedules a coalesced EEPROM write when anything persistent changed
+  settings.update(captureSettings());
+
+  // Nothing left to do until the next interrupt
+  if (!Serial.available() && !eventBus.isPending()) {
+    power.idle();
+  }
 }
 
 /* ========= INIT ========= */
 void initDisplay() {
+  lc.begin();
   for (byte i = 0; i < NUM_MATRICES; i++) {
     lc.shutdown(i, false);
     lc.setIntensity(i, DISPLAY_INTENSITY);
     lc.clearDisplay(i);
   }
+#if GREYSCALE_BITS > 0
+  // Stays mono if the chain isn't on the hardware SPI pins
+  lc.beginGreyscale();
+#endif
 }
 
 void initSensors() {
@@ -125,45 +206,165 @@ void initSensors() {
   mpu.init();
 }
 
-/* ========= INPUT ========= */
-void handleButtonInput() {
-  if (button.wasPressed()) {
-    if (currentMode == MODE_DICE) rollDice();
-    if (currentMode == MODE_HOURGLASS) hourglassMode.reset();
+/* ========= SETTINGS ========= */
+void restoreSettings() {
+  SettingsRecord saved;
+  int mode = MODE_HOURGLASS;
+
+  if (settings.load(&saved)) {
+    setBrightness(saved.brightness);
+    hourglassMode.setDuration(saved.hourglassHours, saved.hourglassMinutes);
+    flipCounterMode.setCount(saved.flipCount);
+    if (saved.mode < NUM_MODES) mode = saved.mode;
+  }
+  setMode(mode);
+}
+
+SettingsRecord captureSettings() {
+  SettingsRecord current;
+  current.brightness = currentBrightness;
+  current.mode = currentMode;
+  current.hourglassHours = hourglassMode.getDurationHours();
+  current.hourglassMinutes = hourglassMode.getDurationMinutes();
+  current.flipCount = flipCounterMode.getCount();
+  return current;
+}
+
+/* ========= EVENTS ========= */
+void dispatchEvent(const Event& event) {
+  switch (event.type) {
+    case EVENT_EDGE:
+      button.onEdge(event.arg, event.value);
+      return;
+    case EVENT_BUTTON:
+      if (event.arg == BUTTON_PRESS && power.noteActivity()) {
+        // First press only wakes the display
+        return;
+      }
+      power.noteActivity();
+      if (event.arg == BUTTON_LONG_PRESS) {
+        cycleMode();
+        return;
+      }
+      break;
+    case EVENT_COMMAND:
+      handleCommand(event);
+      return;
+    case EVENT_SOUND:
+      buzzer.play(event.arg);
+      return;
+    case EVENT_TIMER:
+      if (event.arg == TIMER_MODE_TICK) runModeTick();
+      else if (event.arg == TIMER_MODE_UPDATE) updateMode();
+      return;
+  }
+  if (activeMode.events & EVENT_BIT(event.type)) activeMode.onEvent(event);
+}
+
+void handleCommand(const Event& event) {
+  TRACE(TRACE_COMMAND, event.arg);
+  switch (event.arg) {
+    case CMD_SET_MODE:
+      setMode(event.value);
+      return;
+    case CMD_SET_BRIGHTNESS:
+      setBrightness(event.value);
+      return;
+    case CMD_SET_SCRUB:
+      scrubMs = event.value;
+      return;
+    case CMD_HG_START_AT:
+      if (currentMode != MODE_HOURGLASS) setMode(MODE_HOURGLASS);
+      break;
   }
-  if (button.wasLongPressed()) {
-    cycleMode();
+
+  // Commands reach their mode whether it is showing or not
+  ModeDescriptor mode;
+  for (uint8_t i = 0; i < NUM_MODES; i++) {
+    readModeDescriptor(MODES, i, &mode);
+    if (mode.events & EVENT_BIT(EVENT_COMMAND)) mode.onEvent(event);
   }
 }
 
 /* ========= MODES ========= */
-void updateCurrentMode() {
-  switch (currentMode) {
-    case MODE_CLOCK:       clockMode.update(); break;
-    case MODE_HOURGLASS:   hourglassMode.update(); break;
-    case MODE_DICE:        diceMode.update(); break;
-    case MODE_FLIPCOUNTER: flipCounterMode.update(); break;
+void scheduleModeTick() {
+  // Picked again every frame: the active rate while the mode animates (or
+  // a transition runs), and for a while after the last motion or host
+  // traffic so the mode answers promptly; the idle rate once all is still
+  unsigned long period = isFrameActive() ? activeMode.activeTickMs : activeMode.idleTickMs;
+
+  if (!modeTickPosted && millis() - lastModeTick >= period) {
+    modeTickPosted = eventBus.post(EVENT_TIMER, TIMER_MODE_TICK);
+    tickPeriod = period;
+  }
+}
+
+bool isFrameActive() {
+  // The power manager's idle time already restarts on all three
+  return activeMode.isAnimating() || lc.isTransitioning() || power.getIdleTime() < FRAME_SETTLE_MS;
+}
+
+void runModeTick() {
+  modeTickPosted = false;
+  lastModeTick = millis();
+  if (activeMode.flags & MODE_NEEDS_IMU) {
+    mpu.update();
+    recorder.recordImu(&mpu);
+    power.noteMotion();
+    postMotionEvents();
+  }
+  // Queued behind the motion events so the mode sees them first
+  if (!eventBus.post(EVENT_TIMER, TIMER_MODE_UPDATE)) updateMode();
+}
+
+void updateMode() {
+#if TRACE_ENABLED
+  unsigned long start = millis();
+  activeMode.update();
+  unsigned long took = millis() - start;
+  if (took > tickPeriod) TRACE(TRACE_OVERRUN, min(took - tickPeriod, 255UL));
+#else
+  activeMode.update();
+#endif
+  power.update(activeMode.isAnimating());
+  // Modes only draw into the back buffer, push the changed rows once per tick
+  lc.commit();
+}
+
+void postMotionEvents() {
+  // Detected on every IMU tick so their state never goes stale, whichever
+  // mode is showing
+  bool shaking = mpu.isShaking();
+  if (shaking) eventBus.post(EVENT_GESTURE, GESTURE_SHAKE);
+  // Traced once per shake rather than on every tick of it
+  if (shaking && !wasShaking) TRACE(TRACE_GESTURE, GESTURE_SHAKE);
+  wasShaking = shaking;
+  if (mpu.detectFlip()) {
+    TRACE(TRACE_GESTURE, GESTURE_FLIP);
+    eventBus.post(EVENT_GESTURE, GESTURE_FLIP);
+  }
+  int angle = mpu.getAngle();
+  if (angle != lastAngle) {
+    lastAngle = angle;
+    eventBus.post(EVENT_ORIENTATION, 0, angle);
   }
 }
 
 void setMode(int mode) {
   if (mode < 0 || mode >= NUM_MODES) return;
 
-  switch (currentMode) {
-    case MODE_CLOCK:       clockMode.exit(); break;
-    case MODE_HOURGLASS:   hourglassMode.exit(); break;
-    case MODE_DICE:        diceMode.exit(); break;
-    case MODE_FLIPCOUNTER: flipCounterMode.exit(); break;
+  // Old frame stays on the panel until the new mode has drawn its first one
+  if (deviceInitialized) {
+    lc.startTransition(MODE_TRANSITION, MODE_TRANSITION_FRAMES);
+    activeMode.exit();
   }
 
   currentMode = mode;
-
-  switch (currentMode) {
-    case MODE_CLOCK:       clockMode.enter(); break;
-    case MODE_HOURGLASS:   hourglassMode.enter(); break;
-    case MODE_DICE:        diceMode.enter(); break;
-    case MODE_FLIPCOUNTER: flipCounterMode.enter(); break;
-  }
+  TRACE(TRACE_MODE, mode);
+  readModeDescriptor(MODES, currentMode, &activeMode);
+  activeMode.enter();
+  lastModeTick = millis() - activeMode.activeTickMs;  // First tick right away
+  lastAngle = -1;  // The new mode gets the orientation on that tick
 }
 
 void cycleMode() {
@@ -171,70 +372,175 @@ void cycleMode() {
 }
 
 /* ========= ACTIONS ========= */
-void setClockTime(int h, int m) { clockMode.setTime(h, m); }
-void setHourglassDuration(int h, int m) { hourglassMode.setDuration(h, m); }
-void resetHourglass() { hourglassMode.reset(); }
-void rollDice() { diceMode.roll(); }
-void resetFlipCounter() { flipCounterMode.reset(); }
+bool writeAnimation(uint16_t offset, const uint8_t* data, uint8_t len) {
+  return animationMode.write(offset, data, len);
+}
+
+int pushFrame(const uint8_t* rows) {
+  if (currentMode != MODE_STREAM) setMode(MODE_STREAM);
+  return streamMode.push(rows) ? streamMode.getFill() : -1;
+}
+
+int pushFrameDelta(const uint8_t* pairs, uint8_t count) {
+  if (currentMode != MODE_STREAM) setMode(MODE_STREAM);
+  return streamMode.pushDelta(pairs, count) ? streamMode.getFill() : -1;
+}
+
+void setStreamFps(int fps) { streamMode.setFps(fps); }
+
+int commitAnimation(uint16_t len, uint8_t crc) {
+  int result = animationMode.commit(len, crc);
+  if (result == ANIM_VALID && currentMode == MODE_ANIMATION) {
+    animationMode.enter();  // Start the new program right away
+  }
+  return result;
+}
+
+void noteHostActivity() { power.noteActivity(); }
 
 /* ========= GETTERS ========= */
 int getCurrentMode() { return currentMode; }
 int getDiceValue() { return diceMode.getValue(); }
 int getFlipCount() { return flipCounterMode.getCount(); }
+uint16_t getAnimationLength() { return animationMode.getLength(); }
+uint8_t getAnimationState() { return animationMode.getState(); }
+uint16_t getAnimationPc() { return animationMode.getPc(); }
+uint8_t getStreamFill() { return streamMode.getFill(); }
+uint8_t getStreamFps() { return streamMode.getFps(); }
+uint16_t getStreamPlayed() { return streamMode.getPlayed(); }
+uint16_t getStreamUnderruns() { return streamMode.getUnderruns(); }
+int getOrientationAngle() { return mpu.getAngle(); }
+uint8_t getPowerState() { return power.getState(); }
+uint8_t getSleepPercent() { return power.getSleepPercent(); }
+unsigned long getIdleTime() { return power.getIdleTime(); }
+unsigned int getTickPeriod() { return tickPeriod; }
+unsigned long getHourglassDuration() { return hourglassMode.getDuration(); }
+unsigned long getHourglassElapsed() { return hourglassMode.getElapsed(); }
+bool isHourglassRunning() { return hourglassMode.isRunning(); }
+uint8_t getHourglassProgress() { return hourglassMode.getProgress(); }
+
+#if GREYSCALE_BITS > 0
+unsigned int getRefreshLoad() { return lc.getRefreshLoad(); }
+uint8_t getGreyLevels() { return lc.isGreyscale() ? GREY_MAX + 1 : 0; }
+#else
+unsigned int getRefreshLoad() { return 0; }
+uint8_t getGreyLevels() { return 0; }
+#endif
+unsigned long getBootTime(uint8_t phase) { return phase < BOOT_PHASES ? bootTimes[phase] : 0; }
+const uint8_t* getDisplayRows(int matrix) { return lc.getBuffer(matrix); }
+
+void getAcceleration(int16_t* xyz) {
+  xyz[0] = mpu.getRawX();
+  xyz[1] = mpu.getRawY();
+  xyz[2] = mpu.getRawZ();
+}
 
 /* ========= DISPLAY ========= */
 void setBrightness(int level) {
   level = constrain(level, 0, 15);
+  currentBrightness = level;
   for (byte i = 0; i < NUM_MATRICES; i++) {
     lc.setIntensity(i, level);
   }
 }
 
 /* ========= JSON ========= */
-const char* getStatusJSON() {
-  static char buffer[32];
-  snprintf(buffer, sizeof(buffer), "{\"mode\":%d}", currentMode);
-  return buffer;
-}
-
-const char* getOrientationJSON() {
-  static char buffer[32];
-  snprintf(buffer, sizeof(buffer), "{\"angle\":%.2f}", mpu.getAngle());
-  return buffer;
-}
-
-const char* getDisplayJSON() {
-  // Minimized buffer sizes for memory-constrained Arduino Nano
-  static char buffer[256];   // Reduced from 320
-  static char matrixA_buf[100]; // Reduced from 128
-  static char matrixB_buf[100]; // Reduced from 128
-  
-  // Fill each matrix buffer (matrixToJson now takes caller-provided buffer)
-  matrixToJson(MATRIX_A, matrixA_buf, sizeof(matrixA_buf));
-  matrixToJson(MATRIX_B, matrixB_buf, sizeof(matrixB_buf));
-  
-  // Build final JSON from the two distinct buffers
-  snprintf(buffer, sizeof(buffer), "{\"matrixA\":%s,\"matrixB\":%s}", matrixA_buf, matrixB_buf);
-  return buffer;
-}
-
-void matrixToJson(int matrixAddr, char* buf, size_t bufsize) {
-  // Write 8x8 matrix JSON into caller-provided buffer
+// Written field by field into the serial TX path, nothing is buffered
+void writeBootJSON(JsonWriter& json) {
+  json.beginObject();
+  json.field(F("serial"), bootTimes[BOOT_SERIAL]);
+  json.field(F("display"), bootTimes[BOOT_DISPLAY]);
+  json.field(F("frame"), bootTimes[BOOT_FIRST_FRAME]);
+  json.field(F("ready"), bootTimes[BOOT_READY]);
+  json.endObject();
+}
+
+void writePowerJSON(JsonWriter& json) {
+  json.beginObject();
+  json.field(F("state"), power.getState() == POWER_STANDBY ? F("standby") : F("active"));
+  json.field(F("sleep"), power.getSleepPercent());
+  json.field(F("idleMs"), power.getIdleTime());
+  json.endObject();
+}
+
+void writeCpuJSON(JsonWriter& json) {
+  json.beginObject();
+  json.fixed(F("refresh"), getRefreshLoad(), 1);
+  json.field(F("sleep"), getSleepPercent());
+  json.field(F("levels"), getGreyLevels());
+  json.field(F("tickMs"), getTickPeriod());
+  json.endObject();
+}
+
+void writeMemJSON(JsonWriter& json) {
+  MemoryStats mem;
+  getMemoryStats(&mem);
+  json.beginObject();
+  json.field(F("data"), mem.data);
+  json.field(F("bss"), mem.bss);
+  json.field(F("heap"), mem.heap);
+  json.field(F("free"), mem.freeNow);
+  json.field(F("stackPeak"), mem.stackPeak);
+  json.field(F("freeMin"), mem.freeMin);
+  json.field(F("canary"), mem.canaryOk ? F("ok") : F("broken"));
+  json.endObject();
+}
+
+void writeTimeJSON(JsonWriter& json) {
+  uint32_t ms = timeSync.timeOfDay();
+  char text[13];
+  snprintf(text, sizeof(text), "%02u:%02u:%02u.%03u", (unsigned)(ms / 3600000UL % 24),
+           (unsigned)(ms / 60000UL % 60), (unsigned)(ms / 1000 % 60), (unsigned)(ms % 1000));
+  json.beginObject();
+  json.field(F("time"), text);
+  json.field(F("ms"), ms);
+  json.field(F("synced"), timeSync.isSynced());
+  json.fixed(F("ppm"), timeSync.getRate() / 100, 1);
+  json.field(F("samples"), timeSync.getSamples());
+  json.endObject();
+}
+
+void writeHourglassJSON(JsonWriter& json) {
+  json.beginObject();
+  json.field(F("durationMs"), hourglassMode.getDuration());
+  json.field(F("elapsedMs"), hourglassMode.getElapsed());
+  json.field(F("running"), hourglassMode.isRunning());
+  json.field(F("progress"), hourglassMode.getProgress());
+  json.endObject();
+}
+
+void writeStatusJSON(JsonWriter& json) {
+  json.beginObject();
+  json.field(F("mode"), currentMode);
+  json.endObject();
+}
+
+void writeOrientationJSON(JsonWriter& json) {
+  // Axes in hundredths of g
+  json.beginObject();
+  json.field(F("angle"), mpu.getAngle());
+  json.fixed(F("x"), (long)(mpu.getX() * 100), 2);
+  json.fixed(F("y"), (long)(mpu.getY() * 100), 2);
+  json.fixed(F("z"), (long)(mpu.getZ() * 100), 2);
+  json.endObject();
+}
+
+void writeDisplayJSON(JsonWriter& json) {
+  json.beginObject();
+  writeMatrixJSON(json, F("matrixA"), MATRIX_A);
+  writeMatrixJSON(json, F("matrixB"), MATRIX_B);
+  json.endObject();
+}
+
+void writeMatrixJSON(JsonWriter& json, const __FlashStringHelper* name, int matrixAddr) {
   // Format: [[1,0,1,...],[...],...]
-  // Prevents reentrancy issues by using caller's buffer instead of static
-  if (!buf || bufsize < 100) return;  // Reduced from 120, buffer now 100 bytes
-  
-  int pos = 0;
-  buf[pos++] = '[';
+  json.beginArray(name);
   for (int r = 0; r < 8; r++) {
-    buf[pos++] = '[';
+    json.beginArray();
     for (int c = 0; c < 8; c++) {
-      buf[pos++] = lc.getRawXY(matrixAddr, c, r) ? '1' : '0';
-      if (c < 7) buf[pos++] = ',';
+      json.value(lc.getRawXY(matrixAddr, c, r) ? 1 : 0);
     }
-    buf[pos++] = ']';
-    if (r < 7) buf[pos++] = ',';
+    json.endArray();
   }
-  buf[pos++] = ']';
-  buf[pos] = '\0';
+  json.endArray();
 }
\ No newline at end of file
@@ -1,6 +1,9 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <stdint.h>
+#include <stddef.h>
+
 /**
  * Normalize angle to [0, 360) range
  * Handles negative angles by adding 360 as needed
@@ -10,4 +13,18 @@ inline int normalizeAngle(int angle) {
     return ((angle % 360) + 360) % 360;
 }
 
+/**
+ * CRC-8, polynomial 0x07 (as used by SMBus)
+ * Pass the previous result as crc to continue over several buffers
+ */
+inline uint8_t crc8(const uint8_t* data, size_t len, uint8_t crc = 0) {
+    while (len--) {
+        crc ^= *data++;
+        for (uint8_t i = 0; i < 8; i++) {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
 #endif
@@ -0,0 +1,67 @@
+#include "BinaryLink.h"
+
+namespace hg {
+
+uint8_t crc8(const uint8_t* data, size_t len) {
+    uint8_t crc = 0;
+    while (len--) {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+    return crc;
+}
+
+std::vector<uint8_t> encodeRequest(uint8_t opcode, const uint8_t* args, size_t len) {
+    std::vector<uint8_t> raw;
+    raw.push_back(opcode);
+    raw.insert(raw.end(), args, args + len);
+    raw.push_back(crc8(raw.data(), raw.size()));
+
+    std::vector<uint8_t> out;
+    size_t codePos = 0;
+    out.push_back(1);
+    for (uint8_t b : raw) {
+        if (b == 0 || out[codePos] == 0xFF) {
+            bool zero = b == 0;
+            codePos = out.size();
+            out.push_back(1);
+            if (zero) continue;
+        }
+        out.push_back(b);
+        out[codePos]++;
+    }
+    out.push_back(0);
+    return out;
+}
+
+bool FrameReader::feed(uint8_t c, BinaryResponse& out) {
+    if (c != 0) {
+        if (encoded.size() < 512) encoded.push_back(c);
+        return false;
+    }
+    if (encoded.empty()) return false;
+
+    std::vector<uint8_t> raw;
+    size_t in = 0;
+    bool ok = true;
+    while (in < encoded.size()) {
+        uint8_t code = encoded[in++];
+        if (in + code - 1 > encoded.size()) { ok = false; break; }
+        raw.insert(raw.end(), encoded.begin() + in, encoded.begin() + in + code - 1);
+        in += code - 1;
+        if (code < 0xFF && in < encoded.size()) raw.push_back(0);
+    }
+    encoded.clear();
+
+    if (!ok || raw.size() < 3 || crc8(raw.data(), raw.size() - 1) != raw.back() ||
+        !(raw[0] & BIN_RESPONSE)) {
+        badFrames++;
+        return false;
+    }
+    out.opcode = raw[0] & ~BIN_RESPONSE;
+    out.status = raw[1];
+    out.payload.assign(raw.begin() + 2, raw.end() - 1);
+    return true;
+}
+
+}
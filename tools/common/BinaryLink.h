@@ -0,0 +1,45 @@
+#ifndef BINARY_LINK_H
+#define BINARY_LINK_H
+
+/*
+ * Host side of the firmware's binary protocol: COBS framing and CRC-8
+ * matching firmware/main/BinaryProtocol.cpp. Opcodes and status codes
+ * come from firmware/main/BinaryOpcodes.h.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "BinaryOpcodes.h"
+
+namespace hg {
+
+uint8_t crc8(const uint8_t* data, size_t len);
+
+// Builds a complete request frame: COBS(opcode, args, crc8) + 0x00
+std::vector<uint8_t> encodeRequest(uint8_t opcode, const uint8_t* args, size_t len);
+
+struct BinaryResponse {
+    uint8_t opcode;   // Request opcode, BIN_RESPONSE stripped
+    uint8_t status;
+    std::vector<uint8_t> payload;
+};
+
+// Reassembles responses from the byte stream. Bad frames are skipped.
+class FrameReader {
+public:
+    FrameReader() : badFrames(0) {}
+
+    // Returns true when c completed a valid response, stored in out
+    bool feed(uint8_t c, BinaryResponse& out);
+
+    unsigned long badFrames;
+
+private:
+    std::vector<uint8_t> encoded;
+};
+
+}
+
+#endif
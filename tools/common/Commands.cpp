@@ -0,0 +1,330 @@
+#include "Commands.h"
+#include "HostClock.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
+
+namespace hg {
+
+namespace {
+
+struct Command {
+    const char* name;
+    uint8_t opcode;
+    int args;  // Byte arguments parsed from decimal, -1 for SET_MODE's name
+};
+
+const Command COMMANDS[] = {
+    { "GET_STATUS",      BIN_OP_GET_STATUS,      0 },
+    { "GET_ORIENTATION", BIN_OP_GET_ORIENTATION, 0 },
+    { "GET_DISPLAY",     BIN_OP_GET_DISPLAY,     0 },
+    { "GET_POWER",       BIN_OP_GET_POWER,       0 },
+    { "GET_BOOT",        BIN_OP_GET_BOOT,        0 },
+    { "GET_CPU",         BIN_OP_GET_CPU,         0 },
+    { "GET_MEM",         BIN_OP_GET_MEM,         0 },
+    { "GET_TIME",        BIN_OP_GET_TIME,        0 },
+    { "SET_MODE",        BIN_OP_SET_MODE,       -1 },
+    { "SET_TIME",        BIN_OP_SET_TIME,        2 },
+    { "SET_HG",          BIN_OP_SET_HG,          2 },
+    { "RESET_HG",        BIN_OP_RESET_HG,        0 },
+    { "HG_PAUSE",        BIN_OP_HG_PAUSE,        0 },
+    { "HG_RESUME",       BIN_OP_HG_RESUME,       0 },
+    { "GET_HG",          BIN_OP_GET_HG,          0 },
+    { "ROLL_DICE",       BIN_OP_ROLL_DICE,       0 },
+    { "GET_FLIP_COUNT",  BIN_OP_GET_FLIP_COUNT,  0 },
+    { "RESET_FLIP",      BIN_OP_RESET_FLIP,      0 },
+    { "SET_BRIGHTNESS",  BIN_OP_SET_BRIGHTNESS,  1 },
+    { "SET_SCRUB",       BIN_OP_SET_SCRUB,       1 },
+    { "STREAM_IMU",      BIN_OP_STREAM_IMU,      1 },
+    { "ANIM_INFO",       BIN_OP_ANIM_INFO,       0 },
+    { "STREAM_FPS",      BIN_OP_STREAM_FPS,      1 },
+    { "STREAM_INFO",     BIN_OP_STREAM_INFO,     0 },
+    { "PING",            BIN_OP_PING,            0 },
+};
+
+const char* MODE_NAMES[] = { "CLOCK", "HOURGLASS", "DICE", "FLIPCOUNTER", "ANIMATION", "STREAM" };
+const size_t MODE_COUNT = sizeof(MODE_NAMES) / sizeof(MODE_NAMES[0]);
+
+const char* ANIM_STATES[] = { "none", "running", "waiting", "halted", "fault" };
+
+uint32_t u16(const std::vector<uint8_t>& p, size_t at) {
+    return p[at] | (p[at + 1] << 8);
+}
+
+uint32_t u32(const std::vector<uint8_t>& p, size_t at) {
+    return u16(p, at) | (u16(p, at + 2) << 16);
+}
+
+std::string format(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+
+std::string format(const char* fmt, ...) {
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    return buf;
+}
+
+}
+
+const char* statusText(uint8_t status) {
+    switch (status) {
+        case BIN_OK:          return "OK";
+        case BIN_ERR_CRC:     return "CRC mismatch";
+        case BIN_ERR_UNKNOWN: return "Unknown command";
+        case BIN_ERR_ARGS:    return "Bad arguments";
+        case BIN_ERR_RANGE:   return "Out of range";
+        case BIN_ERR_FULL:    return "Queue full";
+    }
+    return "Error";
+}
+
+const char* modeName(uint8_t mode) {
+    return mode < MODE_COUNT ? MODE_NAMES[mode] : "?";
+}
+
+std::vector<std::string> splitWords(const char* line) {
+    std::vector<std::string> words;
+    std::string word;
+    for (const char* p = line; ; p++) {
+        if (*p == '\0' || *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') {
+            if (!word.empty()) words.push_back(word);
+            word.clear();
+            if (*p == '\0') break;
+        } else {
+            word += *p;
+        }
+    }
+    return words;
+}
+
+bool parseFrame(const char* text, std::vector<uint8_t>& frame) {
+    frame.clear();
+    for (const char* p = text; *p && *p != '\n' && *p != '\r'; p++) {
+        if (*p == ' ') continue;
+        unsigned value;
+        if (!isxdigit((unsigned char)p[0]) || !isxdigit((unsigned char)p[1]) ||
+            sscanf(p, "%2x", &value) != 1) {
+            return false;
+        }
+        frame.push_back((uint8_t)value);
+        p++;
+    }
+    return frame.size() == 16;
+}
+
+bool parseCommand(const std::vector<std::string>& words, Request& out, std::string& error) {
+    out.args.clear();
+    if (words.empty()) {
+        error = "ERR Unknown command";
+        return false;
+    }
+    if (!strcasecmp(words[0].c_str(), "PUSH_FRAME")) {
+        if (words.size() != 2 || !parseFrame(words[1].c_str(), out.args)) {
+            error = "ERR Usage: PUSH_FRAME <32 hex digits>";
+            return false;
+        }
+        out.opcode = BIN_OP_PUSH_FRAME;
+        return true;
+    }
+
+    if (!strcasecmp(words[0].c_str(), "HG_START_AT")) {
+        // Host time of day in ms, or +SECONDS from now
+        char* end = NULL;
+        double at = -1;
+        if (words.size() == 2 && words[1][0] == '+') {
+            at = timeOfDayMs() + strtod(words[1].c_str() + 1, &end) * 1000;
+        } else if (words.size() == 2) {
+            at = strtod(words[1].c_str(), &end);
+        }
+        if (!end || *end || at < 0) {
+            error = "ERR Usage: HG_START_AT HOST_MS | +SECONDS";
+            return false;
+        }
+        uint32_t ms = (uint32_t)fmod(at + 0.5, DAY_MS);
+        out.opcode = BIN_OP_HG_START_AT;
+        for (int i = 0; i < 4; i++) out.args.push_back((uint8_t)(ms >> (i * 8)));
+        return true;
+    }
+
+    const Command* cmd = NULL;
+    for (const Command& c : COMMANDS) {
+        if (!strcasecmp(c.name, words[0].c_str())) cmd = &c;
+    }
+    if (!cmd) {
+        error = "ERR Unknown command";
+        return false;
+    }
+    out.opcode = cmd->opcode;
+
+    if (cmd->args < 0) {
+        if (words.size() != 2) { error = "ERR Usage: SET_MODE NAME"; return false; }
+        size_t mode = 0;
+        while (mode < MODE_COUNT && strcasecmp(MODE_NAMES[mode], words[1].c_str())) mode++;
+        if (mode == MODE_COUNT && !strcasecmp(words[1].c_str(), "FLIP")) mode = 3;
+        if (mode == MODE_COUNT) { error = "ERR Invalid mode"; return false; }
+        out.args.push_back((uint8_t)mode);
+        return true;
+    }
+    if ((int)words.size() != cmd->args + 1) {
+        error = format("ERR %s takes %d argument(s)", cmd->name, cmd->args);
+        return false;
+    }
+    for (size_t i = 1; i < words.size(); i++) out.args.push_back((uint8_t)atoi(words[i].c_str()));
+    if (cmd->opcode == BIN_OP_STREAM_IMU || cmd->opcode == BIN_OP_SET_SCRUB) {
+        int value = atoi(words[1].c_str());
+        out.args[0] = (uint8_t)(value & 0xFF);
+        out.args.push_back((uint8_t)(value >> 8));
+    }
+    return true;
+}
+
+bool isQuery(uint8_t opcode) {
+    switch (opcode) {
+        case BIN_OP_GET_STATUS:
+        case BIN_OP_GET_ORIENTATION:
+        case BIN_OP_GET_DISPLAY:
+        case BIN_OP_GET_POWER:
+        case BIN_OP_GET_BOOT:
+        case BIN_OP_GET_CPU:
+        case BIN_OP_GET_MEM:
+        case BIN_OP_GET_TIME:
+        case BIN_OP_GET_HG:
+        case BIN_OP_GET_FLIP_COUNT:
+        case BIN_OP_ANIM_INFO:
+        case BIN_OP_STREAM_INFO:
+            return true;
+    }
+    return false;
+}
+
+std::string formatDisplay(const uint8_t* rows) {
+    std::string out = "{\"matrixA\":[";
+    for (int m = 0; m < 2; m++) {
+        if (m) out += "],\"matrixB\":[";
+        for (int r = 0; r < 8; r++) {
+            out += r ? ",[" : "[";
+            for (int c = 0; c < 8; c++) {
+                if (c) out += ',';
+                out += (rows[m * 8 + r] & (0x80 >> c)) ? '1' : '0';
+            }
+            out += ']';
+        }
+    }
+    out += "]}";
+    return out;
+}
+
+std::string formatResponse(const BinaryResponse& r) {
+    const std::vector<uint8_t>& p = r.payload;
+    if (r.status == BIN_ERR_INVALID && p.size() >= 2) {
+        return format("ERR Invalid instruction at offset %u", u16(p, 0));
+    }
+    if (r.status != BIN_OK) return format("ERR %s", statusText(r.status));
+
+    switch (r.opcode) {
+        case BIN_OP_GET_STATUS:
+            if (p.size() >= 1) return format("{\"mode\":%u}", p[0]);
+            break;
+        case BIN_OP_GET_ORIENTATION:
+            if (p.size() >= 8) {
+                return format("{\"angle\":%u,\"ax\":%d,\"ay\":%d,\"az\":%d}", u16(p, 0),
+                              (int16_t)u16(p, 2), (int16_t)u16(p, 4), (int16_t)u16(p, 6));
+            }
+            break;
+        case BIN_OP_GET_DISPLAY:
+            if (p.size() >= 16) return formatDisplay(p.data());
+            break;
+        case BIN_OP_GET_POWER:
+            if (p.size() >= 6) {
+                return format("{\"state\":\"%s\",\"sleep\":%u,\"idleMs\":%u}",
+                              p[0] ? "standby" : "active", p[1], u32(p, 2));
+            }
+            break;
+        case BIN_OP_GET_CPU:
+            if (p.size() >= 6) {
+                return format("{\"refresh\":%u.%u,\"sleep\":%u,\"levels\":%u,\"tickMs\":%u}",
+                              u16(p, 0) / 10, u16(p, 0) % 10, p[2], p[3], u16(p, 4));
+            }
+            break;
+        case BIN_OP_GET_MEM:
+            if (p.size() >= 13) {
+                return format("{\"data\":%u,\"bss\":%u,\"heap\":%u,\"free\":%u,"
+                              "\"stackPeak\":%u,\"freeMin\":%u,\"canary\":\"%s\"}",
+                              u16(p, 0), u16(p, 2), u16(p, 4), u16(p, 6), u16(p, 8), u16(p, 10),
+                              p[12] ? "ok" : "broken");
+            }
+            break;
+        case BIN_OP_GET_TIME:
+            if (p.size() >= 10) {
+                uint32_t ms = u32(p, 0);
+                return format("{\"time\":\"%02u:%02u:%02u.%03u\",\"ms\":%u,\"synced\":%s,\"ppm\":%.1f,\"samples\":%u}",
+                              ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000, ms,
+                              p[8] ? "true" : "false", (int32_t)u32(p, 4) / 1000.0, p[9]);
+            }
+            break;
+        case BIN_OP_GET_HG:
+            if (p.size() >= 10) {
+                return format("{\"durationMs\":%u,\"elapsedMs\":%u,\"running\":%s,\"progress\":%u}",
+                              u32(p, 0), u32(p, 4), p[8] ? "true" : "false", p[9]);
+            }
+            break;
+        case BIN_OP_TSYNC:
+            if (p.size() >= 9) return format("{\"seq\":%u,\"rx\":%u,\"tx\":%u}", p[0], u32(p, 1), u32(p, 5));
+            break;
+        case BIN_OP_TSYNC_FIN:
+            if (p.size() >= 11) {
+                return format("{\"step\":%d,\"ppm\":%.1f,\"delay\":%u,\"samples\":%u}",
+                              (int32_t)u32(p, 0), (int32_t)u32(p, 4) / 1000.0, u16(p, 8), p[10]);
+            }
+            break;
+        case BIN_OP_GET_BOOT:
+            if (p.size() >= 16) {
+                return format("{\"serial\":%u,\"display\":%u,\"frame\":%u,\"ready\":%u}",
+                              u32(p, 0), u32(p, 4), u32(p, 8), u32(p, 12));
+            }
+            break;
+        case BIN_OP_ROLL_DICE:
+            if (p.size() >= 1) return format("{\"diceValue\":%u}", p[0]);
+            break;
+        case BIN_OP_STREAM_IMU:
+            if (p.size() >= 8) return format("{\"sent\":%u,\"dropped\":%u}", u32(p, 0), u32(p, 4));
+            return "OK";
+        case BIN_OP_IMU_SAMPLE:
+            if (p.size() >= 18) {
+                std::string line = format("%u,%u,%u,%u", u16(p, 0), u16(p, 2), p[4], p[5]);
+                for (int i = 0; i < 6; i++) line += format(",%d", (int16_t)u16(p, 6 + i * 2));
+                return line;
+            }
+            break;
+        case BIN_OP_ANIM_INFO:
+            if (p.size() >= 5) {
+                return format("{\"length\":%u,\"state\":\"%s\",\"pc\":%u}", u16(p, 0),
+                              p[2] < 5 ? ANIM_STATES[p[2]] : "?", u16(p, 3));
+            }
+            break;
+        case BIN_OP_PUSH_FRAME:
+        case BIN_OP_PUSH_DELTA:
+            if (p.size() >= 2) return format("{\"fill\":%u,\"free\":%u}", p[0], p[1]);
+            break;
+        case BIN_OP_STREAM_INFO:
+            if (p.size() >= 7) {
+                return format("{\"fill\":%u,\"depth\":%u,\"fps\":%u,\"played\":%u,\"underruns\":%u}",
+                              p[0], p[1], p[2], u16(p, 3), u16(p, 5));
+            }
+            break;
+        case BIN_OP_GET_FLIP_COUNT:
+            if (p.size() >= 2) return format("{\"count\":%u}", u16(p, 0));
+            break;
+        default:
+            return "OK";
+    }
+    return "ERR Short response";
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+/*
+ * Text protocol command names mapped onto binary requests, and binary
+ * responses formatted back into the text protocol's JSON. Shared by
+ * hgctl and hgmux.
+ */
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "BinaryLink.h"
+
+namespace hg {
+
+struct Request {
+    uint8_t opcode;
+    std::vector<uint8_t> args;
+
+    bool operator==(const Request& other) const {
+        return opcode == other.opcode && args == other.args;
+    }
+};
+
+// Splits a command line on blanks
+std::vector<std::string> splitWords(const char* line);
+
+// 32 hex digits (blanks allowed between bytes) into a 16 byte frame
+bool parseFrame(const char* text, std::vector<uint8_t>& frame);
+
+// Builds the request for a text command such as "SET_TIME 14 30".
+// Returns false with the text protocol's "ERR ..." line in error.
+bool parseCommand(const std::vector<std::string>& words, Request& out, std::string& error);
+
+// True for commands that only read state, so identical ones can share a response
+bool isQuery(uint8_t opcode);
+
+// One response line without the newline: JSON, "OK" or "ERR ..."
+std::string formatResponse(const BinaryResponse& response);
+
+// BIN_ERR_* as the text protocol words it
+const char* statusText(uint8_t status);
+
+// MODE_* as SET_MODE takes it, "?" when out of range
+const char* modeName(uint8_t mode);
+
+// GET_DISPLAY rows as the text protocol's 8x8 arrays:
+// {"matrixA":[[1,0,...],...],"matrixB":[...]}
+std::string formatDisplay(const uint8_t* rows);
+
+}
+
+#endif
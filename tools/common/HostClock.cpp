@@ -0,0 +1,56 @@
+#include "HostClock.h"
+
+#include <sys/time.h>
+#include <time.h>
+
+namespace hg {
+
+namespace {
+
+// COBS adds one byte to frames this short, plus the terminator
+const int TSYNC_REQUEST_BYTES = 1 + 5 + 1 + 2;
+const int TSYNC_RESPONSE_BYTES = 2 + 9 + 1 + 2;
+
+// 8N1: ten bits a byte
+double wireMs(int bytes, int baud) {
+    return bytes * 10000.0 / baud;
+}
+
+std::vector<uint8_t> args(uint8_t seq, double ms) {
+    uint32_t v = (uint32_t)(ms + 0.5) % DAY_MS;
+    std::vector<uint8_t> out;
+    out.push_back(seq);
+    for (int i = 0; i < 4; i++) out.push_back((uint8_t)(v >> (i * 8)));
+    return out;
+}
+
+}
+
+double timeOfDayMs() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    struct tm local;
+    localtime_r(&tv.tv_sec, &local);
+    return (local.tm_hour * 3600.0 + local.tm_min * 60 + local.tm_sec) * 1000 + tv.tv_usec / 1000.0;
+}
+
+std::vector<uint8_t> tsyncArgs(uint8_t seq, int baud) {
+    return args(seq, timeOfDayMs() + wireMs(TSYNC_REQUEST_BYTES, baud));
+}
+
+std::vector<uint8_t> tsyncFinArgs(uint8_t seq, int baud) {
+    return args(seq, timeOfDayMs() - wireMs(TSYNC_RESPONSE_BYTES, baud) + DAY_MS);
+}
+
+BinaryResponse syncResult(const std::vector<BinaryResponse>& fins) {
+    int32_t step = 0;
+    for (const BinaryResponse& r : fins) {
+        if (r.status != BIN_OK || r.payload.size() < 4) return r;
+        step += (int32_t)(r.payload[0] | r.payload[1] << 8 | r.payload[2] << 16 | (uint32_t)r.payload[3] << 24);
+    }
+    BinaryResponse result = fins.back();
+    for (int i = 0; i < 4; i++) result.payload[i] = (uint8_t)((uint32_t)step >> (i * 8));
+    return result;
+}
+
+}
@@ -0,0 +1,35 @@
+#ifndef HOST_CLOCK_H
+#define HOST_CLOCK_H
+
+/*
+ * The host side of TSYNC (see firmware/main/TimeSync.h): the timebase
+ * the devices are synced to, and the request arguments with the time
+ * the frames spend on the wire taken out.
+ */
+
+#include <stdint.h>
+#include <vector>
+
+#include "BinaryLink.h"
+
+namespace hg {
+
+const uint32_t DAY_MS = 86400000;
+
+// Milliseconds since local midnight
+double timeOfDayMs();
+
+// TSYNC args: seq and the time the request's last byte reaches the device
+std::vector<uint8_t> tsyncArgs(uint8_t seq, int baud);
+
+// TSYNC_FIN args, called right after the TSYNC response was read:
+// seq and the time the device started sending that response
+std::vector<uint8_t> tsyncFinArgs(uint8_t seq, int baud);
+
+// The TSYNC_FIN responses of one sync run as one: the last response with
+// every exchange's step added up, or the first error
+BinaryResponse syncResult(const std::vector<BinaryResponse>& fins);
+
+}
+
+#endif
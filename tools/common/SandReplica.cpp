@@ -0,0 +1,77 @@
+#include "SandReplica.h"
+
+#include <string.h>
+
+#include "BinaryOpcodes.h"
+
+namespace hg {
+
+SandReplica::SandReplica()
+    : steps(0), frames(0), checks(0), mismatches(0), syncs(0), tick(0), synced(false) {
+    memset(frame, 0, sizeof(frame));
+    core.attach(frame, frame + 8);
+}
+
+void SandReplica::stepTo(uint16_t target) {
+    while ((int16_t)(target - tick) > 0) {
+        tick++;
+        steps++;
+        if (core.step()) emitFrame();
+    }
+}
+
+void SandReplica::emitFrame() {
+    frames++;
+    if (onFrame) onFrame(tick, frame);
+}
+
+bool SandReplica::diverge() {
+    synced = false;
+    return false;
+}
+
+bool SandReplica::apply(const std::vector<uint8_t>& record) {
+    if (record.size() < 3) return !synced || diverge();
+    uint8_t kind = record[0];
+    uint16_t at = record[1] | (record[2] << 8);
+
+    if (kind == SAND_SYNC) {
+        if (record.size() < SAND_SYNC_PAYLOAD) return diverge();
+        core.seed(record[3] | (record[4] << 8));
+        core.setMotion(record[5] | (record[6] << 8));
+        memcpy(frame, &record[7], 16);
+        tick = at;
+        synced = true;
+        syncs++;
+        emitFrame();
+        return true;
+    }
+    if (!synced) return true;
+
+    switch (kind) {
+        case SAND_MOTION:
+            // Set before the step of its tick, which must not have run yet
+            if (record.size() < 5 || (int16_t)(at - tick) < 1) return diverge();
+            stepTo(at - 1);
+            core.setMotion(record[3] | (record[4] << 8));
+            return true;
+        case SAND_DROP:
+            if ((int16_t)(at - tick) < 0) return diverge();
+            stepTo(at);
+            if (!core.dropGrain()) return diverge();
+            emitFrame();
+            return true;
+        case SAND_CHECK:
+            if (record.size() < 4 || (int16_t)(at - tick) < 0) return diverge();
+            stepTo(at);
+            checks++;
+            if (core.checksum() != record[3]) {
+                mismatches++;
+                return diverge();
+            }
+            return true;
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef SAND_REPLICA_H
+#define SAND_REPLICA_H
+
+/*
+ * Host mirror of the hourglass sand (see firmware/main/SandMirror.h).
+ * Runs the firmware's own SandCore on the records the device sends, so
+ * it passes through the same frames as the device without them being
+ * sent. Checksums the device sends now and then are compared against
+ * the replica's state; on a mismatch it waits for the next SYNC.
+ */
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+
+#include "SandCore.h"
+
+namespace hg {
+
+class SandReplica {
+public:
+    SandReplica();
+
+    // Applies one BIN_OP_SAND_EVENT payload. Returns false when the
+    // replica has diverged: a checksum disagreed or a record could not
+    // be placed. Records are ignored until a SYNC arrives
+    bool apply(const std::vector<uint8_t>& record);
+
+    bool isSynced() const { return synced; }
+    uint16_t getTick() const { return tick; }
+
+    // A rows then B rows, as PUSH_FRAME takes them
+    const uint8_t* rows() const { return frame; }
+
+    // Called for every frame the replica's state passes through
+    std::function<void(uint16_t tick, const uint8_t* rows)> onFrame;
+
+    unsigned long steps;
+    unsigned long frames;
+    unsigned long checks;
+    unsigned long mismatches;
+    unsigned long syncs;
+
+private:
+    // Runs the steps of every tick up to and including target
+    void stepTo(uint16_t target);
+    void emitFrame();
+    bool diverge();
+
+    SandCore core;
+    uint8_t frame[16];
+    uint16_t tick;  // Last tick whose step has run
+    bool synced;
+};
+
+}
+
+#endif
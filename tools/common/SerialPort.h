@@ -0,0 +1,20 @@
+#ifndef SERIAL_PORT_H
+#define SERIAL_PORT_H
+
+/*
+ * Raw 8N1 serial port for the host tools.
+ */
+
+#include <string>
+
+namespace hg {
+
+// Opens the port non-blocking in raw mode. Returns the fd, or -1 with errno set
+int openSerialPort(const std::string& path, int baud);
+
+// Writes everything, waiting on a non-blocking fd if needed. Returns false on error
+bool writeAll(int fd, const void* data, size_t size);
+
+}
+
+#endif
@@ -0,0 +1,129 @@
+#include "TraceDump.h"
+
+#include <stdio.h>
+
+#include "BinaryOpcodes.h"
+#include "Commands.h"
+
+namespace hg {
+
+namespace {
+
+const char* TRACE_NAMES[] = { "gap", "boot", "mode", "command", "gesture", "overrun",
+                              "queue-full", "i2c-fail", "drop", "error" };
+const size_t TRACE_NAME_COUNT = sizeof(TRACE_NAMES) / sizeof(TRACE_NAMES[0]);
+
+// CMD_*, EVENT_* and GESTURE_* in EventBus.h, by value
+const char* COMMAND_NAMES[] = { "?", "SET_MODE", "SET_BRIGHTNESS", "SET_TIME", "SET_HG",
+                                "RESET_HG", "HG_START_AT", "ROLL_DICE", "RESET_FLIP",
+                                "HG_PAUSE", "HG_RESUME", "SET_SCRUB" };
+const size_t COMMAND_COUNT = sizeof(COMMAND_NAMES) / sizeof(COMMAND_NAMES[0]);
+
+const char* EVENT_NAMES[] = { "edge", "button", "gesture", "orientation", "command", "timer" };
+const size_t EVENT_COUNT = sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0]);
+
+const char* GESTURE_NAMES[] = { "?", "shake", "flip" };
+
+uint32_t u16(const std::vector<uint8_t>& p, size_t at) {
+    return p[at] | (p[at + 1] << 8);
+}
+
+uint32_t u32(const std::vector<uint8_t>& p, size_t at) {
+    return u16(p, at) | (u16(p, at + 2) << 16);
+}
+
+// ms the record stands for between its predecessor and itself
+uint32_t span(const TraceRecord& r) {
+    return r.id == TRACE_GAP ? r.delta * 1000UL : r.delta;
+}
+
+std::string describe(const TraceRecord& r) {
+    char buf[64];
+    switch (r.id) {
+        case TRACE_GAP:
+            snprintf(buf, sizeof(buf), "%u s without records", r.delta);
+            return buf;
+        case TRACE_BOOT: {
+            // AVR MCUSR bits: PORF, EXTRF, BORF, WDRF
+            static const char* causes[] = { "power-on", "external", "brown-out", "watchdog" };
+            std::string out;
+            for (int i = 0; i < 4; i++) {
+                if (!(r.arg & (1 << i))) continue;
+                if (!out.empty()) out += ',';
+                out += causes[i];
+            }
+            return out.empty() ? "reset flags cleared" : out;
+        }
+        case TRACE_MODE:
+            return modeName(r.arg);
+        case TRACE_COMMAND:
+            if (r.arg < COMMAND_COUNT) return COMMAND_NAMES[r.arg];
+            break;
+        case TRACE_GESTURE:
+            if (r.arg < 3) return GESTURE_NAMES[r.arg];
+            break;
+        case TRACE_OVERRUN:
+            snprintf(buf, sizeof(buf), "%u ms over the tick period%s", r.arg, r.arg == 255 ? " or more" : "");
+            return buf;
+        case TRACE_QUEUE_FULL:
+            if (r.arg < EVENT_COUNT) return EVENT_NAMES[r.arg];
+            break;
+        case TRACE_I2C_FAIL:
+            snprintf(buf, sizeof(buf), "code %u", r.arg);
+            return buf;
+        case TRACE_DROP:
+            if (r.arg == TRACE_DROP_IMU) return "imu sample";
+            if (r.arg == TRACE_DROP_STREAM) return "stream underrun";
+            if (r.arg == TRACE_DROP_SAND) return "sand mirror record";
+            break;
+        case TRACE_ERROR:
+            return r.arg ? statusText(r.arg) : "text ERR";
+    }
+    snprintf(buf, sizeof(buf), "%u", r.arg);
+    return buf;
+}
+
+}
+
+TraceDump::TraceDump() : first(0), written(0), uptime(0), age(0), started(false) {}
+
+bool TraceDump::add(const std::vector<uint8_t>& p) {
+    if (p.size() < 12 || (p.size() - 12) % 4) return false;
+    uint16_t from = u16(p, 0);
+    if (!started) {
+        first = from;
+        written = u16(p, 2);
+        uptime = u32(p, 4);
+        age = u32(p, 8);
+        started = true;
+    } else if (from != next()) {
+        return false;
+    }
+    for (size_t at = 12; at < p.size() && next() != written; at += 4) {
+        TraceRecord r = { (uint16_t)u16(p, at), p[at + 2], p[at + 3] };
+        records.push_back(r);
+    }
+    return true;
+}
+
+std::vector<std::string> TraceDump::timeline() const {
+    // Anchored on the newest record and walked back through the deltas
+    std::vector<uint32_t> at(records.size());
+    uint32_t t = uptime - age;
+    for (size_t i = records.size(); i-- > 0;) {
+        at[i] = t;
+        t -= span(records[i]);
+    }
+
+    std::vector<std::string> lines;
+    for (size_t i = 0; i < records.size(); i++) {
+        const TraceRecord& r = records[i];
+        char head[48];
+        snprintf(head, sizeof(head), "%10u.%03u  %-10s  ", at[i] / 1000, at[i] % 1000,
+                 r.id < TRACE_NAME_COUNT ? TRACE_NAMES[r.id] : "?");
+        lines.push_back(head + describe(r));
+    }
+    return lines;
+}
+
+}
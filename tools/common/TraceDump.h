@@ -0,0 +1,51 @@
+#ifndef TRACE_DUMP_H
+#define TRACE_DUMP_H
+
+/*
+ * Host side of DUMP_TRACE (see firmware/main/TraceRing.h). Collects the
+ * responses of one dump and turns the delta-stamped records into a
+ * timeline on the device's uptime clock.
+ */
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace hg {
+
+struct TraceRecord {
+    uint16_t delta;  // ms since the previous record, seconds for TRACE_GAP
+    uint8_t id;
+    uint8_t arg;
+};
+
+class TraceDump {
+public:
+    TraceDump();
+
+    // Adds one DUMP_TRACE response payload. The first one fixes the
+    // snapshot; later ones must carry on where the last one stopped.
+    // Returns false otherwise (records were overwritten meanwhile, so
+    // the dump has to start over)
+    bool add(const std::vector<uint8_t>& payload);
+
+    // The record number to ask for next, and whether that is all of it
+    uint16_t next() const { return (uint16_t)(first + records.size()); }
+    bool complete() const { return started && next() == written; }
+
+    // One line per record, oldest first: uptime in seconds, what, detail
+    std::vector<std::string> timeline() const;
+
+    uint16_t first;    // Number of records[0]
+    uint16_t written;  // Records since boot when the dump started
+    uint32_t uptime;   // Device millis() when the dump started
+    uint32_t age;      // ms from the newest record to then
+    std::vector<TraceRecord> records;
+
+private:
+    bool started;
+};
+
+}
+
+#endif
@@ -0,0 +1,220 @@
+/*
+ * hganim - assembler for the firmware's animation VM.
+ *
+ *   hganim SOURCE.hga OUT.bin
+ *
+ * One instruction per line, mnemonics as in AnimationOpcodes.h without
+ * the ANIM_OP_ prefix. "name:" defines a label, ";" starts a comment.
+ * Numbers may be decimal, 0x hex or 0b binary. Jump operands are labels
+ * or addresses; a BLIT operand naming a DATA line points at its bytes.
+ *
+ *   loop:   PUSH 0
+ *           BLIT heart
+ *           PUSH 200
+ *           WAIT
+ *           JMP loop
+ *   heart:  DATA 0b01100110 0b11111111 0b11111111 0b01111110
+ *                0b00111100 0b00011000 0 0
+ */
+
+#include "AnimationOpcodes.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum Operand { NONE, U8, I16, ADDR, BYTES };
+
+struct Mnemonic {
+    const char* name;
+    uint8_t opcode;
+    Operand operand;
+};
+
+const Mnemonic MNEMONICS[] = {
+    { "HALT", ANIM_OP_HALT, NONE },     { "PUSH", ANIM_OP_PUSH, U8 },
+    { "PUSH16", ANIM_OP_PUSH16, I16 },  { "DUP", ANIM_OP_DUP, NONE },
+    { "DROP", ANIM_OP_DROP, NONE },     { "SWAP", ANIM_OP_SWAP, NONE },
+    { "ADD", ANIM_OP_ADD, NONE },       { "SUB", ANIM_OP_SUB, NONE },
+    { "EQ", ANIM_OP_EQ, NONE },         { "LT", ANIM_OP_LT, NONE },
+    { "RAND", ANIM_OP_RAND, NONE },     { "CLEAR", ANIM_OP_CLEAR, NONE },
+    { "SETROW", ANIM_OP_SETROW, NONE }, { "GETROW", ANIM_OP_GETROW, NONE },
+    { "BLIT", ANIM_OP_BLIT, ADDR },     { "SHIFT", ANIM_OP_SHIFT, NONE },
+    { "INVERT", ANIM_OP_INVERT, NONE }, { "WAIT", ANIM_OP_WAIT, NONE },
+    { "JMP", ANIM_OP_JMP, ADDR },       { "JZ", ANIM_OP_JZ, ADDR },
+    { "JNZ", ANIM_OP_JNZ, ADDR },       { "LOOP", ANIM_OP_LOOP, ADDR },
+    { "ORIENT", ANIM_OP_ORIENT, NONE }, { "ANGLE", ANIM_OP_ANGLE, NONE },
+    { "DATA", ANIM_OP_DATA, BYTES },
+};
+
+struct Line {
+    int number;
+    const Mnemonic* mnemonic;
+    std::vector<std::string> args;
+    uint16_t address;
+};
+
+bool parseNumber(const std::string& text, long* out) {
+    const char* s = text.c_str();
+    bool negative = *s == '-';
+    if (negative) s++;
+    char* end;
+    errno = 0;
+    long value = (!strncasecmp(s, "0b", 2)) ? strtol(s + 2, &end, 2) : strtol(s, &end, 0);
+    if (errno || *end || end == s) return false;
+    *out = negative ? -value : value;
+    return true;
+}
+
+bool isSeparator(char c) {
+    return isspace((unsigned char)c) || c == ',';
+}
+
+std::vector<std::string> tokenize(const std::string& text) {
+    std::vector<std::string> words;
+    size_t i = 0;
+    while (i < text.size()) {
+        while (i < text.size() && isSeparator(text[i])) i++;
+        size_t start = i;
+        while (i < text.size() && !isSeparator(text[i])) i++;
+        if (i > start) words.push_back(text.substr(start, i - start));
+    }
+    return words;
+}
+
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: hganim SOURCE.hga OUT.bin\n");
+        return 2;
+    }
+    FILE* in = fopen(argv[1], "r");
+    if (!in) {
+        fprintf(stderr, "hganim: %s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+
+    // Pass 1: parse, assign addresses and collect labels
+    std::vector<Line> lines;
+    std::map<std::string, uint16_t> labels;
+    std::map<std::string, bool> dataLabels;
+    std::vector<std::string> pending;
+    char buf[512];
+    int number = 0;
+    int errors = 0;
+    uint32_t address = 0;
+    while (fgets(buf, sizeof(buf), in)) {
+        number++;
+        std::string text(buf);
+        size_t comment = text.find(';');
+        if (comment != std::string::npos) text.erase(comment);
+        std::vector<std::string> words = tokenize(text);
+        while (!words.empty() && words[0].back() == ':') {
+            std::string name = words[0].substr(0, words[0].size() - 1);
+            if (labels.count(name)) {
+                fprintf(stderr, "%s:%d: duplicate label %s\n", argv[1], number, name.c_str());
+                errors++;
+            }
+            labels[name] = address;
+            pending.push_back(name);
+            words.erase(words.begin());
+        }
+        // DATA rows may continue on lines without a mnemonic
+        if (!words.empty() && !lines.empty() && lines.back().mnemonic->operand == BYTES &&
+            (isdigit((unsigned char)words[0][0]) || words[0][0] == '-')) {
+            lines.back().args.insert(lines.back().args.end(), words.begin(), words.end());
+            address += words.size();
+            continue;
+        }
+        if (words.empty()) continue;
+
+        const Mnemonic* mnemonic = NULL;
+        for (const Mnemonic& m : MNEMONICS) {
+            if (!strcasecmp(m.name, words[0].c_str())) mnemonic = &m;
+        }
+        if (!mnemonic) {
+            fprintf(stderr, "%s:%d: unknown instruction %s\n", argv[1], number, words[0].c_str());
+            errors++;
+            continue;
+        }
+        for (const std::string& name : pending) dataLabels[name] = mnemonic->operand == BYTES;
+        pending.clear();
+
+        Line line = { number, mnemonic, std::vector<std::string>(words.begin() + 1, words.end()), (uint16_t)address };
+        size_t expected = mnemonic->operand == NONE ? 0 : 1;
+        if (mnemonic->operand != BYTES && line.args.size() != expected) {
+            fprintf(stderr, "%s:%d: %s takes %zu operand(s)\n", argv[1], number, mnemonic->name, expected);
+            errors++;
+        }
+        static const int sizes[] = { 1, 2, 3, 3, 2 };
+        address += sizes[mnemonic->operand] + (mnemonic->operand == BYTES ? line.args.size() : 0);
+        lines.push_back(line);
+    }
+    fclose(in);
+
+    // Pass 2: encode
+    std::vector<uint8_t> out;
+    for (const Line& line : lines) {
+        out.push_back(line.mnemonic->opcode);
+        long value = 0;
+        switch (line.mnemonic->operand) {
+            case NONE:
+                break;
+            case U8:
+            case I16:
+                if (line.args.empty() || !parseNumber(line.args[0], &value) ||
+                    (line.mnemonic->operand == U8 ? (value < 0 || value > 255) : (value < -32768 || value > 32767))) {
+                    fprintf(stderr, "%s:%d: bad operand\n", argv[1], line.number);
+                    errors++;
+                }
+                out.push_back(value & 0xFF);
+                if (line.mnemonic->operand == I16) out.push_back((value >> 8) & 0xFF);
+                break;
+            case ADDR:
+                if (!line.args.empty() && labels.count(line.args[0])) {
+                    value = labels[line.args[0]];
+                    if (line.mnemonic->opcode == ANIM_OP_BLIT && dataLabels[line.args[0]]) value += 2;
+                } else if (line.args.empty() || !parseNumber(line.args[0], &value)) {
+                    fprintf(stderr, "%s:%d: unknown label\n", argv[1], line.number);
+                    errors++;
+                }
+                out.push_back(value & 0xFF);
+                out.push_back((value >> 8) & 0xFF);
+                break;
+            case BYTES:
+                if (line.args.size() > 255) {
+                    fprintf(stderr, "%s:%d: DATA holds at most 255 bytes\n", argv[1], line.number);
+                    errors++;
+                }
+                out.push_back(line.args.size() & 0xFF);
+                for (const std::string& arg : line.args) {
+                    if (!parseNumber(arg, &value) || value < 0 || value > 255) {
+                        fprintf(stderr, "%s:%d: bad byte %s\n", argv[1], line.number, arg.c_str());
+                        errors++;
+                    }
+                    out.push_back(value & 0xFF);
+                }
+                break;
+        }
+    }
+    if (errors) return 1;
+
+    FILE* bin = fopen(argv[2], "wb");
+    if (!bin || fwrite(out.data(), 1, out.size(), bin) != out.size() || fclose(bin) != 0) {
+        fprintf(stderr, "hganim: %s: %s\n", argv[2], strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "hganim: %zu bytes\n", out.size());
+    return 0;
+}
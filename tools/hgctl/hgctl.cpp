@@ -0,0 +1,430 @@
+/*
+ * hgctl - control a device over the binary protocol.
+ *
+ *   hgctl [--baud N] [--no-reset-wait] PORT [COMMAND [ARGS...]]
+ *
+ * COMMAND uses the text protocol's names (GET_STATUS, SET_TIME 14 30,
+ * ...). Without one, commands are read from stdin, one per line. Each
+ * response is printed as JSON. The link is switched to binary mode on
+ * start and back to text on exit.
+ *
+ * STREAM_IMU HZ prints one CSV line per sample until Ctrl-C:
+ *   seq,ms,dropped,decimation,ax,ay,az,gx,gy,gz
+ *
+ * ANIM_UPLOAD FILE uploads an animation program built by tools/hganim,
+ * ANIM_INFO shows the VM state.
+ *
+ * PLAY FILE streams frames (one line of 32 hex digits each, A rows then
+ * B rows) into the device's frame queue, backing off while it is full.
+ *
+ * SYNC [ROUNDS] runs TSYNC exchanges (default 8) against the host's time
+ * of day and prints the device's estimate. Run it every few minutes: the
+ * drift rate is only fitted once the samples span 30 s.
+ *
+ * MIRROR [SECONDS] runs the hourglass sand on the host from the device's
+ * mirror feed and prints every frame it passes through in PLAY's format,
+ * until Ctrl-C or for SECONDS, then the totals.
+ *
+ * DUMP_TRACE reads the device's event trace ring and prints it as a
+ * timeline on the device's uptime clock, oldest first.
+ */
+
+#include "BinaryLink.h"
+#include "Commands.h"
+#include "HostClock.h"
+#include "SandReplica.h"
+#include "TraceDump.h"
+#include "SerialPort.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+volatile sig_atomic_t stopRequested = 0;
+
+void onSignal(int) { stopRequested = 1; }
+
+void printResponse(const hg::BinaryResponse& r) {
+    printf("%s\n", hg::formatResponse(r).c_str());
+}
+
+class Link {
+public:
+    Link(int fd) : fd(fd), sent(0), received(0) {}
+
+    // Sends a request and waits for the matching response
+    bool transact(uint8_t opcode, const std::vector<uint8_t>& args, hg::BinaryResponse& out) {
+        return send(opcode, args) && waitFor(opcode, out);
+    }
+
+    // Sends a request, leaving the response to whoever reads next
+    bool send(uint8_t opcode, const std::vector<uint8_t>& args) {
+        std::vector<uint8_t> frame = hg::encodeRequest(opcode, args.data(), args.size());
+        if (!hg::writeAll(fd, frame.data(), frame.size())) return false;
+        sent += frame.size();
+        return true;
+    }
+
+    bool waitFor(uint8_t opcode, hg::BinaryResponse& out) {
+        while (!stopRequested) {
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            int n = poll(&pfd, 1, 1000);
+            if (n == 0) return false;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            uint8_t c;
+            while (read(fd, &c, 1) == 1) {
+                received++;
+                if (!reader.feed(c, out)) continue;
+                if (out.opcode == opcode || out.opcode == BIN_OP_NAK) return true;
+                if (out.opcode == BIN_OP_IMU_SAMPLE) printResponse(out);
+            }
+        }
+        return false;
+    }
+
+    // Prints streamed IMU samples until Ctrl-C
+    void printSamples() {
+        while (!stopRequested) {
+            struct pollfd pfd = { fd, POLLIN, 0 };
+            if (poll(&pfd, 1, 200) <= 0) continue;
+            uint8_t c;
+            hg::BinaryResponse sample;
+            while (read(fd, &c, 1) == 1) {
+                received++;
+                if (reader.feed(c, sample) && sample.opcode == BIN_OP_IMU_SAMPLE) printResponse(sample);
+            }
+            fflush(stdout);
+        }
+    }
+
+    int fd;
+    unsigned long sent;
+    unsigned long received;
+    hg::FrameReader reader;
+};
+
+bool uploadAnimation(Link& link, const char* path) {
+    FILE* in = fopen(path, "rb");
+    if (!in) {
+        printf("ERR %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    std::vector<uint8_t> program;
+    int c;
+    while ((c = fgetc(in)) != EOF) program.push_back((uint8_t)c);
+    fclose(in);
+
+    // Offset plus data must fit a frame with the opcode and CRC
+    const size_t chunk = BIN_MAX_FRAME - 4;
+    hg::BinaryResponse response;
+    for (size_t offset = 0; offset < program.size(); offset += chunk) {
+        size_t len = std::min(chunk, program.size() - offset);
+        std::vector<uint8_t> args;
+        args.push_back(offset & 0xFF);
+        args.push_back(offset >> 8);
+        args.insert(args.end(), program.begin() + offset, program.begin() + offset + len);
+        if (!link.transact(BIN_OP_ANIM_WRITE, args, response)) {
+            printf("ERR No response\n");
+            return false;
+        }
+        if (response.status != BIN_OK) {
+            printResponse(response);
+            return false;
+        }
+    }
+
+    uint8_t commit[3] = { (uint8_t)(program.size() & 0xFF), (uint8_t)(program.size() >> 8),
+                          hg::crc8(program.data(), program.size()) };
+    if (!link.transact(BIN_OP_ANIM_COMMIT, std::vector<uint8_t>(commit, commit + 3), response)) {
+        printf("ERR No response\n");
+        return false;
+    }
+    printResponse(response);
+    return response.status == BIN_OK;
+}
+
+bool playFrames(Link& link, const char* path) {
+    FILE* in = fopen(path, "r");
+    if (!in) {
+        printf("ERR %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    hg::BinaryResponse response;
+    if (!link.transact(BIN_OP_STREAM_INFO, std::vector<uint8_t>(), response) ||
+        response.status != BIN_OK || response.payload.size() < 7) {
+        printf("ERR No response\n");
+        fclose(in);
+        return false;
+    }
+    unsigned periodUs = 1000000 / (response.payload[2] ? response.payload[2] : 1);
+
+    char line[128];
+    int number = 0;
+    unsigned long frames = 0;
+    std::vector<uint8_t> frame;
+    while (!stopRequested && fgets(line, sizeof(line), in)) {
+        number++;
+        if (line[0] == '#' || line[0] == '\n') continue;
+        if (!hg::parseFrame(line, frame)) {
+            printf("ERR %s:%d: expected 32 hex digits\n", path, number);
+            fclose(in);
+            return false;
+        }
+        // The device answers "full" with its fill level; wait out one frame and retry
+        for (;;) {
+            if (!link.transact(BIN_OP_PUSH_FRAME, frame, response)) {
+                printf("ERR No response\n");
+                fclose(in);
+                return false;
+            }
+            if (response.status != BIN_ERR_FULL || stopRequested) break;
+            usleep(periodUs);
+        }
+        frames++;
+    }
+    fclose(in);
+    printf("{\"frames\":%lu}\n", frames);
+    return true;
+}
+
+bool syncClock(Link& link, int baud, int rounds) {
+    hg::BinaryResponse response;
+    std::vector<hg::BinaryResponse> fins;
+    for (int i = 0; i < rounds && !stopRequested; i++) {
+        uint8_t seq = (uint8_t)i;
+        if (!link.transact(BIN_OP_TSYNC, hg::tsyncArgs(seq, baud), response)) {
+            printf("ERR No response\n");
+            return false;
+        }
+        // Stamp the response before anything else delays it
+        std::vector<uint8_t> fin = hg::tsyncFinArgs(seq, baud);
+        if (response.status != BIN_OK) {
+            printResponse(response);
+            return false;
+        }
+        if (!link.transact(BIN_OP_TSYNC_FIN, fin, response)) {
+            printf("ERR No response\n");
+            return false;
+        }
+        fins.push_back(response);
+        if (response.status != BIN_OK) break;
+    }
+    if (fins.empty()) return false;
+    response = hg::syncResult(fins);
+    printResponse(response);
+    return response.status == BIN_OK;
+}
+
+bool mirrorSand(Link& link, int seconds) {
+    hg::BinaryResponse response;
+    std::vector<uint8_t> on(1, 1);
+    if (!link.transact(BIN_OP_SAND_MIRROR, on, response) || response.status != BIN_OK) {
+        printf("ERR No mirror feed\n");
+        return false;
+    }
+
+    hg::SandReplica replica;
+    replica.onFrame = [](uint16_t, const uint8_t* rows) {
+        for (int i = 0; i < 16; i++) printf("%02x", rows[i]);
+        printf("\n");
+    };
+    unsigned long records = 0;
+    unsigned long startBytes = link.received;
+    time_t end = time(NULL) + seconds;
+    while (!stopRequested && (seconds == 0 || time(NULL) < end)) {
+        struct pollfd pfd = { link.fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) <= 0) continue;
+        uint8_t c;
+        hg::BinaryResponse record;
+        while (read(link.fd, &c, 1) == 1) {
+            link.received++;
+            if (!link.reader.feed(c, record) || record.opcode != BIN_OP_SAND_EVENT) continue;
+            records++;
+            // Diverged: restarting the feed makes the device send a SYNC
+            if (!replica.apply(record.payload)) link.send(BIN_OP_SAND_MIRROR, on);
+        }
+        fflush(stdout);
+    }
+    stopRequested = 0;
+
+    std::vector<uint8_t> off(1, 0);
+    unsigned long sent = 0;
+    if (link.transact(BIN_OP_SAND_MIRROR, off, response) && response.payload.size() >= 8) {
+        const std::vector<uint8_t>& p = response.payload;
+        sent = p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+    }
+    fprintf(stderr, "{\"sent\":%lu,\"records\":%lu,\"bytes\":%lu,\"frames\":%lu,\"steps\":%lu,"
+            "\"checks\":%lu,\"mismatches\":%lu,\"syncs\":%lu}\n",
+            sent, records, link.received - startBytes, replica.frames, replica.steps,
+            replica.checks, replica.mismatches, replica.syncs);
+    return true;
+}
+
+bool dumpTrace(Link& link) {
+    // Records logged while reading can push out ones not read yet; start over then
+    for (int attempt = 0; attempt < 3; attempt++) {
+        hg::TraceDump dump;
+        hg::BinaryResponse response;
+        bool ok = true;
+        do {
+            uint8_t from[2] = { (uint8_t)(dump.next() & 0xFF), (uint8_t)(dump.next() >> 8) };
+            if (!link.transact(BIN_OP_DUMP_TRACE, std::vector<uint8_t>(from, from + 2), response)) {
+                printf("ERR No response\n");
+                return false;
+            }
+            if (response.status != BIN_OK) {
+                printf("%s\n", hg::formatResponse(response).c_str());
+                return false;
+            }
+            ok = dump.add(response.payload);
+        } while (ok && !dump.complete());
+        if (!ok) continue;
+
+        printf("# %u records, %u since boot, uptime %u.%03u s\n", (unsigned)dump.records.size(),
+               dump.written, dump.uptime / 1000, dump.uptime % 1000);
+        std::vector<std::string> lines = dump.timeline();
+        for (size_t i = 0; i < lines.size(); i++) printf("%s\n", lines[i].c_str());
+        return true;
+    }
+    printf("ERR Trace kept changing while being read\n");
+    return false;
+}
+
+bool runCommand(Link& link, int baud, const std::vector<std::string>& words) {
+    if (!strcasecmp(words[0].c_str(), "PLAY")) {
+        if (words.size() != 2) {
+            printf("ERR Usage: PLAY FILE\n");
+            return false;
+        }
+        return playFrames(link, words[1].c_str());
+    }
+    if (!strcasecmp(words[0].c_str(), "ANIM_UPLOAD")) {
+        if (words.size() != 2) {
+            printf("ERR Usage: ANIM_UPLOAD FILE\n");
+            return false;
+        }
+        return uploadAnimation(link, words[1].c_str());
+    }
+    if (!strcasecmp(words[0].c_str(), "SYNC")) {
+        int rounds = words.size() > 1 ? atoi(words[1].c_str()) : 8;
+        if (words.size() > 2 || rounds < 1) {
+            printf("ERR Usage: SYNC [ROUNDS]\n");
+            return false;
+        }
+        return syncClock(link, baud, rounds);
+    }
+    if (!strcasecmp(words[0].c_str(), "DUMP_TRACE")) {
+        if (words.size() != 1) {
+            printf("ERR DUMP_TRACE takes 0 argument(s)\n");
+            return false;
+        }
+        return dumpTrace(link);
+    }
+    if (!strcasecmp(words[0].c_str(), "MIRROR")) {
+        int seconds = words.size() > 1 ? atoi(words[1].c_str()) : 0;
+        if (words.size() > 2 || seconds < 0) {
+            printf("ERR Usage: MIRROR [SECONDS]\n");
+            return false;
+        }
+        return mirrorSand(link, seconds);
+    }
+
+    hg::Request request;
+    std::string error;
+    if (!hg::parseCommand(words, request, error)) {
+        printf("%s\n", error.c_str());
+        return false;
+    }
+    const std::vector<uint8_t>& args = request.args;
+
+    hg::BinaryResponse response;
+    if (!link.transact(request.opcode, args, response)) {
+        printf("ERR No response\n");
+        return false;
+    }
+    printResponse(response);
+    if (request.opcode == BIN_OP_STREAM_IMU && response.status == BIN_OK && (args[0] | args[1])) {
+        link.printSamples();
+        stopRequested = 0;
+        uint8_t stop[2] = { 0, 0 };
+        if (link.transact(BIN_OP_STREAM_IMU, std::vector<uint8_t>(stop, stop + 2), response)) {
+            printResponse(response);
+        }
+    }
+    return response.status == BIN_OK;
+}
+
+}
+
+int main(int argc, char** argv) {
+    int baud = 9600;
+    bool resetWait = true;
+    const char* port = NULL;
+    std::vector<std::string> words;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--baud") && i + 1 < argc) baud = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--no-reset-wait")) resetWait = false;
+        else if (!port) port = argv[i];
+        else words.push_back(argv[i]);
+    }
+    if (!port) {
+        fprintf(stderr, "usage: hgctl [--baud N] [--no-reset-wait] PORT [COMMAND [ARGS...]]\n");
+        return 2;
+    }
+
+    int fd = hg::openSerialPort(port, baud);
+    if (fd < 0) {
+        fprintf(stderr, "hgctl: %s: %s\n", port, strerror(errno));
+        return 1;
+    }
+    // Opening the port resets the Nano through DTR; give it time to boot
+    if (resetWait) sleep(2);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    Link link(fd);
+    uint8_t magic = BIN_MAGIC;
+    hg::BinaryResponse hello;
+    if (!hg::writeAll(fd, &magic, 1) || !link.waitFor(BIN_OP_HELLO, hello)) {
+        fprintf(stderr, "hgctl: no binary protocol on %s\n", port);
+        return 1;
+    }
+    link.sent++;
+
+    bool ok = true;
+    if (!words.empty()) {
+        ok = runCommand(link, baud, words);
+    } else {
+        char line[128];
+        while (fgets(line, sizeof(line), stdin)) {
+            std::vector<std::string> lineWords = hg::splitWords(line);
+            if (lineWords.empty()) continue;
+            ok = runCommand(link, baud, lineWords) && ok;
+            fflush(stdout);
+        }
+    }
+
+    hg::BinaryResponse bye;
+    link.transact(BIN_OP_EXIT, std::vector<uint8_t>(), bye);
+    close(fd);
+    fprintf(stderr, "hgctl: %lu bytes sent, %lu received, %lu bad frames\n",
+            link.sent, link.received, link.reader.badFrames);
+    return ok ? 0 : 1;
+}
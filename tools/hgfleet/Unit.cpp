@@ -0,0 +1,197 @@
+#include "Unit.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "HostClock.h"
+#include "SerialPort.h"
+
+namespace hgfleet {
+
+namespace {
+
+const unsigned RESET_WAIT_MS = 2000;  // The Nano reboots when the port opens
+const unsigned HELLO_MS = 2000;
+
+}
+
+Unit::Unit(const std::string& path, const Options& options, ResultFn result)
+    : path_(path), options(options), result(result), fd_(-1), state(UNIT_DONE),
+      reachable(false), deadline_(0), jobs(NULL), job(0), step(0), attempts(0), jobRetries(0) {}
+
+void Unit::start(const std::vector<Job>& jobs, uint64_t nowMs) {
+    this->jobs = &jobs;
+    job = 0;
+    step = 0;
+    jobRetries = 0;
+    if (jobs.empty()) return;
+
+    fd_ = hg::openSerialPort(path_, options.baud);
+    if (fd_ < 0) {
+        failRemaining(std::string("ERR ") + strerror(errno));
+        return;
+    }
+    state = UNIT_RESET_WAIT;
+    deadline_ = nowMs + (options.resetWait ? RESET_WAIT_MS : 0);
+}
+
+void Unit::send(const hg::Request& request) {
+    std::vector<uint8_t> frame = hg::encodeRequest(request.opcode, request.args.data(), request.args.size());
+    out.insert(out.end(), frame.begin(), frame.end());
+}
+
+void Unit::sendCurrent(uint64_t nowMs) {
+    hg::Request request = (*jobs)[job].requests[step];
+    uint8_t seq = (uint8_t)(step / 2);
+    if (request.opcode == BIN_OP_TSYNC) request.args = hg::tsyncArgs(seq, options.baud);
+    else if (request.opcode == BIN_OP_TSYNC_FIN) request.args = hg::tsyncFinArgs(seq, options.baud);
+    send(request);
+    deadline_ = nowMs + options.timeoutMs;
+    // Don't let the timestamp wait for the next epoll round
+    if (request.opcode == BIN_OP_TSYNC) onWritable();
+}
+
+void Unit::onWritable() {
+    if (fd_ < 0 || out.empty()) return;
+    ssize_t n = write(fd_, out.data(), out.size());
+    if (n > 0) out.erase(out.begin(), out.begin() + n);
+}
+
+void Unit::onReadable(uint64_t nowMs) {
+    uint8_t buf[256];
+    ssize_t got = read(fd_, buf, sizeof(buf));
+    if (got <= 0) {
+        if (got < 0 && (errno == EAGAIN || errno == EINTR)) return;
+        failRemaining("ERR Port closed");
+        return;
+    }
+    hg::BinaryResponse response;
+    for (ssize_t i = 0; i < got && state != UNIT_DONE; i++) {
+        if (!reader.feed(buf[i], response)) continue;
+        if (state == UNIT_HELLO) {
+            if (response.opcode != BIN_OP_HELLO) continue;
+            reachable = true;
+            state = UNIT_READY;
+            attempts = 0;
+            sendCurrent(nowMs);
+        } else if (state == UNIT_READY) {
+            if (response.opcode == BIN_OP_NAK || response.status == BIN_ERR_CRC) {
+                retry("ERR CRC mismatch", false, nowMs);
+            } else if (response.opcode == (*jobs)[job].requests[step].opcode) {
+                completeStep(response, nowMs);
+            }
+        }
+    }
+}
+
+void Unit::onTimer(uint64_t nowMs) {
+    switch (state) {
+        case UNIT_RESET_WAIT:
+        case UNIT_HELLO:
+            if (state == UNIT_HELLO && ++attempts > options.retries) {
+                failRemaining("ERR No binary protocol");
+                return;
+            }
+            // Ends a frame or leaves binary mode if a previous session
+            // left it on; the text parser ignores these bytes
+            out.push_back(0x00);
+            send(hg::Request{ BIN_OP_EXIT, std::vector<uint8_t>() });
+            out.push_back(BIN_MAGIC);
+            if (state == UNIT_RESET_WAIT) attempts = 0;
+            state = UNIT_HELLO;
+            deadline_ = nowMs + HELLO_MS;
+            break;
+        case UNIT_READY:
+            retry("ERR No response", true, nowMs);
+            break;
+        case UNIT_DONE:
+            break;
+    }
+}
+
+void Unit::retry(const char* error, bool fatal, uint64_t nowMs) {
+    if (++attempts <= options.retries) {
+        jobRetries++;
+        reader = hg::FrameReader();
+        // A lost TSYNC_FIN's stamp is stale; redo the whole exchange
+        if ((*jobs)[job].requests[step].opcode == BIN_OP_TSYNC_FIN) {
+            step--;
+            responses.pop_back();
+        }
+        sendCurrent(nowMs);
+        return;
+    }
+    if (fatal) {
+        // A device that stopped answering won't answer the rest either
+        failRemaining(error);
+        return;
+    }
+    result(*this, job, error, jobRetries);
+    job++;
+    step = 0;
+    attempts = 0;
+    jobRetries = 0;
+    responses.clear();
+    if (job == jobs->size()) finish();
+    else sendCurrent(nowMs);
+}
+
+void Unit::completeStep(const hg::BinaryResponse& response, uint64_t nowMs) {
+    responses.push_back(response);
+    attempts = 0;
+    if (++step < (*jobs)[job].requests.size()) {
+        sendCurrent(nowMs);
+        return;
+    }
+    result(*this, job, jobResult((*jobs)[job], responses), jobRetries);
+    job++;
+    step = 0;
+    jobRetries = 0;
+    responses.clear();
+    if (job == jobs->size()) finish();
+    else sendCurrent(nowMs);
+}
+
+void Unit::failRemaining(const std::string& line) {
+    for (; job < jobs->size(); job++) {
+        result(*this, job, line, jobRetries);
+        jobRetries = 0;
+    }
+    finish();
+}
+
+void Unit::finish() {
+    if (fd_ >= 0) {
+        // Back to the text protocol for whoever opens the port next
+        if (reachable) send(hg::Request{ BIN_OP_EXIT, std::vector<uint8_t>() });
+        hg::writeAll(fd_, out.data(), out.size());
+        close(fd_);
+        fd_ = -1;
+    }
+    out.clear();
+    state = UNIT_DONE;
+    deadline_ = 0;
+}
+
+std::string jobResult(const Job& job, const std::vector<hg::BinaryResponse>& responses) {
+    if (!job.merge) {
+        std::vector<hg::BinaryResponse> fins;
+        for (const hg::BinaryResponse& r : responses) {
+            if (r.status != BIN_OK) return hg::formatResponse(r);
+            if (r.opcode == BIN_OP_TSYNC_FIN) fins.push_back(r);
+        }
+        return hg::formatResponse(fins.empty() ? responses.back() : hg::syncResult(fins));
+    }
+
+    std::string merged;
+    for (const hg::BinaryResponse& r : responses) {
+        std::string line = hg::formatResponse(r);
+        if (r.status != BIN_OK || line[0] != '{') return line;
+        merged += merged.empty() ? "{" : ",";
+        merged += line.substr(1, line.size() - 2);
+    }
+    return merged + "}";
+}
+
+}
@@ -0,0 +1,91 @@
+#ifndef HGFLEET_UNIT_H
+#define HGFLEET_UNIT_H
+
+/*
+ * One device of the fleet: its port, link handshake and command queue.
+ * Units never block; the event loop calls them when their fd is ready
+ * or their deadline passes.
+ */
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "BinaryLink.h"
+#include "Commands.h"
+
+namespace hgfleet {
+
+// A command line and the requests it takes (STATUS and SYNC take several).
+// TSYNC and TSYNC_FIN get their timestamps when they are sent.
+struct Job {
+    std::string text;
+    std::vector<hg::Request> requests;
+    bool merge;     // Report all responses merged, or just the last one
+};
+
+struct Options {
+    int baud;
+    bool resetWait;
+    unsigned timeoutMs;  // Per request attempt
+    unsigned retries;    // Extra attempts after a timeout or a corrupted frame
+};
+
+class Unit {
+public:
+    // Called once per job with its response line and how many requests were resent
+    typedef std::function<void(Unit& unit, size_t job, const std::string& line, unsigned retries)> ResultFn;
+
+    Unit(const std::string& path, const Options& options, ResultFn result);
+
+    const std::string& path() const { return path_; }
+    int fd() const { return fd_; }
+    bool wantsWrite() const { return !out.empty(); }
+    bool isDone() const { return state == UNIT_DONE; }
+    bool wasReachable() const { return reachable; }
+    // When the unit next needs onTimer, 0 for never
+    uint64_t deadline() const { return deadline_; }
+
+    void start(const std::vector<Job>& jobs, uint64_t nowMs);
+    void onReadable(uint64_t nowMs);
+    void onWritable();
+    void onTimer(uint64_t nowMs);
+
+private:
+    enum State { UNIT_RESET_WAIT, UNIT_HELLO, UNIT_READY, UNIT_DONE };
+
+    void send(const hg::Request& request);
+    void sendCurrent(uint64_t nowMs);
+    void retry(const char* error, bool fatal, uint64_t nowMs);
+    void completeStep(const hg::BinaryResponse& response, uint64_t nowMs);
+    void failRemaining(const std::string& line);
+    void finish();
+
+    std::string path_;
+    Options options;
+    ResultFn result;
+
+    int fd_;
+    State state;
+    bool reachable;
+    uint64_t deadline_;
+    std::vector<uint8_t> out;
+    hg::FrameReader reader;
+
+    const std::vector<Job>* jobs;
+    size_t job;    // Index of the job being run
+    size_t step;   // Request within it
+    unsigned attempts;      // Of the current request
+    unsigned jobRetries;
+    std::vector<hg::BinaryResponse> responses;
+};
+
+// The response line for a job: the first error, then either the last
+// response or the responses' JSON objects merged into one
+std::string jobResult(const Job& job, const std::vector<hg::BinaryResponse>& responses);
+
+}
+
+#endif
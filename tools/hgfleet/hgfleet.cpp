@@ -0,0 +1,311 @@
+/*
+ * hgfleet - run commands on many devices at once.
+ *
+ *   hgfleet [OPTIONS] PORT... [-- COMMAND [ARGS...]]
+ *
+ *   --ports FILE       read more ports from FILE, one per line
+ *   --baud N           (default 9600)
+ *   --no-reset-wait    don't wait two seconds for a Nano to reboot
+ *   --timeout MS       per request attempt (default 1000)
+ *   --retries N        resends after a timeout or corrupted frame (default 2)
+ *   --quiet            only print the summary
+ *
+ * COMMAND uses the text protocol's names. Without one, commands are read
+ * from stdin, one per line, and every device runs them in order at its
+ * own pace. STATUS collects mode, power state and flip count. SYNC runs
+ * eight TSYNC exchanges against this host's clock, so a following
+ * "HG_START_AT +5" starts every hourglass on the same tick.
+ *
+ * Each response is printed as "PORT<TAB>COMMAND<TAB>RESPONSE" when it
+ * arrives, followed by a JSON summary with the per-command tallies.
+ * All ports are driven from one epoll loop; a device that stops
+ * answering fails its remaining commands without holding up the rest.
+ */
+
+#include "Unit.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace {
+
+volatile sig_atomic_t stopRequested = 0;
+
+void onSignal(int) { stopRequested = 1; }
+
+uint64_t nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Tallies for one command across the fleet
+struct Tally {
+    unsigned ok;
+    unsigned retries;
+    std::vector<std::string> failed;
+    // STATUS only
+    std::map<unsigned, unsigned> modes;
+    unsigned standby;
+    unsigned long flips;
+    // SYNC only: the largest correction a device needed
+    long maxStep;
+};
+
+const int SYNC_ROUNDS = 8;
+
+bool parseJob(const std::string& line, hgfleet::Job& job) {
+    std::vector<std::string> words = hg::splitWords(line.c_str());
+    job.text.clear();
+    for (const std::string& w : words) job.text += (job.text.empty() ? "" : " ") + w;
+    job.requests.clear();
+    job.merge = false;
+
+    if (words.size() == 1 && !strcasecmp(words[0].c_str(), "STATUS")) {
+        static const uint8_t STATUS_OPS[] = { BIN_OP_GET_STATUS, BIN_OP_GET_POWER, BIN_OP_GET_FLIP_COUNT };
+        for (uint8_t op : STATUS_OPS) job.requests.push_back(hg::Request{ op, std::vector<uint8_t>() });
+        job.merge = true;
+        return true;
+    }
+    if (words.size() == 1 && !strcasecmp(words[0].c_str(), "SYNC")) {
+        // Args are filled in by the unit as it sends them
+        for (int i = 0; i < SYNC_ROUNDS; i++) {
+            job.requests.push_back(hg::Request{ BIN_OP_TSYNC, std::vector<uint8_t>() });
+            job.requests.push_back(hg::Request{ BIN_OP_TSYNC_FIN, std::vector<uint8_t>() });
+        }
+        return true;
+    }
+    hg::Request request;
+    std::string error;
+    if (!words.empty() && !strcasecmp(words[0].c_str(), "STREAM_IMU")) {
+        error = "ERR STREAM_IMU needs hgctl";
+    } else if (hg::parseCommand(words, request, error)) {
+        job.requests.push_back(request);
+        return true;
+    }
+    fprintf(stderr, "hgfleet: %s: %s\n", job.text.c_str(), error.c_str());
+    return false;
+}
+
+// Value of "key": in a flat JSON object, or -1
+long jsonNumber(const std::string& json, const char* key) {
+    std::string needle = std::string("\"") + key + "\":";
+    size_t at = json.find(needle);
+    return at == std::string::npos ? -1 : strtol(json.c_str() + at + needle.size(), NULL, 10);
+}
+
+void raiseFdLimit() {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    hgfleet::Options options = { 9600, true, 1000, 2 };
+    bool quiet = false;
+    std::vector<std::string> ports;
+    std::vector<std::string> words;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--")) {
+            words.assign(argv + i + 1, argv + argc);
+            break;
+        }
+        if (!strcmp(argv[i], "--baud") && i + 1 < argc) options.baud = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--no-reset-wait")) options.resetWait = false;
+        else if (!strcmp(argv[i], "--timeout") && i + 1 < argc) options.timeoutMs = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--retries") && i + 1 < argc) options.retries = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--quiet")) quiet = true;
+        else if (!strcmp(argv[i], "--ports") && i + 1 < argc) {
+            FILE* in = fopen(argv[++i], "r");
+            if (!in) {
+                fprintf(stderr, "hgfleet: %s: %s\n", argv[i], strerror(errno));
+                return 1;
+            }
+            char line[256];
+            while (fgets(line, sizeof(line), in)) {
+                std::vector<std::string> w = hg::splitWords(line);
+                if (!w.empty() && w[0][0] != '#') ports.push_back(w[0]);
+            }
+            fclose(in);
+        } else {
+            ports.push_back(argv[i]);
+        }
+    }
+    if (ports.empty() || options.timeoutMs == 0) {
+        fprintf(stderr, "usage: hgfleet [--ports FILE] [--baud N] [--no-reset-wait] [--timeout MS] "
+                        "[--retries N] [--quiet] PORT... [-- COMMAND [ARGS...]]\n");
+        return 2;
+    }
+
+    std::vector<hgfleet::Job> jobs;
+    hgfleet::Job job;
+    if (!words.empty()) {
+        std::string line;
+        for (const std::string& w : words) line += w + " ";
+        if (!parseJob(line, job)) return 2;
+        jobs.push_back(job);
+    } else {
+        char line[128];
+        while (fgets(line, sizeof(line), stdin)) {
+            if (hg::splitWords(line).empty()) continue;
+            if (!parseJob(line, job)) return 2;
+            jobs.push_back(job);
+        }
+    }
+
+    raiseFdLimit();
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    std::vector<Tally> tallies(jobs.size(), Tally{ 0, 0, std::vector<std::string>(), std::map<unsigned, unsigned>(), 0, 0, 0 });
+    auto onResult = [&](hgfleet::Unit& unit, size_t index, const std::string& line, unsigned retries) {
+        if (!quiet) printf("%s\t%s\t%s\n", unit.path().c_str(), jobs[index].text.c_str(), line.c_str());
+        Tally& t = tallies[index];
+        t.retries += retries;
+        if (line.compare(0, 4, "ERR ") == 0) {
+            t.failed.push_back(unit.path());
+            return;
+        }
+        t.ok++;
+        if (jobs[index].requests[0].opcode == BIN_OP_TSYNC) {
+            t.maxStep = std::max(t.maxStep, labs(jsonNumber(line, "step")));
+        } else if (jobs[index].merge) {
+            t.modes[jsonNumber(line, "mode")]++;
+            if (line.find("\"state\":\"standby\"") != std::string::npos) t.standby++;
+            t.flips += jsonNumber(line, "count");
+        }
+    };
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("hgfleet: epoll_create1");
+        return 1;
+    }
+
+    // Deadlines in a min-heap; entries a unit has moved on from are skipped when popped
+    typedef std::pair<uint64_t, size_t> Timer;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer> > timers;
+    std::vector<hgfleet::Unit> units;
+    units.reserve(ports.size());
+    std::vector<int> watchedFd(ports.size(), -1);
+    std::vector<bool> watchedOut(ports.size(), false);
+    std::vector<uint64_t> scheduled(ports.size(), 0);
+    size_t running = 0;
+
+    // Brings epoll and the timer heap up to date after a unit ran
+    auto sync = [&](size_t i) {
+        hgfleet::Unit& u = units[i];
+        if (u.fd() != watchedFd[i] || u.wantsWrite() != watchedOut[i]) {
+            struct epoll_event ev;
+            ev.events = EPOLLIN | (u.wantsWrite() ? EPOLLOUT : 0);
+            ev.data.u64 = i;
+            if (watchedFd[i] >= 0 && u.fd() == watchedFd[i]) {
+                epoll_ctl(epfd, EPOLL_CTL_MOD, u.fd(), &ev);
+            } else if (u.fd() >= 0) {
+                epoll_ctl(epfd, EPOLL_CTL_ADD, u.fd(), &ev);
+            }
+            watchedFd[i] = u.fd();
+            watchedOut[i] = u.wantsWrite();
+        }
+        if (u.deadline() && u.deadline() != scheduled[i]) timers.push(Timer(u.deadline(), i));
+        scheduled[i] = u.deadline();
+        if (u.isDone() && watchedFd[i] != -2) {
+            watchedFd[i] = -2;
+            running--;
+        }
+    };
+
+    uint64_t startMs = nowMs();
+    for (size_t i = 0; i < ports.size(); i++) {
+        units.push_back(hgfleet::Unit(ports[i], options, onResult));
+        running++;
+        units[i].start(jobs, startMs);
+        sync(i);
+    }
+
+    std::vector<struct epoll_event> events(256);
+    while (running && !stopRequested) {
+        int timeout = -1;
+        while (!timers.empty()) {
+            const Timer& top = timers.top();
+            if (top.first != units[top.second].deadline()) {
+                timers.pop();
+                continue;
+            }
+            uint64_t now = nowMs();
+            timeout = top.first > now ? (int)(top.first - now) : 0;
+            break;
+        }
+
+        int n = epoll_wait(epfd, events.data(), events.size(), timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("hgfleet: epoll_wait");
+            return 1;
+        }
+        uint64_t now = nowMs();
+        for (int e = 0; e < n; e++) {
+            size_t i = events[e].data.u64;
+            hgfleet::Unit& u = units[i];
+            if (u.isDone()) continue;
+            if (events[e].events & EPOLLOUT) u.onWritable();
+            if (events[e].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) u.onReadable(now);
+            sync(i);
+        }
+        while (!timers.empty() && timers.top().first <= now) {
+            Timer top = timers.top();
+            timers.pop();
+            hgfleet::Unit& u = units[top.second];
+            if (top.first != u.deadline()) continue;
+            u.onTimer(now);
+            sync(top.second);
+        }
+        fflush(stdout);
+    }
+    close(epfd);
+
+    unsigned reachable = 0;
+    for (const hgfleet::Unit& u : units) reachable += u.wasReachable();
+    bool ok = !stopRequested;
+    printf("{\"devices\":%zu,\"reachable\":%u,\"elapsedMs\":%llu,\"commands\":[",
+           units.size(), reachable, (unsigned long long)(nowMs() - startMs));
+    for (size_t j = 0; j < jobs.size(); j++) {
+        const Tally& t = tallies[j];
+        ok = ok && t.failed.empty();
+        printf("%s{\"command\":\"%s\",\"ok\":%u,\"failed\":%zu,\"retries\":%u",
+               j ? "," : "", jobs[j].text.c_str(), t.ok, t.failed.size(), t.retries);
+        if (jobs[j].requests[0].opcode == BIN_OP_TSYNC) {
+            printf(",\"maxStep\":%ld", t.maxStep);
+        } else if (jobs[j].merge) {
+            printf(",\"modes\":{");
+            for (std::map<unsigned, unsigned>::const_iterator m = t.modes.begin(); m != t.modes.end(); ++m) {
+                printf("%s\"%u\":%u", m == t.modes.begin() ? "" : ",", m->first, m->second);
+            }
+            printf("},\"standby\":%u,\"flips\":%lu", t.standby, t.flips);
+        }
+        printf(",\"failedPorts\":[");
+        for (size_t f = 0; f < t.failed.size(); f++) printf("%s\"%s\"", f ? "," : "", t.failed[f].c_str());
+        printf("]}");
+    }
+    printf("]}\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,330 @@
+#include "Device.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "SerialPort.h"
+
+namespace hgmux {
+
+namespace {
+
+const unsigned RECONNECT_MS = 2000;
+const unsigned RESET_WAIT_MS = 2000;  // The Nano reboots when the port opens
+const unsigned HELLO_MS = 2000;
+const unsigned RESPONSE_MS = 1000;
+const unsigned MAX_TIMEOUTS = 3;      // In a row before the link is reopened
+
+// The state mirrored for clients, refreshed every poll period
+const uint8_t POLLED[] = {
+    BIN_OP_GET_STATUS, BIN_OP_GET_DISPLAY, BIN_OP_GET_ORIENTATION, BIN_OP_GET_FLIP_COUNT,
+};
+
+bool isPolled(uint8_t opcode) {
+    for (uint8_t op : POLLED) {
+        if (op == opcode) return true;
+    }
+    return false;
+}
+
+}
+
+Device::Device(const std::string& path, int baud, bool resetWait, unsigned pollMs, ReplyFn reply)
+    : requestsSent(0), shared(0), cacheHits(0),
+      path(path), baud(baud), resetWait(resetWait), pollMs(pollMs), reply(reply),
+      fd_(-1), linkState(LINK_CLOSED), deadline(0), timeouts(0),
+      inFlight(false), nextPoll(0), stateChanged(true) {}
+
+void Device::open(uint64_t nowMs) {
+    fd_ = hg::openSerialPort(path, baud);
+    if (fd_ < 0) {
+        fprintf(stderr, "hgmux: %s: %s\n", path.c_str(), strerror(errno));
+        deadline = nowMs + RECONNECT_MS;
+        return;
+    }
+    reader = hg::FrameReader();
+    out.clear();
+    linkState = LINK_RESET_WAIT;
+    deadline = resetWait ? nowMs + RESET_WAIT_MS : nowMs;
+}
+
+void Device::close(const char* why) {
+    fprintf(stderr, "hgmux: %s: %s, reconnecting\n", path.c_str(), why);
+    ::close(fd_);
+    fd_ = -1;
+    linkState = LINK_CLOSED;
+    for (const Pending& p : queue) {
+        for (const Waiter& w : p.waiters) reply(w, "ERR Device not connected");
+    }
+    queue.clear();
+    inFlight = false;
+    out.clear();
+    stateChanged = true;
+}
+
+void Device::send(const hg::Request& request) {
+    std::vector<uint8_t> frame = hg::encodeRequest(request.opcode, request.args.data(), request.args.size());
+    out.insert(out.end(), frame.begin(), frame.end());
+    requestsSent++;
+}
+
+void Device::sendNext(uint64_t nowMs) {
+    while (!inFlight && !queue.empty() && linkState == LINK_READY) {
+        if (!queue.front().state) {
+            send(queue.front().request);
+            inFlight = true;
+            deadline = nowMs + RESPONSE_MS;
+            return;
+        }
+        // A state snapshot: poll what a command made stale first, once, so
+        // a failing poll can't hold it up for good
+        if (!queue.front().refreshed && isStale()) {
+            queue.front().refreshed = true;
+            for (const std::map<uint8_t, Cached>::value_type& entry : cache) {
+                if (!entry.second.stale) continue;
+                Pending p;
+                p.request.opcode = entry.first;
+                queue.push_front(p);
+            }
+            continue;
+        }
+        Pending done = queue.front();
+        queue.pop_front();
+        std::string json = stateJSON();
+        for (const Waiter& w : done.waiters) reply(w, json);
+    }
+}
+
+// Queue position just past the client's last queued command, 0 if none
+size_t Device::queuedAfter(int client) const {
+    size_t after = 0;
+    for (size_t i = 0; i < queue.size(); i++) {
+        if (queue[i].state || hg::isQuery(queue[i].request.opcode)) continue;
+        for (const Waiter& w : queue[i].waiters) {
+            if (w.client == client) after = i + 1;
+        }
+    }
+    return after;
+}
+
+bool Device::isStale() const {
+    for (const std::map<uint8_t, Cached>::value_type& entry : cache) {
+        if (entry.second.stale) return true;
+    }
+    return false;
+}
+
+void Device::finish(const std::string& line) {
+    Pending done = queue.front();
+    queue.pop_front();
+    inFlight = false;
+    for (const Waiter& w : done.waiters) reply(w, line);
+    // Anything that changes the device makes the mirror stale and gets it
+    // refreshed right away
+    if (!hg::isQuery(done.request.opcode)) {
+        for (std::map<uint8_t, Cached>::value_type& entry : cache) entry.second.stale = true;
+        nextPoll = 0;
+    }
+}
+
+void Device::onWritable() {
+    if (fd_ < 0 || out.empty()) return;
+    ssize_t n = write(fd_, out.data(), out.size());
+    if (n > 0) out.erase(out.begin(), out.begin() + n);
+}
+
+void Device::onReadable(uint64_t nowMs) {
+    uint8_t buf[256];
+    ssize_t got = read(fd_, buf, sizeof(buf));
+    if (got <= 0) {
+        if (got < 0 && (errno == EAGAIN || errno == EINTR)) return;
+        close(got == 0 ? "closed" : strerror(errno));
+        deadline = nowMs + RECONNECT_MS;
+        return;
+    }
+    hg::BinaryResponse response;
+    for (ssize_t i = 0; i < got && fd_ >= 0; i++) {
+        if (!reader.feed(buf[i], response)) continue;
+        if (linkState == LINK_HELLO) {
+            if (response.opcode != BIN_OP_HELLO) continue;
+            fprintf(stderr, "hgmux: %s: connected, protocol version %u\n", path.c_str(),
+                    response.payload.empty() ? 0 : response.payload[0]);
+            linkState = LINK_READY;
+            timeouts = 0;
+            nextPoll = 0;
+            stateChanged = true;
+        } else if (linkState == LINK_READY) {
+            handleResponse(response, nowMs);
+        }
+    }
+    sendNext(nowMs);
+}
+
+void Device::handleResponse(const hg::BinaryResponse& response, uint64_t nowMs) {
+    if (!inFlight) return;
+    if (response.opcode == BIN_OP_NAK) {
+        finish("ERR CRC mismatch");
+        return;
+    }
+    if (response.opcode != queue.front().request.opcode) return;  // Stray or unsolicited
+
+    timeouts = 0;
+    if (isPolled(response.opcode) && response.status == BIN_OK) {
+        Cached& slot = cache[response.opcode];
+        if (slot.response.payload != response.payload) stateChanged = true;
+        slot.response = response;
+        slot.at = nowMs;
+        slot.stale = false;
+    }
+    finish(hg::formatResponse(response));
+}
+
+void Device::poll(uint64_t nowMs) {
+    for (uint8_t op : POLLED) {
+        bool queued = false;
+        for (const Pending& p : queue) {
+            if (!p.state && p.request.opcode == op && p.request.args.empty()) queued = true;
+        }
+        if (queued) continue;
+        Pending p;
+        p.request.opcode = op;
+        queue.push_back(p);
+    }
+    nextPoll = nowMs + pollMs;
+}
+
+int Device::tick(uint64_t nowMs) {
+    switch (linkState) {
+        case LINK_CLOSED:
+            if (nowMs >= deadline) open(nowMs);
+            break;
+        case LINK_RESET_WAIT:
+            if (nowMs >= deadline) {
+                // Ends a frame or leaves binary mode if a previous session
+                // left it on; the text parser ignores these bytes
+                out.push_back(0x00);
+                send(hg::Request{ BIN_OP_EXIT, std::vector<uint8_t>() });
+                out.push_back(BIN_MAGIC);
+                linkState = LINK_HELLO;
+                deadline = nowMs + HELLO_MS;
+            }
+            break;
+        case LINK_HELLO:
+            if (nowMs >= deadline) {
+                close("no binary protocol");
+                deadline = nowMs + RECONNECT_MS;
+            }
+            break;
+        case LINK_READY:
+            if (inFlight && nowMs >= deadline) {
+                finish("ERR No response");
+                if (++timeouts >= MAX_TIMEOUTS) {
+                    close("not responding");
+                    deadline = nowMs + RECONNECT_MS;
+                    break;
+                }
+            }
+            if (nowMs >= nextPoll) poll(nowMs);
+            sendNext(nowMs);
+            break;
+    }
+
+    uint64_t next = deadline;
+    if (linkState == LINK_READY && !inFlight) next = nextPoll;
+    return next > nowMs ? (int)(next - nowMs) : 0;
+}
+
+void Device::submit(const Waiter& to, const hg::Request& request, uint64_t nowMs) {
+    if (linkState != LINK_READY) {
+        reply(to, "ERR Device not connected");
+        return;
+    }
+    if (hg::isQuery(request.opcode)) {
+        // A query must see the client's own commands, so neither the cache
+        // nor a request queued ahead of one of them will do
+        size_t after = queuedAfter(to.client);
+        std::map<uint8_t, Cached>::const_iterator hit = cache.find(request.opcode);
+        if (after == 0 && request.args.empty() && hit != cache.end() && !hit->second.stale &&
+            nowMs - hit->second.at < pollMs) {
+            cacheHits++;
+            reply(to, hg::formatResponse(hit->second.response));
+            return;
+        }
+        for (size_t i = after; i < queue.size(); i++) {
+            Pending& p = queue[i];
+            if (!p.state && p.request == request) {
+                shared++;
+                p.waiters.push_back(to);
+                return;
+            }
+        }
+    }
+    Pending p;
+    p.request = request;
+    p.waiters.push_back(to);
+    queue.push_back(p);
+    sendNext(nowMs);
+}
+
+void Device::submitState(const Waiter& to, uint64_t nowMs) {
+    size_t after = queuedAfter(to.client);
+    // Disconnected, the mirror says so and there is nothing to wait for
+    if (linkState != LINK_READY || (after == 0 && !isStale())) {
+        cacheHits++;
+        reply(to, stateJSON());
+        return;
+    }
+    for (size_t i = after; i < queue.size(); i++) {
+        if (queue[i].state) {
+            shared++;
+            queue[i].waiters.push_back(to);
+            return;
+        }
+    }
+    Pending p;
+    p.state = true;
+    p.waiters.push_back(to);
+    queue.push_back(p);
+    sendNext(nowMs);
+}
+
+std::string Device::stateJSON() const {
+    std::string json = "{\"connected\":";
+    json += linkState == LINK_READY ? "true" : "false";
+
+    std::map<uint8_t, Cached>::const_iterator it = cache.find(BIN_OP_GET_STATUS);
+    json += ",\"mode\":";
+    json += it != cache.end() ? std::to_string(it->second.response.payload[0]) : "null";
+
+    it = cache.find(BIN_OP_GET_ORIENTATION);
+    json += ",\"orientation\":";
+    json += it != cache.end() ? hg::formatResponse(it->second.response) : "null";
+
+    it = cache.find(BIN_OP_GET_DISPLAY);
+    json += ",\"display\":";
+    json += it != cache.end() ? hg::formatDisplay(it->second.response.payload.data()) : "null";
+
+    it = cache.find(BIN_OP_GET_FLIP_COUNT);
+    json += ",\"flipCount\":";
+    if (it != cache.end()) {
+        const std::vector<uint8_t>& p = it->second.response.payload;
+        json += std::to_string(p[0] | (p[1] << 8));
+    } else {
+        json += "null";
+    }
+    json += "}";
+    return json;
+}
+
+bool Device::takeStateChanged() {
+    // Held back while a command's effects are being polled, so subscribers
+    // never see a mirror that is part before and part after it
+    if (linkState == LINK_READY && isStale()) return false;
+    bool changed = stateChanged;
+    stateChanged = false;
+    return changed;
+}
+
+}
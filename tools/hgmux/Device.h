@@ -0,0 +1,115 @@
+#ifndef HGMUX_DEVICE_H
+#define HGMUX_DEVICE_H
+
+/*
+ * The one connection to the device. Requests from all clients go
+ * through a single queue with one request in flight; identical queries
+ * share a request, and the state the daemon mirrors is polled on a
+ * fixed schedule however many clients there are.
+ */
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "BinaryLink.h"
+#include "Commands.h"
+
+namespace hgmux {
+
+// Who a response goes to: a client and its reply slot
+struct Waiter {
+    int client;
+    unsigned slot;
+};
+
+class Device {
+public:
+    // Called with the response line ("ERR ..." when the device didn't answer)
+    typedef std::function<void(const Waiter& to, const std::string& line)> ReplyFn;
+
+    Device(const std::string& path, int baud, bool resetWait, unsigned pollMs, ReplyFn reply);
+
+    // -1 while disconnected
+    int fd() const { return fd_; }
+    bool wantsWrite() const { return !out.empty(); }
+
+    void onReadable(uint64_t nowMs);
+    void onWritable();
+    // Connects, polls and times out requests. Returns ms until it needs to run again
+    int tick(uint64_t nowMs);
+
+    // Queues a request for a client. Queries already queued or in flight
+    // are shared, and polled state fresher than one poll period comes
+    // from the cache - unless the client has a command still queued, in
+    // which case its query goes out after that command.
+    void submit(const Waiter& to, const hg::Request& request, uint64_t nowMs);
+    // Queues a reply with stateJSON() in the same order: taken once the
+    // client's queued commands have completed and the stale parts of the
+    // mirror have been polled again
+    void submitState(const Waiter& to, uint64_t nowMs);
+
+    bool isConnected() const { return linkState == LINK_READY; }
+
+    // The mirrored state as JSON, and whether it changed since the last call
+    // (not while a completed command has left it stale)
+    std::string stateJSON() const;
+    bool takeStateChanged();
+
+    unsigned long requestsSent;
+    unsigned long shared;     // Answered by a request already on its way
+    unsigned long cacheHits;  // Answered from the mirror
+
+private:
+    enum LinkState { LINK_CLOSED, LINK_RESET_WAIT, LINK_HELLO, LINK_READY };
+
+    struct Pending {
+        hg::Request request;
+        std::vector<Waiter> waiters;
+        bool state = false;      // Answered with stateJSON(), nothing is sent
+        bool refreshed = false;  // Stale polls already went ahead of it once
+    };
+
+    struct Cached {
+        hg::BinaryResponse response;
+        uint64_t at;
+        bool stale;  // A command completed since; ask the device again
+    };
+
+    void open(uint64_t nowMs);
+    void close(const char* why);
+    void send(const hg::Request& request);
+    void sendNext(uint64_t nowMs);
+    size_t queuedAfter(int client) const;
+    bool isStale() const;
+    void finish(const std::string& line);
+    void handleResponse(const hg::BinaryResponse& response, uint64_t nowMs);
+    void poll(uint64_t nowMs);
+
+    std::string path;
+    int baud;
+    bool resetWait;
+    unsigned pollMs;
+    ReplyFn reply;
+
+    int fd_;
+    LinkState linkState;
+    uint64_t deadline;  // Of the current link step or request
+    unsigned timeouts;
+    std::vector<uint8_t> out;
+    hg::FrameReader reader;
+
+    std::deque<Pending> queue;
+    bool inFlight;
+    uint64_t nextPoll;
+
+    std::map<uint8_t, Cached> cache;
+    bool stateChanged;
+};
+
+}
+
+#endif
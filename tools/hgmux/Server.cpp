@@ -0,0 +1,456 @@
+#include "Server.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "WebSocket.h"
+
+namespace hgmux {
+
+namespace {
+
+const size_t MAX_LINE = 256;         // Longer commands than any the device takes
+const size_t MAX_HTTP_HEADER = 8192;
+const size_t MAX_OUTPUT = 1 << 20;   // Clients further behind than this are dropped
+
+std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if ((unsigned char)c >= 0x20) out += c;
+    }
+    return out + "\"";
+}
+
+// docs/API_DOCUMENTATION.md section 3
+int errorCode(const std::string& message) {
+    if (message == "Unknown command") return 404;
+    if (message == "Device not connected" || message == "No response" ||
+        message == "CRC mismatch" || message == "Short response") return 500;
+    return 400;
+}
+
+// A text protocol line as the JSON API's response object
+std::string apiJSON(const std::string& line, int& code) {
+    code = 200;
+    if (line == "OK") return "{\"status\":\"ok\"}";
+    if (line.compare(0, 4, "ERR ") == 0) {
+        std::string message = line.substr(4);
+        code = errorCode(message);
+        return "{\"status\":\"error\",\"message\":" + jsonString(message) +
+               ",\"code\":" + std::to_string(code) + "}";
+    }
+    return line;
+}
+
+const char* reason(int code) {
+    switch (code) {
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+    }
+    return "Internal Server Error";
+}
+
+std::string httpResponse(int code, const std::string& body) {
+    std::string r = "HTTP/1.1 " + std::to_string(code) + " " + reason(code) + "\r\n";
+    r += "Content-Type: application/json\r\n";
+    r += "Access-Control-Allow-Origin: *\r\n";
+    r += "Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n";
+    r += "Access-Control-Allow-Headers: Content-Type\r\n";
+    r += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    r += "Connection: close\r\n\r\n";
+    return r + body;
+}
+
+std::string trim(const std::string& s) {
+    size_t begin = 0, end = s.size();
+    while (begin < end && isspace((unsigned char)s[begin])) begin++;
+    while (end > begin && isspace((unsigned char)s[end - 1])) end--;
+    return s.substr(begin, end - begin);
+}
+
+void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+}
+
+Server::Server(Device& device)
+    : device(device), unixFd(-1), httpFd(-1), nextId(1) {}
+
+Server::~Server() {
+    for (auto& entry : clients) {
+        if (entry.second.fd >= 0) close(entry.second.fd);
+    }
+    if (unixFd >= 0) {
+        close(unixFd);
+        unlink(unixPath.c_str());
+    }
+    if (httpFd >= 0) close(httpFd);
+}
+
+bool Server::listenUnix(const std::string& path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(addr.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    unlink(path.c_str());  // Left behind by a daemon that didn't exit cleanly
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return false;
+    }
+    setNonBlocking(fd);
+    unixFd = fd;
+    unixPath = path;
+    return true;
+}
+
+bool Server::listenHttp(int port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // Local clients only
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return false;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return false;
+    }
+    setNonBlocking(fd);
+    httpFd = fd;
+    return true;
+}
+
+void Server::addPollFds(std::vector<struct pollfd>& fds) const {
+    if (unixFd >= 0) fds.push_back(pollfd{ unixFd, POLLIN, 0 });
+    if (httpFd >= 0) fds.push_back(pollfd{ httpFd, POLLIN, 0 });
+    for (const auto& entry : clients) {
+        const Client& c = entry.second;
+        short events = c.closing ? 0 : POLLIN;
+        if (!c.out.empty()) events |= POLLOUT;
+        fds.push_back(pollfd{ c.fd, events, 0 });
+    }
+}
+
+void Server::onPoll(const std::vector<struct pollfd>& fds, uint64_t nowMs) {
+    for (const struct pollfd& pfd : fds) {
+        if (!pfd.revents) continue;
+        if (pfd.fd == unixFd) {
+            accept(unixFd, CLIENT_LINE);
+            continue;
+        }
+        if (pfd.fd == httpFd) {
+            accept(httpFd, CLIENT_HTTP);
+            continue;
+        }
+        for (auto& entry : clients) {
+            Client& c = entry.second;
+            if (c.fd != pfd.fd) continue;
+            if (pfd.revents & POLLOUT) onWritable(c);
+            if (c.fd >= 0 && (pfd.revents & (POLLIN | POLLHUP | POLLERR))) onReadable(c, nowMs);
+            break;
+        }
+    }
+    reap();
+}
+
+void Server::accept(int listenFd, Kind kind) {
+    int fd = ::accept(listenFd, NULL, NULL);
+    if (fd < 0) return;
+    setNonBlocking(fd);
+    Client& c = clients[nextId];
+    c.id = nextId++;
+    c.fd = fd;
+    c.kind = kind;
+    c.subscribed = false;
+    c.closing = false;
+    c.nextSlot = 0;
+    c.firstSlot = 0;
+    c.stateEventSlot = -1;
+}
+
+void Server::onReadable(Client& c, uint64_t nowMs) {
+    char buf[1024];
+    ssize_t got = read(c.fd, buf, sizeof(buf));
+    if (got < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    if (got <= 0) {
+        // A line client that shut down its side still gets its replies
+        if (c.kind == CLIENT_LINE && got == 0) {
+            c.closing = true;
+            onWritable(c);
+        } else {
+            drop(c);
+        }
+        return;
+    }
+    c.in.append(buf, got);
+
+    switch (c.kind) {
+        case CLIENT_LINE: {
+            size_t eol;
+            while (c.fd >= 0 && (eol = c.in.find('\n')) != std::string::npos) {
+                std::string line = c.in.substr(0, eol);
+                c.in.erase(0, eol + 1);
+                handleLine(c, line, nowMs);
+            }
+            if (c.in.size() > MAX_LINE) drop(c);
+            break;
+        }
+        case CLIENT_HTTP:
+            handleHttp(c, nowMs);
+            break;
+        case CLIENT_WS:
+            handleWs(c, nowMs);
+            break;
+    }
+}
+
+void Server::onWritable(Client& c) {
+    if (!c.out.empty()) {
+        ssize_t n = write(c.fd, c.out.data(), c.out.size());
+        if (n < 0 && errno != EAGAIN && errno != EINTR) {
+            drop(c);
+            return;
+        }
+        if (n > 0) c.out.erase(0, n);
+    }
+    if (c.closing && c.out.empty() && c.firstSlot == c.nextSlot) drop(c);
+}
+
+void Server::handleLine(Client& c, const std::string& line, uint64_t nowMs) {
+    std::string command = trim(line);
+    if (!command.empty()) this->command(c, command, nowMs);
+}
+
+void Server::handleHttp(Client& c, uint64_t nowMs) {
+    size_t end = c.in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (c.in.size() > MAX_HTTP_HEADER) drop(c);
+        return;
+    }
+
+    std::string method, target, upgrade, wsKey;
+    size_t contentLength = 0;
+    size_t lineStart = 0;
+    while (lineStart < end) {
+        size_t lineEnd = c.in.find("\r\n", lineStart);
+        std::string line = c.in.substr(lineStart, lineEnd - lineStart);
+        if (lineStart == 0) {
+            size_t sp1 = line.find(' ');
+            size_t sp2 = line.find(' ', sp1 + 1);
+            if (sp1 == std::string::npos || sp2 == std::string::npos) {
+                drop(c);
+                return;
+            }
+            method = line.substr(0, sp1);
+            target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        } else {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                std::string name = line.substr(0, colon);
+                std::string value = trim(line.substr(colon + 1));
+                if (!strcasecmp(name.c_str(), "Content-Length")) contentLength = strtoul(value.c_str(), NULL, 10);
+                else if (!strcasecmp(name.c_str(), "Upgrade")) upgrade = value;
+                else if (!strcasecmp(name.c_str(), "Sec-WebSocket-Key")) wsKey = value;
+            }
+        }
+        lineStart = lineEnd + 2;
+    }
+    if (contentLength > MAX_LINE) {
+        c.closing = true;
+        send(c, httpResponse(400, "{\"status\":\"error\",\"message\":\"Command too long\",\"code\":400}"));
+        return;
+    }
+    if (c.in.size() < end + 4 + contentLength) return;
+    std::string body = c.in.substr(end + 4, contentLength);
+    c.in.erase(0, end + 4 + contentLength);
+
+    if (method == "GET" && target == "/ws" && !strcasecmp(upgrade.c_str(), "websocket") && !wsKey.empty()) {
+        c.kind = CLIENT_WS;
+        c.subscribed = true;
+        send(c, "HTTP/1.1 101 Switching Protocols\r\n"
+                "Upgrade: websocket\r\n"
+                "Connection: Upgrade\r\n"
+                "Sec-WebSocket-Accept: " + wsAcceptKey(wsKey) + "\r\n\r\n");
+        c.stateEventSlot = c.nextSlot++;
+        device.submitState(Waiter{ c.id, (unsigned)c.stateEventSlot }, nowMs);
+        handleWs(c, nowMs);
+        return;
+    }
+
+    // One request per connection
+    c.closing = true;
+    c.in.clear();
+    if (method == "OPTIONS") {
+        send(c, httpResponse(204, ""));
+    } else if (method == "GET" && target == "/api/state") {
+        device.submitState(Waiter{ c.id, c.nextSlot++ }, nowMs);
+    } else if (method == "POST" && target == "/api/command") {
+        command(c, trim(body), nowMs);
+    } else {
+        send(c, httpResponse(404, "{\"status\":\"error\",\"message\":\"Not found\",\"code\":404}"));
+    }
+}
+
+void Server::handleWs(Client& c, uint64_t nowMs) {
+    bool fin;
+    uint8_t opcode;
+    std::string payload;
+    int got;
+    while (c.fd >= 0 && !c.closing && (got = wsTakeFrame(c.in, MAX_LINE, fin, opcode, payload)) != 0) {
+        if (got < 0) {
+            drop(c);
+            return;
+        }
+        switch (opcode) {
+            case WS_TEXT:
+            case WS_BINARY:
+            case WS_CONTINUATION:
+                c.message += payload;
+                if (c.message.size() > MAX_LINE) {
+                    drop(c);
+                    return;
+                }
+                if (fin) {
+                    std::string command = trim(c.message);
+                    c.message.clear();
+                    if (!command.empty()) this->command(c, command, nowMs);
+                }
+                break;
+            case WS_PING:
+                send(c, wsFrame(WS_PONG, payload));
+                break;
+            case WS_CLOSE:
+                send(c, wsFrame(WS_CLOSE, payload.substr(0, 2)));
+                c.closing = true;
+                break;
+        }
+    }
+}
+
+void Server::command(Client& c, const std::string& line, uint64_t nowMs) {
+    unsigned slot = c.nextSlot++;
+    std::vector<std::string> words = hg::splitWords(line.c_str());
+    if (words.empty()) {
+        deliver(c, slot, "ERR Unknown command");
+        return;
+    }
+
+    const char* name = words[0].c_str();
+    if (!strcasecmp(name, "STATE")) {
+        device.submitState(Waiter{ c.id, slot }, nowMs);
+        return;
+    }
+    if (!strcasecmp(name, "SUBSCRIBE") || !strcasecmp(name, "UNSUBSCRIBE")) {
+        c.subscribed = !strcasecmp(name, "SUBSCRIBE");
+        deliver(c, slot, "OK");
+        return;
+    }
+    // The samples would go to every client; stream with hgctl instead
+    if (!strcasecmp(name, "STREAM_IMU")) {
+        deliver(c, slot, "ERR Not available through hgmux");
+        return;
+    }
+
+    hg::Request request;
+    std::string error;
+    if (!hg::parseCommand(words, request, error)) {
+        deliver(c, slot, error);
+        return;
+    }
+    device.submit(Waiter{ c.id, slot }, request, nowMs);
+}
+
+void Server::reply(const Waiter& to, const std::string& line) {
+    std::map<int, Client>::iterator it = clients.find(to.client);
+    if (it != clients.end() && it->second.fd >= 0) deliver(it->second, to.slot, line);
+}
+
+void Server::deliver(Client& c, unsigned slot, const std::string& line) {
+    c.ready[slot] = line;
+    std::map<unsigned, std::string>::iterator next;
+    while (c.fd >= 0 && (next = c.ready.find(c.firstSlot)) != c.ready.end()) {
+        int code;
+        switch (c.kind) {
+            case CLIENT_LINE:
+                send(c, next->second + "\n");
+                break;
+            case CLIENT_HTTP: {
+                std::string body = apiJSON(next->second, code);
+                send(c, httpResponse(code, body));
+                break;
+            }
+            case CLIENT_WS:
+                if ((int)next->first == c.stateEventSlot) {
+                    send(c, wsFrame(WS_TEXT, "{\"event\":\"state\"," + next->second.substr(1)));
+                } else {
+                    send(c, wsFrame(WS_TEXT, apiJSON(next->second, code)));
+                }
+                break;
+        }
+        c.ready.erase(next);
+        c.firstSlot++;
+    }
+}
+
+void Server::pushState(const std::string& stateJSON) {
+    std::string event = "{\"event\":\"state\"," + stateJSON.substr(1);
+    for (auto& entry : clients) {
+        Client& c = entry.second;
+        if (!c.subscribed || c.fd < 0 || c.closing) continue;
+        send(c, c.kind == CLIENT_WS ? wsFrame(WS_TEXT, event) : event + "\n");
+    }
+    reap();
+}
+
+void Server::send(Client& c, const std::string& data) {
+    if (c.out.size() + data.size() > MAX_OUTPUT) {
+        fprintf(stderr, "hgmux: dropping client %d, not reading its responses\n", c.id);
+        drop(c);
+        return;
+    }
+    c.out += data;
+}
+
+void Server::drop(Client& c) {
+    if (c.fd < 0) return;
+    close(c.fd);
+    c.fd = -1;
+    dropped.push_back(c.id);
+}
+
+void Server::reap() {
+    for (int id : dropped) clients.erase(id);
+    dropped.clear();
+}
+
+}
@@ -0,0 +1,83 @@
+#ifndef HGMUX_SERVER_H
+#define HGMUX_SERVER_H
+
+/*
+ * The clients' side of hgmux: a Unix socket speaking the text protocol
+ * one line at a time, and an HTTP listener serving the JSON API with a
+ * WebSocket endpoint. Each client gets its responses in the order it
+ * sent the commands, whichever order the device answers them in.
+ */
+
+#include <poll.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Device.h"
+
+namespace hgmux {
+
+class Server {
+public:
+    explicit Server(Device& device);
+    ~Server();
+
+    // Return false with errno set if the listener can't be opened
+    bool listenUnix(const std::string& path);
+    bool listenHttp(int port);
+
+    // Adds the listeners and clients to a poll set
+    void addPollFds(std::vector<struct pollfd>& fds) const;
+    // Handles the events of the fds added by addPollFds
+    void onPoll(const std::vector<struct pollfd>& fds, uint64_t nowMs);
+
+    // A device response for a client's reply slot
+    void reply(const Waiter& to, const std::string& line);
+    // Sends the state to subscribers, at most once per call
+    void pushState(const std::string& stateJSON);
+
+    size_t clientCount() const { return clients.size(); }
+
+private:
+    enum Kind { CLIENT_LINE, CLIENT_HTTP, CLIENT_WS };
+
+    struct Client {
+        int id;
+        int fd;
+        Kind kind;
+        bool subscribed;
+        bool closing;       // Drop once the output is flushed
+        std::string in;
+        std::string out;
+        std::string message;  // WebSocket message being reassembled
+        unsigned nextSlot;
+        unsigned firstSlot;   // Oldest reply slot not yet sent
+        int stateEventSlot;   // Reply slot sent as the WebSocket's first state event, -1 if none
+        std::map<unsigned, std::string> ready;
+    };
+
+    void accept(int listenFd, Kind kind);
+    void onReadable(Client& c, uint64_t nowMs);
+    void onWritable(Client& c);
+    void handleLine(Client& c, const std::string& line, uint64_t nowMs);
+    void handleHttp(Client& c, uint64_t nowMs);
+    void handleWs(Client& c, uint64_t nowMs);
+    void command(Client& c, const std::string& line, uint64_t nowMs);
+    void deliver(Client& c, unsigned slot, const std::string& line);
+    void send(Client& c, const std::string& data);
+    void drop(Client& c);
+    void reap();
+
+    Device& device;
+    int unixFd;
+    int httpFd;
+    std::string unixPath;
+    int nextId;
+    std::map<int, Client> clients;
+    std::vector<int> dropped;
+};
+
+}
+
+#endif
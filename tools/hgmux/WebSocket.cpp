@@ -0,0 +1,112 @@
+#include "WebSocket.h"
+
+namespace hgmux {
+
+namespace {
+
+const char WS_GUID[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+uint32_t rol(uint32_t v, int n) { return (v << n) | (v >> (32 - n)); }
+
+void sha1(const std::string& message, uint8_t digest[20]) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+    std::string m = message;
+    uint64_t bits = (uint64_t)message.size() * 8;
+    m += (char)0x80;
+    while (m.size() % 64 != 56) m += (char)0;
+    for (int i = 7; i >= 0; i--) m += (char)(bits >> (i * 8));
+
+    for (size_t block = 0; block < m.size(); block += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            const uint8_t* p = (const uint8_t*)m.data() + block + i * 4;
+            w[i] = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+        }
+        for (int i = 16; i < 80; i++) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rol(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+    for (int i = 0; i < 20; i++) digest[i] = h[i / 4] >> (24 - (i % 4) * 8);
+}
+
+std::string base64(const uint8_t* data, size_t len) {
+    static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < len) v |= data[i + 1] << 8;
+        if (i + 2 < len) v |= data[i + 2];
+        out += ALPHABET[(v >> 18) & 63];
+        out += ALPHABET[(v >> 12) & 63];
+        out += i + 1 < len ? ALPHABET[(v >> 6) & 63] : '=';
+        out += i + 2 < len ? ALPHABET[v & 63] : '=';
+    }
+    return out;
+}
+
+}
+
+std::string wsAcceptKey(const std::string& key) {
+    uint8_t digest[20];
+    sha1(key + WS_GUID, digest);
+    return base64(digest, sizeof(digest));
+}
+
+std::string wsFrame(uint8_t opcode, const std::string& payload) {
+    std::string frame;
+    frame += (char)(0x80 | opcode);
+    size_t len = payload.size();
+    if (len < 126) {
+        frame += (char)len;
+    } else if (len < 65536) {
+        frame += (char)126;
+        frame += (char)(len >> 8);
+        frame += (char)len;
+    } else {
+        frame += (char)127;
+        for (int i = 7; i >= 0; i--) frame += (char)((uint64_t)len >> (i * 8));
+    }
+    return frame + payload;
+}
+
+int wsTakeFrame(std::string& buf, size_t maxPayload, bool& fin, uint8_t& opcode, std::string& payload) {
+    const uint8_t* p = (const uint8_t*)buf.data();
+    if (buf.size() < 2) return 0;
+    fin = p[0] & 0x80;
+    opcode = p[0] & 0x0F;
+    if (!(p[1] & 0x80)) return -1;  // Clients must mask
+
+    size_t header = 2;
+    uint64_t len = p[1] & 0x7F;
+    if (len == 126) {
+        if (buf.size() < 4) return 0;
+        len = p[2] << 8 | p[3];
+        header = 4;
+    } else if (len == 127) {
+        if (buf.size() < 10) return 0;
+        len = 0;
+        for (int i = 0; i < 8; i++) len = len << 8 | p[2 + i];
+        header = 10;
+    }
+    if (len > maxPayload) return -1;
+    if (buf.size() < header + 4 + len) return 0;
+
+    const uint8_t* mask = p + header;
+    payload.assign(buf, header + 4, len);
+    for (size_t i = 0; i < len; i++) payload[i] ^= mask[i % 4];
+    buf.erase(0, header + 4 + len);
+    return 1;
+}
+
+}
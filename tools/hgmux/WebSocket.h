@@ -0,0 +1,36 @@
+#ifndef HGMUX_WEBSOCKET_H
+#define HGMUX_WEBSOCKET_H
+
+/*
+ * The parts of RFC 6455 hgmux needs: the handshake accept key and
+ * unfragmented frames to and from a browser.
+ */
+
+#include <stdint.h>
+#include <string>
+
+namespace hgmux {
+
+enum WsOpcode {
+    WS_CONTINUATION = 0x0,
+    WS_TEXT = 0x1,
+    WS_BINARY = 0x2,
+    WS_CLOSE = 0x8,
+    WS_PING = 0x9,
+    WS_PONG = 0xA,
+};
+
+// Sec-WebSocket-Accept for a client's Sec-WebSocket-Key
+std::string wsAcceptKey(const std::string& key);
+
+// An unmasked server frame
+std::string wsFrame(uint8_t opcode, const std::string& payload);
+
+// Takes one client frame off the front of buf. Returns 1 with the
+// unmasked payload, 0 if the frame is incomplete, -1 if it is malformed
+// or longer than maxPayload.
+int wsTakeFrame(std::string& buf, size_t maxPayload, bool& fin, uint8_t& opcode, std::string& payload);
+
+}
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * hgmux - share one device between many local clients.
+ *
+ *   hgmux [--baud N] [--no-reset-wait] [--socket PATH] [--http PORT] [--poll MS] PORT
+ *
+ * Owns the serial port in binary mode and serves:
+ *   - the text protocol, one command per line, on a Unix socket
+ *     (default /tmp/hgmux.sock), plus STATE, SUBSCRIBE and UNSUBSCRIBE
+ *   - GET /api/state, POST /api/command and a WebSocket at /ws on
+ *     127.0.0.1:PORT (default 8080, 0 turns HTTP off)
+ *
+ * Mode, display, orientation and flip count are polled every MS
+ * milliseconds (default 250) and mirrored; subscribers get the state
+ * whenever it changes. The device sees the same traffic however many
+ * clients are connected.
+ */
+
+#include "Device.h"
+#include "Server.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+namespace {
+
+volatile sig_atomic_t stopRequested = 0;
+
+void onSignal(int) { stopRequested = 1; }
+
+uint64_t nowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+}
+
+int main(int argc, char** argv) {
+    int baud = 9600;
+    bool resetWait = true;
+    const char* socketPath = "/tmp/hgmux.sock";
+    int httpPort = 8080;
+    unsigned pollMs = 250;
+    const char* port = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--baud") && i + 1 < argc) baud = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--no-reset-wait")) resetWait = false;
+        else if (!strcmp(argv[i], "--socket") && i + 1 < argc) socketPath = argv[++i];
+        else if (!strcmp(argv[i], "--http") && i + 1 < argc) httpPort = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--poll") && i + 1 < argc) pollMs = atoi(argv[++i]);
+        else if (!port) port = argv[i];
+    }
+    if (!port || pollMs == 0) {
+        fprintf(stderr, "usage: hgmux [--baud N] [--no-reset-wait] [--socket PATH] [--http PORT] [--poll MS] PORT\n");
+        return 2;
+    }
+
+    hgmux::Server* server = NULL;
+    hgmux::Device device(port, baud, resetWait, pollMs,
+                         [&server](const hgmux::Waiter& to, const std::string& line) {
+                             server->reply(to, line);
+                         });
+    hgmux::Server mux(device);
+    server = &mux;
+
+    if (!mux.listenUnix(socketPath)) {
+        fprintf(stderr, "hgmux: %s: %s\n", socketPath, strerror(errno));
+        return 1;
+    }
+    if (httpPort && !mux.listenHttp(httpPort)) {
+        fprintf(stderr, "hgmux: port %d: %s\n", httpPort, strerror(errno));
+        return 1;
+    }
+    fprintf(stderr, "hgmux: serving %s on %s", port, socketPath);
+    if (httpPort) fprintf(stderr, " and http://127.0.0.1:%d", httpPort);
+    fprintf(stderr, "\n");
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<struct pollfd> fds;
+    while (!stopRequested) {
+        int timeout = device.tick(nowMs());
+        // Changes are pushed once per pass, however many responses it took
+        if (device.takeStateChanged()) mux.pushState(device.stateJSON());
+
+        fds.clear();
+        if (device.fd() >= 0) {
+            fds.push_back(pollfd{ device.fd(), (short)(POLLIN | (device.wantsWrite() ? POLLOUT : 0)), 0 });
+        }
+        size_t first = fds.size();
+        mux.addPollFds(fds);
+
+        if (poll(fds.data(), fds.size(), timeout) < 0) {
+            if (errno == EINTR) continue;
+            perror("hgmux: poll");
+            return 1;
+        }
+        uint64_t now = nowMs();
+        if (first == 1) {
+            if (fds[0].revents & POLLOUT) device.onWritable();
+            if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) device.onReadable(now);
+        }
+        mux.onPoll(std::vector<struct pollfd>(fds.begin() + first, fds.end()), now);
+    }
+
+    fprintf(stderr, "hgmux: %lu requests sent, %lu shared, %lu from cache\n",
+            device.requestsSent, device.shared, device.cacheHits);
+    return 0;
+}
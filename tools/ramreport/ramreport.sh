@@ -0,0 +1,63 @@
+#!/bin/sh
+# ramreport - static SRAM used by each part of the firmware build.
+#
+#   arduino-cli compile --fqbn arduino:avr:nano --build-path build firmware/main
+#   tools/ramreport/ramreport.sh build [SYMBOLS]
+#
+# Prints .data + .bss per object file (the sketch's classes, each
+# library, the core), the linked totals against the Nano's 2048 bytes,
+# and the SYMBOLS (default 15) largest statics in the linked image.
+
+set -e
+
+BUILD=${1:?usage: ramreport.sh BUILD_DIR [SYMBOLS]}
+SYMBOLS=${2:-15}
+RAM=2048
+SIZE=${AVR_SIZE:-avr-size}
+NM=${AVR_NM:-avr-nm}
+
+ELF=$(ls "$BUILD"/*.elf 2>/dev/null | head -n 1)
+if [ -z "$ELF" ]; then
+    echo "ramreport: no .elf in $BUILD" >&2
+    exit 1
+fi
+
+# .rodata lives in SRAM on the AVR (string literals without F()), so it
+# counts as data. Archives (the core) are summed over all members.
+objsize() {
+    "$SIZE" -A "$1" | awk -v name="$2" '
+        $1 ~ /^\.(data|rodata)/ { data += $2 }
+        $1 ~ /^\.bss/           { bss += $2 }
+        END { if (data + bss) printf "%7d %6d %6d  %s\n", data + bss, data, bss, name }'
+}
+
+echo "Static SRAM per object, before unused sections are dropped at link"
+echo "  bytes   data    bss  object"
+{
+    for obj in "$BUILD"/sketch/*.o; do
+        [ -f "$obj" ] && objsize "$obj" "$(basename "$obj" .o)"
+    done
+    for obj in "$BUILD"/libraries/*/*.o "$BUILD"/libraries/*/*/*.o; do
+        [ -f "$obj" ] && objsize "$obj" "$(basename "$(dirname "$obj")")/$(basename "$obj" .o)"
+    done
+    for lib in "$BUILD"/core/*.a; do
+        [ -f "$lib" ] && objsize "$lib" "core"
+    done
+} | sort -rn
+
+echo
+"$SIZE" -A "$ELF" | awk -v ram=$RAM '
+    $1 == ".data"   { data = $2 }
+    $1 == ".bss"    { bss = $2 }
+    $1 == ".noinit" { noinit = $2 }
+    END {
+        used = data + bss + noinit
+        printf "Linked: data %d + bss %d + noinit %d = %d of %d bytes, %d left for stack\n",
+               data, bss, noinit, used, ram, ram - used
+    }'
+
+echo
+echo "Largest statics"
+"$NM" -S -C --size-sort -t d "$ELF" | awk '$3 ~ /^[bBdD]$/' | tail -n "$SYMBOLS" |
+    awk '{ name = $4; for (i = 5; i <= NF; i++) name = name " " $i; printf "%7d  %s\n", $2, name }' |
+    sort -rn
@@ -0,0 +1,75 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+/*
+ * Trace files: "HGT1" followed by the records the firmware Recorder
+ * streams, minus the REC_MARK byte in front of each one.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "Recorder.h"  // REC_* record types, shared with the firmware
+
+static const char TRACE_MAGIC[4] = { 'H', 'G', 'T', '1' };
+
+struct TraceRecord {
+    uint8_t type;
+    uint32_t time;  // ms since the start of the trace
+    uint8_t payload[12];
+};
+
+inline int tracePayloadSize(uint8_t type) {
+    switch (type) {
+        case REC_IMU:    return 12;
+        case REC_BUTTON: return 1;
+        case REC_SERIAL: return 1;
+        case REC_GAP:    return 0;
+    }
+    return -1;
+}
+
+inline int16_t traceInt16(const uint8_t* p) {
+    return (int16_t)(p[0] | (p[1] << 8));
+}
+
+// Returns false (with a message in error) for truncated or unknown records
+inline bool loadTrace(const char* path, std::vector<TraceRecord>& records, std::string& error) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        error = std::string("cannot open ") + path;
+        return false;
+    }
+    char magic[4];
+    if (fread(magic, 1, 4, f) != 4 || memcmp(magic, TRACE_MAGIC, 4) != 0) {
+        fclose(f);
+        error = "not a trace file";
+        return false;
+    }
+    uint32_t time = 0;
+    uint8_t head[3];
+    while (fread(head, 1, 3, f) == 3) {
+        TraceRecord r;
+        r.type = head[0];
+        int size = tracePayloadSize(r.type);
+        if (size < 0) {
+            fclose(f);
+            error = "unknown record type";
+            return false;
+        }
+        time += head[1] | (head[2] << 8);
+        if (size > 0 && fread(r.payload, 1, size, f) != (size_t)size) {
+            fclose(f);
+            error = "truncated record";
+            return false;
+        }
+        r.time = time;
+        if (r.type != REC_GAP) records.push_back(r);
+    }
+    fclose(f);
+    return true;
+}
+
+#endif
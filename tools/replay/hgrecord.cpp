@@ -0,0 +1,131 @@
+/*
+ * hgrecord - capture a trace from a device streaming over serial.
+ *
+ *   hgrecord [--baud N] PORT OUT.hgt
+ *
+ * Sends REC_START, writes every record to OUT.hgt and echoes the
+ * device's text responses to stdout. Lines typed on stdin are sent to
+ * the device (and end up in the trace). EOF or Ctrl-C sends REC_STOP.
+ */
+
+#include "SerialPort.h"
+#include "TraceFormat.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace {
+
+volatile sig_atomic_t stopRequested = 0;
+
+void onSignal(int) { stopRequested = 1; }
+
+// Splits the device stream into text and REC_MARK records
+class StreamSplitter {
+public:
+    StreamSplitter(FILE* out) : out(out), need(0), have(0), records(0) {}
+
+    void feed(uint8_t c) {
+        if (need == 0) {
+            if (c == REC_MARK) {
+                need = 3;  // type + delta
+                have = 0;
+            } else {
+                fputc(c, stdout);
+            }
+            return;
+        }
+        record[have++] = c;
+        if (have == 3) {
+            int size = tracePayloadSize(record[0]);
+            if (size < 0) {
+                // Lost sync - drop back to text
+                need = 0;
+                return;
+            }
+            need = 3 + size;
+        }
+        if (have == need) {
+            fwrite(record, 1, have, out);
+            records++;
+            need = 0;
+        }
+    }
+
+    FILE* out;
+    uint8_t record[16];
+    int need;
+    int have;
+    unsigned long records;
+};
+
+}
+
+int main(int argc, char** argv) {
+    int baud = 9600;
+    const char* port = NULL;
+    const char* path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--baud") && i + 1 < argc) baud = atoi(argv[++i]);
+        else if (!port) port = argv[i];
+        else if (!path) path = argv[i];
+    }
+    if (!port || !path) {
+        fprintf(stderr, "usage: hgrecord [--baud N] PORT OUT.hgt\n");
+        return 2;
+    }
+
+    int fd = hg::openSerialPort(port, baud);
+    if (fd < 0) {
+        fprintf(stderr, "hgrecord: %s: %s\n", port, strerror(errno));
+        return 1;
+    }
+    FILE* out = fopen(path, "wb");
+    if (!out) {
+        fprintf(stderr, "hgrecord: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), out);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    // Opening the port resets the Nano through DTR; give it time to boot
+    sleep(2);
+    hg::writeAll(fd, "REC_START\n", 10);
+
+    StreamSplitter splitter(out);
+    bool stdinOpen = true;
+    while (!stopRequested) {
+        struct pollfd fds[2] = { { fd, POLLIN, 0 }, { STDIN_FILENO, POLLIN, 0 } };
+        int n = poll(fds, stdinOpen ? 2 : 1, 200);
+        if (n < 0 && errno != EINTR) break;
+
+        if (fds[0].revents & POLLIN) {
+            uint8_t buf[256];
+            ssize_t got = read(fd, buf, sizeof(buf));
+            for (ssize_t i = 0; i < got; i++) splitter.feed(buf[i]);
+            fflush(stdout);
+        }
+        if (stdinOpen && (fds[1].revents & (POLLIN | POLLHUP))) {
+            char line[128];
+            if (fgets(line, sizeof(line), stdin)) {
+                hg::writeAll(fd, line, strlen(line));
+            } else {
+                stdinOpen = false;
+                stopRequested = 1;
+            }
+        }
+    }
+
+    hg::writeAll(fd, "REC_STOP\n", 9);
+    close(fd);
+    fclose(out);
+    fprintf(stderr, "hgrecord: %lu records written to %s\n", splitter.records, path);
+    return 0;
+}
@@ -0,0 +1,191 @@
+/*
+ * hgreplay - run a recorded trace through the unmodified firmware on a
+ * virtual clock and check the resulting frames against a golden file.
+ *
+ *   hgreplay [--golden FILE [--update]] [--print] [--serial] [--tail MS] TRACE
+ */
+
+#include "Arduino.h"
+#include "HostShim.h"
+#include "config.h"
+#include "TraceFormat.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// The sketch
+void setup();
+void loop();
+
+namespace {
+
+struct Options {
+    const char* trace;
+    const char* golden;
+    bool update;
+    bool print;
+    bool serial;
+    uint32_t tailMs;
+};
+
+std::string frameLine() {
+    char buf[8];
+    std::string line;
+    for (int dev = 0; dev < NUM_MATRICES; dev++) {
+        if (dev) line += ' ';
+        for (int row = 0; row < 8; row++) {
+            snprintf(buf, sizeof(buf), "%02x", host::panelRow(dev, row));
+            line += buf;
+        }
+        // OP_SHUTDOWN register reads 0 while the driver is shut down
+        if (host::panelRegister(dev, 12) == 0) line += "-off";
+    }
+    return line;
+}
+
+class Runner {
+public:
+    Runner(const Options& opts) : opts(opts) {}
+
+    void record() {
+        std::string line = frameLine();
+        if (line == lastFrame) return;
+        lastFrame = line;
+        char stamp[24];
+        snprintf(stamp, sizeof(stamp), "%lu ", (unsigned long)(host::now() / 1000));
+        frames.push_back(stamp + line);
+        if (opts.print) printf("%s\n", frames.back().c_str());
+    }
+
+    void runUntil(uint64_t deadline) {
+        host::setWakeLimit(deadline);
+        while (host::now() < deadline) {
+            uint64_t before = host::now();
+            loop();
+            record();
+            // A pass that neither slept nor waited still costs CPU time
+            if (host::now() == before) host::advance(50);
+            flushSerial();
+        }
+    }
+
+    void apply(const TraceRecord& r) {
+        switch (r.type) {
+            case REC_IMU: {
+                host::ImuSample sample;
+                sample.ax = traceInt16(r.payload + 0);
+                sample.ay = traceInt16(r.payload + 2);
+                sample.az = traceInt16(r.payload + 4);
+                sample.gx = traceInt16(r.payload + 6);
+                sample.gy = traceInt16(r.payload + 8);
+                sample.gz = traceInt16(r.payload + 10);
+                host::setImu(sample);
+                break;
+            }
+            case REC_BUTTON:
+                host::setPin(PIN_BUTTON, r.payload[0]);
+                break;
+            case REC_SERIAL:
+                host::serialInject(r.payload[0]);
+                break;
+        }
+    }
+
+    void flushSerial() {
+        std::string out = host::serialTakeOutput();
+        if (opts.serial && !out.empty()) fwrite(out.data(), 1, out.size(), stderr);
+    }
+
+    const Options& opts;
+    std::string lastFrame;
+    std::vector<std::string> frames;
+};
+
+bool readLines(const char* path, std::vector<std::string>& lines) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty()) lines.push_back(line);
+    }
+    return true;
+}
+
+int usage() {
+    fprintf(stderr, "usage: hgreplay [--golden FILE [--update]] [--print] [--serial] [--tail MS] TRACE\n");
+    return 2;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Options opts = { NULL, NULL, false, false, false, 2000 };
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--golden") && i + 1 < argc) opts.golden = argv[++i];
+        else if (!strcmp(argv[i], "--update")) opts.update = true;
+        else if (!strcmp(argv[i], "--print")) opts.print = true;
+        else if (!strcmp(argv[i], "--serial")) opts.serial = true;
+        else if (!strcmp(argv[i], "--tail") && i + 1 < argc) opts.tailMs = strtoul(argv[++i], NULL, 10);
+        else if (argv[i][0] != '-' && !opts.trace) opts.trace = argv[i];
+        else return usage();
+    }
+    if (!opts.trace) return usage();
+
+    std::vector<TraceRecord> records;
+    std::string error;
+    if (!loadTrace(opts.trace, records, error)) {
+        fprintf(stderr, "hgreplay: %s: %s\n", opts.trace, error.c_str());
+        return 1;
+    }
+
+    host::attachMax7219(PIN_LOAD, NUM_MATRICES);
+#if GREYSCALE_BITS > 0
+    // A dimmed pixel is only latched for some of the bit planes; count it
+    // as lit if it was on at any point of the last refresh cycle
+    host::setPanelPersistence((uint64_t)GREY_SLOT_US << GREYSCALE_BITS);
+#endif
+    Runner runner(opts);
+    setup();
+    runner.record();
+    runner.flushSerial();
+
+    // Trace time starts once the sketch is up
+    uint64_t origin = host::now();
+    for (size_t i = 0; i < records.size(); i++) {
+        runner.runUntil(origin + (uint64_t)records[i].time * 1000);
+        runner.apply(records[i]);
+    }
+    runner.runUntil(host::now() + (uint64_t)opts.tailMs * 1000);
+
+    fprintf(stderr, "hgreplay: %zu records, %zu frames, %.3f s virtual\n",
+            records.size(), runner.frames.size(), host::now() / 1e6);
+
+    if (!opts.golden) return 0;
+
+    if (opts.update) {
+        std::ofstream out(opts.golden);
+        for (size_t i = 0; i < runner.frames.size(); i++) out << runner.frames[i] << '\n';
+        return out ? 0 : 1;
+    }
+
+    std::vector<std::string> expected;
+    if (!readLines(opts.golden, expected)) {
+        fprintf(stderr, "hgreplay: cannot read %s\n", opts.golden);
+        return 1;
+    }
+    size_t n = std::max(expected.size(), runner.frames.size());
+    for (size_t i = 0; i < n; i++) {
+        const char* want = i < expected.size() ? expected[i].c_str() : "<end>";
+        const char* got = i < runner.frames.size() ? runner.frames[i].c_str() : "<end>";
+        if (strcmp(want, got) != 0) {
+            fprintf(stderr, "hgreplay: frame %zu differs\n  expected: %s\n  actual:   %s\n", i, want, got);
+            return 1;
+        }
+    }
+    fprintf(stderr, "hgreplay: %zu frames match %s\n", n, opts.golden);
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * hgsim - run the firmware in real time behind a pseudo-terminal.
+ *
+ *   hgsim [--angle DEG] [--drift PPM] [--glitch MS] [--link PATH]
+ *
+ * The sketch is built against the host shim as for hgreplay, but its
+ * virtual clock follows the wall clock and its serial port is the
+ * master side of a pty. The slave path is printed on stdout (and
+ * symlinked to PATH with --link), so hgctl, hgmux or a terminal can
+ * open it like a Nano's port. Bytes cross the pty at SERIAL_BAUD in
+ * both directions, as they would over the UART.
+ *
+ * The IMU reads a still device tilted DEG degrees in the display plane
+ * (0: +X down, matrix A on top). --drift runs the device clock PPM
+ * parts per million fast (negative: slow), like an off-nominal resonator.
+ * --glitch overwrites a random display driver register with a random
+ * value every MS ms, and on exit prints how many the firmware rewrote
+ * and the longest any stayed wrong.
+ */
+
+#include "Arduino.h"
+#include "HostShim.h"
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <deque>
+#include <string>
+#include <utility>
+
+void setup();
+void loop();
+
+namespace {
+
+volatile sig_atomic_t stopRequested = 0;
+
+void onSignal(int) { stopRequested = 1; }
+
+uint64_t wallMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Opens the pty and keeps a slave fd of our own, so the master doesn't
+// hang up between clients
+int openPty(std::string& slavePath, int& slaveFd) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) return -1;
+    slavePath = ptsname(master);
+    slaveFd = open(slavePath.c_str(), O_RDWR | O_NOCTTY);
+    if (slaveFd < 0) return -1;
+    struct termios tio;
+    if (tcgetattr(slaveFd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(slaveFd, TCSANOW, &tio);
+    }
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    return master;
+}
+
+// Queues bytes with the wall time they finish crossing the line
+void queueBytes(std::deque<std::pair<uint8_t, uint64_t> >& line, uint64_t& lineFree,
+                const uint8_t* data, size_t len, uint64_t now) {
+    const uint64_t byteUs = 10000000ULL / SERIAL_BAUD;
+    for (size_t i = 0; i < len; i++) {
+        lineFree = (lineFree > now ? lineFree : now) + byteUs;
+        line.push_back(std::make_pair(data[i], lineFree));
+    }
+}
+
+int usage() {
+    fprintf(stderr, "usage: hgsim [--angle DEG] [--drift PPM] [--glitch MS] [--link PATH]\n");
+    return 2;
+}
+
+}
+
+int main(int argc, char** argv) {
+    double angle = 0;
+    double drift = 0;
+    double glitchMs = 0;
+    const char* link = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--angle") && i + 1 < argc) angle = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--drift") && i + 1 < argc) drift = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--glitch") && i + 1 < argc) glitchMs = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--link") && i + 1 < argc) link = argv[++i];
+        else return usage();
+    }
+
+    std::string slavePath;
+    int slaveFd = -1;
+    int master = openPty(slavePath, slaveFd);
+    if (master < 0) {
+        fprintf(stderr, "hgsim: pty: %s\n", strerror(errno));
+        return 1;
+    }
+    if (link) {
+        unlink(link);
+        if (symlink(slavePath.c_str(), link) != 0) {
+            fprintf(stderr, "hgsim: %s: %s\n", link, strerror(errno));
+            return 1;
+        }
+    }
+    printf("%s\n", slavePath.c_str());
+    fflush(stdout);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    host::attachMax7219(PIN_LOAD, NUM_MATRICES);
+    host::ImuSample still = { 0, 0, 0, 0, 0, 0 };
+    still.ax = (int16_t)(16384 * cos(angle * M_PI / 180));
+    still.ay = (int16_t)(16384 * sin(angle * M_PI / 180));
+    host::setImu(still);
+    setup();
+
+    uint64_t wallStart = wallMicros();
+    uint64_t origin = host::now();
+    std::deque<std::pair<uint8_t, uint64_t> > input, output;
+    uint64_t rxFree = 0, txFree = 0;
+    uint64_t nextGlitch = origin + (uint64_t)(glitchMs * 1000);
+    // Digit rows, decode mode, intensity, scan limit, shutdown, display test
+    static const uint8_t glitchRegs[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 15 };
+    while (!stopRequested) {
+        struct pollfd pfd = { master, POLLIN, 0 };
+        poll(&pfd, 1, 1);
+        uint64_t wall = wallMicros() - wallStart;
+
+        uint8_t buf[256];
+        ssize_t got;
+        while ((got = read(master, buf, sizeof(buf))) > 0) queueBytes(input, rxFree, buf, got, wall);
+        // The shim's RX buffer is 64 bytes like the real one; hold the rest back
+        while (!input.empty() && input.front().second <= wall && host::serialPending() < 32) {
+            host::serialInject(input.front().first);
+            input.pop_front();
+        }
+
+        uint64_t target = origin + (uint64_t)(wall * (1 + drift / 1e6));
+        host::setWakeLimit(target);
+        while (host::now() < target) {
+            uint64_t before = host::now();
+            loop();
+            if (host::now() == before) host::advance(50);
+            if (glitchMs > 0 && host::now() >= nextGlitch) {
+                host::glitchPanel(rand() % NUM_MATRICES, glitchRegs[rand() % sizeof(glitchRegs)], rand() & 0xFF);
+                nextGlitch += (uint64_t)(glitchMs * 1000);
+            }
+        }
+
+        std::string sent = host::serialTakeOutput();
+        queueBytes(output, txFree, (const uint8_t*)sent.data(), sent.size(), wall);
+        std::string due;
+        while (!output.empty() && output.front().second <= wall) {
+            due += (char)output.front().first;
+            output.pop_front();
+        }
+        if (!due.empty() && write(master, due.data(), due.size()) < 0 && errno != EAGAIN) break;
+    }
+
+    if (glitchMs > 0) {
+        fprintf(stderr, "hgsim: %lu glitches, %lu rewritten, longest %.1f ms wrong\n",
+                host::panelGlitches(), host::panelRepairs(), host::panelRepairMaxUs() / 1000.0);
+    }
+    if (link) unlink(link);
+    close(slaveFd);
+    close(master);
+    return 0;
+}
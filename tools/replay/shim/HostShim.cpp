@@ -0,0 +1,623 @@
+#include "Arduino.h"
+#include "Wire.h"
+#include "HostShim.h"
+#include "avr/sleep.h"
+#include "avr/eeprom.h"
+
+#include <deque>
+#include <vector>
+
+/* ========= REGISTERS ========= */
+volatile uint8_t SREG, MCUSR;
+volatile uint8_t DDRB, PORTB, PINB;
+volatile uint8_t DDRD, PORTD, PIND;
+volatile uint8_t SPCR, SPSR;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint16_t OCR1A;
+SpiDataRegister SPDR;
+Timer1Counter TCNT1;
+volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TIFR2, OCR2A, OCR2B;
+Timer2Counter TCNT2;
+volatile uint8_t EICRA, EIMSK, EIFR;
+volatile uint8_t PCICR, PCMSK2;
+volatile uint8_t ADCSRA;
+volatile uint8_t UCSR0A, UCSR0B;
+
+HardwareSerial Serial;
+TwoWire Wire;
+
+// Firmware that doesn't use a timer leaves its vector undefined
+extern "C" void TIMER1_COMPA_vect(void) __attribute__((weak));
+extern "C" void TIMER2_COMPA_vect(void) __attribute__((weak));
+
+namespace {
+
+const size_t SERIAL_RX_SIZE = 64;
+const size_t SERIAL_TX_SIZE = 64;
+
+struct State {
+    uint64_t clock;
+    uint64_t wakeLimit;
+    unsigned long sleeps;
+
+    uint8_t pins[NUM_DIGITAL_PINS];
+    void (*handlers[2])();
+    int handlerModes[2];
+
+    unsigned long baud;
+    std::deque<uint8_t> rx;
+    std::string tx;
+    size_t txQueued;
+    uint64_t txDrainedAt;
+
+    bool imuPresent;
+    uint8_t imuRegs[128];
+    uint8_t i2cPointer;
+    bool i2cAddressed;
+    std::vector<uint8_t> i2cRead;
+    size_t i2cReadPos;
+
+    int csPin;
+    int devices;
+    bool csLow;
+    std::vector<uint8_t> shifted;
+    uint8_t panel[8][16];
+    unsigned long latches;
+    // Values replaced on each digit row, for the persistence window
+    std::deque<std::pair<uint64_t, uint8_t> > replaced[8][8];
+    uint64_t persistence;
+    // When each register was last glitched (0: not since its last write)
+    uint64_t glitchedAt[8][16];
+    unsigned long glitches, repairs;
+    uint64_t repairMaxUs;
+
+    // Timer1 compare time (0 while stopped) and the last match
+    uint64_t timer1Due;
+    uint64_t timer1Start;
+    // The same for Timer2
+    uint64_t timer2Due;
+    uint64_t timer2Start;
+    bool inIsr;
+
+    uint32_t randomState;
+    uint8_t eeprom[E2END + 1];
+};
+
+void resetState(State& st);
+
+// Built on first use: firmware globals (LedControl) touch pins from
+// their constructors, before this file's static initialisers may run
+State& st() {
+    static State state;
+    static bool initialised = false;
+    if (!initialised) {
+        initialised = true;
+        resetState(state);
+    }
+    return state;
+}
+
+void drainTx() {
+    if (st().txQueued == 0 || st().baud == 0) {
+        st().txDrainedAt = st().clock;
+        return;
+    }
+    // 10 bit times per byte on the wire
+    uint64_t usPerByte = 10000000ULL / st().baud;
+    uint64_t done = (st().clock - st().txDrainedAt) / usPerByte;
+    if (done >= st().txQueued) {
+        st().txQueued = 0;
+        st().txDrainedAt = st().clock;
+    } else {
+        st().txQueued -= done;
+        st().txDrainedAt += done * usPerByte;
+    }
+}
+
+void latchPanel() {
+    // First pair shifted out ends up in the last device of the chain
+    size_t pairs = st().shifted.size() / 2;
+    for (size_t k = 0; k < pairs && (int)k < st().devices; k++) {
+        int device = st().devices - 1 - (int)k;
+        uint8_t opcode = st().shifted[k * 2] & 0x0F;
+        uint8_t data = st().shifted[k * 2 + 1];
+        if (opcode == 0) continue;
+        if (opcode <= 8 && st().persistence && st().panel[device][opcode] != data) {
+            std::deque<std::pair<uint64_t, uint8_t> >& history = st().replaced[device][opcode - 1];
+            history.push_back(std::make_pair(st().clock, st().panel[device][opcode]));
+            while (history.front().first + st().persistence < st().clock) history.pop_front();
+        }
+        st().panel[device][opcode] = data;
+        if (st().glitchedAt[device][opcode]) {
+            uint64_t took = st().clock - st().glitchedAt[device][opcode];
+            if (took > st().repairMaxUs) st().repairMaxUs = took;
+            st().glitchedAt[device][opcode] = 0;
+            st().repairs++;
+        }
+    }
+    st().shifted.clear();
+    st().latches++;
+}
+
+void resetState(State& state) {
+    state.clock = 0;
+    state.wakeLimit = ~0ULL;
+    state.sleeps = 0;
+    for (int i = 0; i < NUM_DIGITAL_PINS; i++) state.pins[i] = HIGH;
+    state.handlers[0] = state.handlers[1] = NULL;
+    state.baud = 0;
+    state.rx.clear();
+    state.tx.clear();
+    state.txQueued = 0;
+    state.txDrainedAt = 0;
+    state.imuPresent = true;
+    memset(state.imuRegs, 0, sizeof(state.imuRegs));
+    state.imuRegs[0x75] = 0x68;
+    state.i2cPointer = 0;
+    state.i2cAddressed = false;
+    state.i2cRead.clear();
+    state.i2cReadPos = 0;
+    state.csPin = -1;
+    state.devices = 0;
+    state.csLow = false;
+    state.shifted.clear();
+    memset(state.panel, 0, sizeof(state.panel));
+    state.latches = 0;
+    for (int d = 0; d < 8; d++)
+        for (int r = 0; r < 8; r++) state.replaced[d][r].clear();
+    state.persistence = 0;
+    memset(state.glitchedAt, 0, sizeof(state.glitchedAt));
+    state.glitches = state.repairs = 0;
+    state.repairMaxUs = 0;
+    state.timer1Due = 0;
+    state.timer1Start = 0;
+    state.timer2Due = 0;
+    state.timer2Start = 0;
+    state.inIsr = false;
+    state.randomState = 1;
+    memset(state.eeprom, 0xFF, sizeof(state.eeprom));
+}
+
+// Length of a Timer1 tick in us from the clock select bits (prescaler >= 16 only
+// resolves to whole microseconds; finer prescalers count as 1 us)
+uint64_t timer1TickUs() {
+    static const uint16_t prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+    uint16_t p = prescale[TCCR1B & 7];
+    return p >= 16 ? p / 16 : (p ? 1 : 0);
+}
+
+bool timer1Running() {
+    return timer1TickUs() && (TIMSK1 & _BV(OCIE1A)) && TIMER1_COMPA_vect;
+}
+
+uint64_t timer1Period() { return ((uint64_t)OCR1A + 1) * timer1TickUs(); }
+
+// Runs every compare match up to the target time, CTC mode
+void runTimer1(uint64_t target) {
+    if (!timer1Running()) {
+        st().timer1Due = 0;
+        return;
+    }
+    if (st().inIsr) return;
+    if (st().timer1Due == 0) {
+        st().timer1Start = st().clock;
+        st().timer1Due = st().clock + timer1Period();
+    }
+    while (st().timer1Due && st().timer1Due <= target) {
+        st().clock = st().timer1Due;
+        drainTx();
+        st().timer1Start = st().clock;
+        st().inIsr = true;
+        TIMER1_COMPA_vect();
+        st().inIsr = false;
+        st().timer1Due = timer1Running() ? st().timer1Start + timer1Period() : 0;
+        // An interrupt that outlasts its period loses the matches it overran
+        while (st().timer1Due && st().timer1Due <= st().clock) st().timer1Due += timer1Period();
+    }
+}
+
+// Timer2 prescalers, by clock select bits
+const uint16_t TIMER2_PRESCALE[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+bool timer2Running() {
+    return (TCCR2B & 7) && (TIMSK2 & _BV(OCIE2A)) && TIMER2_COMPA_vect;
+}
+
+// CTC period in whole microseconds, at least one
+uint64_t timer2Period() {
+    uint64_t ticks = ((uint64_t)OCR2A + 1) * TIMER2_PRESCALE[TCCR2B & 7];
+    return ticks >= 24 ? (ticks + 8) / 16 : 1;
+}
+
+void runTimer2(uint64_t target) {
+    if (!timer2Running()) {
+        st().timer2Due = 0;
+        return;
+    }
+    if (st().inIsr) return;
+    if (st().timer2Due == 0) {
+        st().timer2Start = st().clock;
+        st().timer2Due = st().clock + timer2Period();
+    }
+    while (st().timer2Due && st().timer2Due <= target) {
+        st().clock = st().timer2Due;
+        st().timer2Start = st().clock;
+        st().inIsr = true;
+        TIMER2_COMPA_vect();
+        st().inIsr = false;
+        st().timer2Due = timer2Running() ? st().timer2Start + timer2Period() : 0;
+    }
+}
+
+// Both timers up to the target, their interrupts in time order
+void runTimers(uint64_t target) {
+    runTimer1(st().clock);
+    runTimer2(st().clock);
+    for (;;) {
+        uint64_t next = target;
+        if (st().timer1Due && st().timer1Due < next) next = st().timer1Due;
+        if (st().timer2Due && st().timer2Due < next) next = st().timer2Due;
+        runTimer1(next);
+        runTimer2(next);
+        if (next == target) break;
+    }
+}
+
+}
+
+SpiDataRegister& SpiDataRegister::operator=(uint8_t data) {
+    value = data;
+    if (SPCR & _BV(SPE)) {
+        if (st().csLow) st().shifted.push_back(data);
+        SPSR |= _BV(SPIF);
+        // 8 bits at fosc/2 plus the polling loop; no interrupts in between
+        st().clock += 1;
+    }
+    return *this;
+}
+
+Timer1Counter& Timer1Counter::operator=(uint16_t ticks) {
+    st().timer1Start = st().clock - ticks * timer1TickUs();
+    st().timer1Due = st().timer1Start + timer1Period();
+    return *this;
+}
+
+Timer2Counter& Timer2Counter::operator=(uint8_t) {
+    // Counting restarts from the next run of the timers
+    st().timer2Due = 0;
+    return *this;
+}
+
+Timer2Counter::operator uint8_t() const {
+    uint64_t ticks = (st().clock - st().timer2Start) * 16;
+    uint16_t prescale = TIMER2_PRESCALE[TCCR2B & 7];
+    return prescale ? (uint8_t)(ticks / prescale) : 0;
+}
+
+Timer1Counter::operator uint16_t() const {
+    uint64_t tick = timer1TickUs();
+    return tick ? (uint16_t)((st().clock - st().timer1Start) / tick) : 0;
+}
+
+/* ========= CONTROL SURFACE ========= */
+namespace host {
+
+uint64_t now() { return st().clock; }
+
+void advance(uint64_t us) {
+    uint64_t target = st().clock + us;
+    runTimers(target);
+    if (st().clock < target) st().clock = target;
+    drainTx();
+}
+
+void setWakeLimit(uint64_t us) { st().wakeLimit = us; }
+unsigned long sleepCount() { return st().sleeps; }
+
+void setPin(uint8_t pin, uint8_t level) {
+    if (pin >= NUM_DIGITAL_PINS) return;
+    uint8_t old = st().pins[pin];
+    st().pins[pin] = level ? HIGH : LOW;
+    int irq = digitalPinToInterrupt(pin);
+    if (irq < 0 || !st().handlers[irq] || old == st().pins[pin]) return;
+    int mode = st().handlerModes[irq];
+    if (mode == CHANGE || (mode == RISING && level) || (mode == FALLING && !level)) {
+        st().handlers[irq]();
+    }
+}
+
+uint8_t getPin(uint8_t pin) { return pin < NUM_DIGITAL_PINS ? st().pins[pin] : LOW; }
+
+void serialInject(uint8_t c) {
+    if (st().rx.size() < SERIAL_RX_SIZE - 1) st().rx.push_back(c);
+}
+
+size_t serialPending() { return st().rx.size(); }
+
+std::string serialTakeOutput() {
+    std::string out;
+    out.swap(st().tx);
+    return out;
+}
+
+void setImuPresent(bool present) { st().imuPresent = present; }
+
+void setImu(const ImuSample& sample) {
+    const int16_t values[7] = { sample.ax, sample.ay, sample.az, 0, sample.gx, sample.gy, sample.gz };
+    for (int i = 0; i < 7; i++) {
+        st().imuRegs[0x3B + i * 2] = (uint8_t)(values[i] >> 8);
+        st().imuRegs[0x3B + i * 2 + 1] = (uint8_t)(values[i] & 0xFF);
+    }
+}
+
+uint8_t imuRegister(uint8_t reg) { return st().imuRegs[reg & 0x7F]; }
+
+void attachMax7219(uint8_t csPin, int devices) {
+    st().csPin = csPin;
+    st().devices = devices > 8 ? 8 : devices;
+}
+
+uint8_t panelRow(int device, int row) {
+    uint8_t value = st().panel[device & 7][(row & 7) + 1];
+    const std::deque<std::pair<uint64_t, uint8_t> >& history = st().replaced[device & 7][row & 7];
+    for (size_t i = 0; i < history.size(); i++) {
+        if (history[i].first + st().persistence >= st().clock) value |= history[i].second;
+    }
+    return value;
+}
+
+void setPanelPersistence(uint64_t us) { st().persistence = us; }
+uint8_t panelRegister(int device, int reg) { return st().panel[device & 7][reg & 15]; }
+unsigned long panelLatches() { return st().latches; }
+
+void glitchPanel(int device, int reg, uint8_t value) {
+    device &= 7;
+    reg &= 15;
+    st().panel[device][reg] = value;
+    if (!st().glitchedAt[device][reg]) st().glitches++;
+    st().glitchedAt[device][reg] = st().clock ? st().clock : 1;
+}
+
+unsigned long panelGlitches() { return st().glitches; }
+unsigned long panelRepairs() { return st().repairs; }
+uint64_t panelRepairMaxUs() { return st().repairMaxUs; }
+
+unsigned int buzzerFrequency() {
+    // OC2B toggles once per compare match while connected
+    if (!(TCCR2A & _BV(COM2B0)) || !(TCCR2B & 7)) return 0;
+    return F_CPU / 2 / TIMER2_PRESCALE[TCCR2B & 7] / (OCR2A + 1);
+}
+
+void reset() { resetState(st()); }
+
+}
+
+/* ========= TIME ========= */
+unsigned long millis() { return (unsigned long)(uint32_t)(st().clock / 1000); }
+unsigned long micros() { return (unsigned long)(uint32_t)st().clock; }
+void delay(unsigned long ms) { host::advance((uint64_t)ms * 1000); }
+void delayMicroseconds(unsigned int us) { host::advance(us); }
+
+void set_sleep_mode(int) {}
+void sleep_enable() {}
+void sleep_disable() {}
+
+void sleep_cpu() {
+    // Next Timer0 tick, unless something else is due earlier
+    uint64_t wake = (st().clock / 1000 + 1) * 1000;
+    if (st().timer1Due && wake > st().timer1Due) wake = st().timer1Due;
+    if (st().timer2Due && wake > st().timer2Due) wake = st().timer2Due;
+    if (wake > st().wakeLimit) wake = st().wakeLimit;
+    if (wake > st().clock) host::advance(wake - st().clock);
+    st().sleeps++;
+}
+
+/* ========= PINS ========= */
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin < NUM_DIGITAL_PINS && mode == INPUT_PULLUP) st().pins[pin] = HIGH;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin < NUM_DIGITAL_PINS) st().pins[pin] = value ? HIGH : LOW;
+    if ((int)pin != st().csPin) return;
+    if (!value) {
+        st().csLow = true;
+        st().shifted.clear();
+    } else if (st().csLow) {
+        st().csLow = false;
+        latchPanel();
+    }
+}
+
+int digitalRead(uint8_t pin) { return pin < NUM_DIGITAL_PINS ? st().pins[pin] : LOW; }
+
+int analogRead(uint8_t) { return 512; }
+
+void shiftOut(uint8_t, uint8_t, uint8_t bitOrder, uint8_t value) {
+    if (bitOrder == LSBFIRST) {
+        uint8_t r = 0;
+        for (int i = 0; i < 8; i++) if (value & (1 << i)) r |= 0x80 >> i;
+        value = r;
+    }
+    if (st().csLow) st().shifted.push_back(value);
+    // ~16 us per bit with digitalWrite on a 16 MHz AVR
+    host::advance(128);
+}
+
+
+/* ========= RANDOM (avr-libc Park-Miller, same sequence as the device) ========= */
+long random(long howbig) {
+    if (howbig == 0) return 0;
+    int32_t x = (int32_t)st().randomState;
+    if (x == 0) x = 123459876L;
+    int32_t hi = x / 127773L;
+    int32_t lo = x % 127773L;
+    x = 16807L * lo - 2836L * hi;
+    if (x < 0) x += 0x7fffffffL;
+    st().randomState = (uint32_t)x;
+    return (long)((uint32_t)x % 0x80000000UL) % howbig;
+}
+
+long random(long howsmall, long howbig) {
+    if (howsmall >= howbig) return howsmall;
+    return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed) {
+    if (seed != 0) st().randomState = (uint32_t)seed;
+}
+
+/* ========= INTERRUPTS ========= */
+void attachInterrupt(uint8_t interruptNum, void (*handler)(), int mode) {
+    if (interruptNum > 1) return;
+    st().handlers[interruptNum] = handler;
+    st().handlerModes[interruptNum] = mode;
+}
+
+void detachInterrupt(uint8_t interruptNum) {
+    if (interruptNum <= 1) st().handlers[interruptNum] = NULL;
+}
+
+void noInterrupts() {}
+void interrupts() {}
+
+/* ========= PRINT ========= */
+size_t Print::write(const uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (size--) n += write(*buffer++);
+    return n;
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+    char buf[8 * sizeof(long) + 1];
+    char* str = &buf[sizeof(buf) - 1];
+    *str = '\0';
+    if (base < 2) base = 10;
+    do {
+        char c = n % base;
+        n /= base;
+        *--str = c < 10 ? c + '0' : c + 'A' - 10;
+    } while (n);
+    return write(str);
+}
+
+size_t Print::print(const __FlashStringHelper* fs) { return write(reinterpret_cast<const char*>(fs)); }
+size_t Print::print(const char* str) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(unsigned char n, int base) { return print((unsigned long)n, base); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long)n, base); }
+
+size_t Print::print(long n, int base) {
+    // AVR long is 32 bits
+    int32_t v = (int32_t)n;
+    if (base == 10 && v < 0) {
+        size_t t = print('-');
+        return t + printNumber((unsigned long)(-(int64_t)v), 10);
+    }
+    return printNumber((uint32_t)v, base);
+}
+
+size_t Print::print(unsigned long n, int base) { return printNumber((uint32_t)n, base); }
+
+size_t Print::print(double number, int digits) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.*f", digits, number);
+    return write(buf);
+}
+
+size_t Print::println() { return write("\r\n"); }
+
+/* ========= SERIAL ========= */
+void HardwareSerial::begin(unsigned long baud) {
+    st().baud = baud;
+    st().txDrainedAt = st().clock;
+}
+
+void HardwareSerial::end() { st().baud = 0; }
+int HardwareSerial::available() { return (int)st().rx.size(); }
+int HardwareSerial::peek() { return st().rx.empty() ? -1 : st().rx.front(); }
+
+int HardwareSerial::read() {
+    if (st().rx.empty()) return -1;
+    uint8_t c = st().rx.front();
+    st().rx.pop_front();
+    return c;
+}
+
+int HardwareSerial::availableForWrite() {
+    drainTx();
+    return (int)(SERIAL_TX_SIZE - 1 - st().txQueued);
+}
+
+void HardwareSerial::flush() {
+    drainTx();
+    if (st().txQueued && st().baud) host::advance(st().txQueued * 10000000ULL / st().baud);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+    drainTx();
+    // Blocks like the real driver once the TX ring is full
+    while (st().baud && st().txQueued >= SERIAL_TX_SIZE - 1) {
+        host::advance(10000000ULL / st().baud);
+    }
+    st().tx.push_back((char)c);
+    if (st().baud) st().txQueued++;
+    return 1;
+}
+
+/* ========= I2C ========= */
+void TwoWire::begin() {}
+void TwoWire::begin(int, int) {}
+void TwoWire::setClock(unsigned long) {}
+
+void TwoWire::beginTransmission(uint8_t) {
+    st().i2cAddressed = false;
+}
+
+size_t TwoWire::write(uint8_t value) {
+    if (!st().i2cAddressed) {
+        st().i2cPointer = value & 0x7F;
+        st().i2cAddressed = true;
+    } else {
+        st().imuRegs[st().i2cPointer] = value;
+        st().i2cPointer = (st().i2cPointer + 1) & 0x7F;
+    }
+    return 1;
+}
+
+uint8_t TwoWire::endTransmission(bool) {
+    return st().imuPresent ? 0 : 2;
+}
+
+uint8_t TwoWire::requestFrom(int, int quantity, bool) {
+    st().i2cRead.clear();
+    st().i2cReadPos = 0;
+    if (!st().imuPresent) return 0;
+    for (int i = 0; i < quantity; i++) {
+        st().i2cRead.push_back(st().imuRegs[(st().i2cPointer + i) & 0x7F]);
+    }
+    // 14 bytes at 100 kHz
+    host::advance(20 + quantity * 90);
+    return (uint8_t)quantity;
+}
+
+int TwoWire::available() { return (int)(st().i2cRead.size() - st().i2cReadPos); }
+
+int TwoWire::read() {
+    if (st().i2cReadPos >= st().i2cRead.size()) return -1;
+    return st().i2cRead[st().i2cReadPos++];
+}
+
+/* ========= EEPROM ========= */
+uint8_t eeprom_read_byte(const uint8_t* addr) { return st().eeprom[(uintptr_t)addr & E2END]; }
+void eeprom_write_byte(uint8_t* addr, uint8_t value) { st().eeprom[(uintptr_t)addr & E2END] = value; }
+void eeprom_update_byte(uint8_t* addr, uint8_t value) { eeprom_write_byte(addr, value); }
+
+void eeprom_read_block(void* dst, const void* src, size_t n) {
+    for (size_t i = 0; i < n; i++) ((uint8_t*)dst)[i] = eeprom_read_byte((const uint8_t*)src + i);
+}
+
+void eeprom_update_block(const void* src, void* dst, size_t n) {
+    for (size_t i = 0; i < n; i++) eeprom_update_byte((uint8_t*)dst + i, ((const uint8_t*)src)[i]);
+}
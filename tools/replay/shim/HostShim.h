@@ -0,0 +1,67 @@
+#ifndef HOST_SHIM_H
+#define HOST_SHIM_H
+
+/*
+ * Control surface of the host Arduino shim, used by the replay runner
+ * and other host tools that link the unmodified firmware.
+ */
+
+#include <stdint.h>
+#include <string>
+
+namespace host {
+
+struct ImuSample {
+    int16_t ax, ay, az;
+    int16_t gx, gy, gz;
+};
+
+// ----- Virtual clock (microseconds) -----
+uint64_t now();
+void advance(uint64_t us);
+// sleep_cpu() and blocking waits never run the clock past this point
+void setWakeLimit(uint64_t us);
+unsigned long sleepCount();
+
+// ----- Pins -----
+// Drive an input pin from outside; fires attachInterrupt() handlers
+void setPin(uint8_t pin, uint8_t level);
+uint8_t getPin(uint8_t pin);
+
+// ----- Serial -----
+void serialInject(uint8_t c);
+size_t serialPending();
+std::string serialTakeOutput();
+
+// ----- MPU6050 on the I2C bus -----
+void setImuPresent(bool present);
+void setImu(const ImuSample& sample);
+uint8_t imuRegister(uint8_t reg);
+
+// ----- MAX7219 chain -----
+void attachMax7219(uint8_t csPin, int devices);
+// Digit row (0..7) of a device as currently latched, plus every pixel
+// that was lit within the persistence window
+uint8_t panelRow(int device, int row);
+// Window for panelRow(), so time-multiplexed grey levels read as one
+// frame; 0 (the default) reports only the latched value
+void setPanelPersistence(uint64_t us);
+// Any control/digit register (opcode 1..15)
+uint8_t panelRegister(int device, int reg);
+unsigned long panelLatches();
+// Overwrite a register as supply noise would. The chain's next write to
+// it counts as a repair, with the longest wait kept
+void glitchPanel(int device, int reg, uint8_t value);
+unsigned long panelGlitches();
+unsigned long panelRepairs();
+uint64_t panelRepairMaxUs();
+
+// ----- Buzzer -----
+unsigned int buzzerFrequency();
+
+// ----- Reset all state to power-on -----
+void reset();
+
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef WIRE_H
+#define WIRE_H
+
+#include "Arduino.h"
+
+class TwoWire {
+public:
+    void begin();
+    void begin(int sda, int scl);
+    void setClock(unsigned long clock);
+    void beginTransmission(uint8_t address);
+    uint8_t endTransmission(bool sendStop = true);
+    size_t write(uint8_t value);
+    uint8_t requestFrom(int address, int quantity, bool sendStop = true);
+    int available();
+    int read();
+};
+
+extern TwoWire Wire;
+
+#endif
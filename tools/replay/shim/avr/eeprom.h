@@ -0,0 +1,13 @@
+#ifndef EEPROM_H_AVR
+#define EEPROM_H_AVR
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint8_t eeprom_read_byte(const uint8_t* addr);
+void eeprom_write_byte(uint8_t* addr, uint8_t value);
+void eeprom_update_byte(uint8_t* addr, uint8_t value);
+void eeprom_read_block(void* dst, const void* src, size_t n);
+void eeprom_update_block(const void* src, void* dst, size_t n);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef INTERRUPT_H
+#define INTERRUPT_H
+
+// Interrupt vectors become plain functions the replay runner can call
+#define ISR(vector, ...) extern "C" void vector(void)
+#define sei()
+#define cli()
+
+#endif
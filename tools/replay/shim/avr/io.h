@@ -0,0 +1,90 @@
+#ifndef IO_H
+#define IO_H
+
+// ATmega328P registers as plain memory, bit names as in avr-libc
+
+#include <stdint.h>
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define _BV(bit) (1 << (bit))
+#define RAMSTART 0x100
+#define RAMEND 0x8FF
+#define E2END 0x3FF
+
+extern volatile uint8_t SREG;
+extern volatile uint8_t MCUSR;
+extern volatile uint8_t DDRB, PORTB, PINB;
+extern volatile uint8_t DDRD, PORTD, PIND;
+extern volatile uint8_t SPCR, SPSR;
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint16_t OCR1A;
+extern volatile uint8_t TCCR2A, TCCR2B, TIMSK2, TIFR2, OCR2A, OCR2B;
+extern volatile uint8_t EICRA, EIMSK, EIFR;
+extern volatile uint8_t PCICR, PCMSK2;
+extern volatile uint8_t ADCSRA;
+extern volatile uint8_t UCSR0A, UCSR0B;
+
+// Registers whose accesses have side effects in the shim: a byte written
+// to SPDR goes out to the MAX7219 chain, TCNT1 follows the virtual clock,
+// writing TCNT2 restarts Timer2's period
+struct SpiDataRegister {
+    uint8_t value;
+    SpiDataRegister& operator=(uint8_t data);
+    operator uint8_t() const { return value; }
+};
+struct Timer1Counter {
+    Timer1Counter& operator=(uint16_t ticks);
+    operator uint16_t() const;
+};
+struct Timer2Counter {
+    Timer2Counter& operator=(uint8_t ticks);
+    operator uint8_t() const;
+};
+extern SpiDataRegister SPDR;
+extern Timer1Counter TCNT1;
+extern Timer2Counter TCNT2;
+
+// SPI
+#define SPIE 7
+#define SPE 6
+#define DORD 5
+#define MSTR 4
+#define CPOL 3
+#define CPHA 2
+#define SPR1 1
+#define SPR0 0
+#define SPIF 7
+#define SPI2X 0
+
+// Timer1
+#define WGM10 0
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define OCIE1A 1
+#define OCF1A 1
+
+// Timer2
+#define WGM20 0
+#define WGM21 1
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define OCIE2A 1
+#define COM2B0 4
+#define OCF2A 1
+
+// Pin change interrupts
+#define PCIE2 2
+#define PCINT16 0
+
+// ADC
+#define ADEN 7
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef SLEEP_H
+#define SLEEP_H
+
+#define SLEEP_MODE_IDLE 0
+#define SLEEP_MODE_PWR_DOWN 2
+#define SLEEP_MODE_PWR_SAVE 3
+
+void set_sleep_mode(int mode);
+void sleep_enable();
+void sleep_disable();
+void sleep_cpu();
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+// Single-threaded host: the block just runs once
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 1
+#define ATOMIC_BLOCK(type) for (int _atomic_once = 1; _atomic_once; _atomic_once = 0)
+
+#endif